@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "Codec2-types"
 #include <log/log.h>
+#include <unistd.h>
 
 #include <codec2/hidl/1.0/types.h>
 
@@ -27,6 +28,7 @@
 #include <C2BlockInternal.h>
 #include <C2Buffer.h>
 #include <C2Component.h>
+#include <C2FenceFactory.h>
 #include <C2Param.h>
 #include <C2ParamInternal.h>
 #include <C2PlatformSupport.h>
@@ -668,15 +670,31 @@ Status addBaseBlock(
 }
 
 // C2Fence -> hidl_handle
-// Note: File descriptors are not duplicated. The original file descriptor must
-// not be closed before the transaction is complete.
+// Note: The file descriptor is duplicated and owned by the hidl_handle. Fences
+// that are not backed by a sync_file cannot be transferred and are waited for,
+// for at most FENCE_WAIT_TIMEOUT_NS as this blocks the calling (binder) thread.
+constexpr c2_nsecs_t FENCE_WAIT_TIMEOUT_NS = 1000000000ll;  // 1 second
+
 Status objcpy(hidl_handle* d, const C2Fence& s) {
-    (void)s; // TODO: implement s.fd()
-    int fenceFd = -1;
     d->setTo(nullptr);
+    int fenceFd = s.fd();
+    if (fenceFd < 0 && !s.ready()) {
+        ALOGD("Waiting for a fence that cannot be transferred.");
+        C2Fence fence = s;
+        c2_status_t err = fence.wait(FENCE_WAIT_TIMEOUT_NS);
+        if (err == C2_TIMED_OUT) {
+            ALOGE("Fence was not signaled within %lld ms.",
+                  static_cast<long long>(FENCE_WAIT_TIMEOUT_NS / 1000000));
+            return Status::TIMED_OUT;
+        } else if (err != C2_OK) {
+            ALOGE("Failed to wait for fence: %d", static_cast<int>(err));
+            return static_cast<Status>(err);
+        }
+    }
     if (fenceFd >= 0) {
         native_handle_t *handle = native_handle_create(1, 0);
         if (!handle) {
+            close(fenceFd);
             return Status::NO_MEMORY;
         }
         handle->data[0] = fenceFd;
@@ -1056,12 +1074,20 @@ struct C2BaseBlock {
 };
 
 // hidl_handle -> C2Fence
-// Note: File descriptors are not duplicated. The original file descriptor must
-// not be closed before the transaction is complete.
+// Note: The file descriptor is duplicated, so the original may be closed once
+// the transaction is complete.
 c2_status_t objcpy(C2Fence* d, const hidl_handle& s) {
-    // TODO: Implement.
-    (void)s;
     *d = C2Fence();
+    const native_handle_t* handle = s.getNativeHandle();
+    if (!handle || handle->numFds < 1) {
+        return C2_OK;
+    }
+    int fenceFd = dup(handle->data[0]);
+    if (fenceFd < 0) {
+        ALOGE("Failed to duplicate fence fd.");
+        return C2_NO_MEMORY;
+    }
+    *d = _C2FenceFactory::CreateSyncFence(fenceFd);
     return C2_OK;
 }
 
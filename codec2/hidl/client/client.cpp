@@ -23,6 +23,7 @@
 #include <deque>
 #include <limits>
 #include <map>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -32,6 +33,7 @@
 #include <gui/bufferqueue/1.0/H2BGraphicBufferProducer.h>
 #include <hidl/HidlSupport.h>
 #include <media/stagefright/bqhelper/WGraphicBufferProducer.h>
+#include <utils/Timers.h>
 #undef LOG
 
 #include <android/hardware/media/bufferpool/1.0/IClientManager.h>
@@ -789,6 +791,154 @@ const std::vector<C2Component::Traits>& Codec2Client::ListComponents() {
 Codec2Client::Listener::~Listener() {
 }
 
+// Codec2Client::Component::InputBuffers
+
+Codec2Client::Component::InputBuffers::InputBuffers() : mNumOverflow(0) {
+    for (Slot& slot : mSlots) {
+        slot.state.store(kFreeSlot, std::memory_order_relaxed);
+        slot.frameIndex.store(0, std::memory_order_relaxed);
+        slot.pending.store(0, std::memory_order_relaxed);
+        slot.users.store(0, std::memory_order_relaxed);
+        slot.queuedNs = 0;
+    }
+}
+
+bool Codec2Client::Component::InputBuffers::Acquire(Slot& slot, uint64_t frameIndex) {
+    // Announce the access before checking the slot, so that the slot is
+    // not reused for another frame until Release() (see add()).
+    slot.users.fetch_add(1);
+    if (slot.state.load() != kHeldSlot || slot.frameIndex.load() != frameIndex) {
+        slot.users.fetch_sub(1);
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<C2Buffer> Codec2Client::Component::InputBuffers::Release(
+        Slot& slot, uint32_t bits, bool last, size_t bufferIndex) {
+    // The caller owns the buffers for |bits| as it has cleared their bits.
+    std::array<std::shared_ptr<C2Buffer>, kMaxSlotBuffers> released;
+    for (size_t i = 0; i < kMaxSlotBuffers; ++i) {
+        if (bits & (1u << i)) {
+            released[i] = std::move(slot.buffers[i]);
+        }
+    }
+    if (last) {
+        ALOGV("input frame %llu released %lld us after queueing",
+              (unsigned long long)slot.frameIndex.load(),
+              (long long)(systemTime() - slot.queuedNs) / 1000);
+        slot.state.store(kFreeSlot);
+    }
+    slot.users.fetch_sub(1);
+    return bufferIndex < kMaxSlotBuffers ? released[bufferIndex] : nullptr;
+}
+
+bool Codec2Client::Component::InputBuffers::add(
+        uint64_t frameIndex,
+        const std::vector<std::shared_ptr<C2Buffer>>& buffers) {
+    bool added = !remove(frameIndex);
+    Slot& slot = mSlots[frameIndex % kNumSlots];
+    uint32_t expected = kFreeSlot;
+    if (buffers.size() <= kMaxSlotBuffers
+            && slot.state.compare_exchange_strong(expected, kClaimedSlot)) {
+        // Wait for threads that released the previous frame in this slot.
+        while (slot.users.load() != 0) {
+            std::this_thread::yield();
+        }
+        std::copy(buffers.begin(), buffers.end(), slot.buffers.begin());
+        slot.queuedNs = systemTime();
+        slot.pending.store((1u << buffers.size()) - 1, std::memory_order_relaxed);
+        slot.frameIndex.store(frameIndex);
+        slot.state.store(kHeldSlot);
+        return added;
+    }
+    std::lock_guard<std::mutex> lock(mOverflowMutex);
+    mOverflow[frameIndex] = { buffers, buffers.size() };
+    mNumOverflow.store(mOverflow.size());
+    return added;
+}
+
+bool Codec2Client::Component::InputBuffers::remove(uint64_t frameIndex) {
+    Slot& slot = mSlots[frameIndex % kNumSlots];
+    if (Acquire(slot, frameIndex)) {
+        uint32_t bits = slot.pending.exchange(0);
+        Release(slot, bits, bits != 0, kMaxSlotBuffers);
+        return bits != 0;
+    }
+    if (mNumOverflow.load() == 0) {
+        return false;
+    }
+    std::vector<std::shared_ptr<C2Buffer>> released;
+    {
+        std::lock_guard<std::mutex> lock(mOverflowMutex);
+        auto it = mOverflow.find(frameIndex);
+        if (it == mOverflow.end()) {
+            return false;
+        }
+        released = std::move(it->second.first);
+        mOverflow.erase(it);
+        mNumOverflow.store(mOverflow.size());
+    }
+    return true;
+}
+
+std::shared_ptr<C2Buffer> Codec2Client::Component::InputBuffers::remove(
+        uint64_t frameIndex, size_t bufferIndex) {
+    Slot& slot = mSlots[frameIndex % kNumSlots];
+    if (Acquire(slot, frameIndex)) {
+        uint32_t bit = bufferIndex < kMaxSlotBuffers ? (1u << bufferIndex) : 0u;
+        uint32_t pending = slot.pending.fetch_and(~bit);
+        if ((pending & bit) == 0) {
+            slot.users.fetch_sub(1);
+            ALOGI("freeInputBuffer -- Input buffer no. %zu in "
+                  "input frame index %llu is invalid or has already been freed.",
+                  bufferIndex, static_cast<long long unsigned>(frameIndex));
+            return nullptr;
+        }
+        return Release(slot, bit, pending == bit, bufferIndex);
+    }
+    std::shared_ptr<C2Buffer> buffer;
+    std::lock_guard<std::mutex> lock(mOverflowMutex);
+    auto it = mOverflow.find(frameIndex);
+    if (it == mOverflow.end()) {
+        ALOGI("freeInputBuffer -- Unrecognized input frame index %llu.",
+              static_cast<long long unsigned>(frameIndex));
+        return nullptr;
+    }
+    if (bufferIndex >= it->second.first.size()) {
+        ALOGI("freeInputBuffer -- Input buffer no. %zu is invalid in "
+              "input frame index %llu.",
+              bufferIndex, static_cast<long long unsigned>(frameIndex));
+        return nullptr;
+    }
+    buffer = std::move(it->second.first[bufferIndex]);
+    if (!buffer) {
+        ALOGI("freeInputBuffer -- Input buffer no. %zu in "
+              "input frame index %llu has already been freed.",
+              bufferIndex, static_cast<long long unsigned>(frameIndex));
+        return nullptr;
+    }
+    if (--it->second.second == 0) {
+        mOverflow.erase(it);
+        mNumOverflow.store(mOverflow.size());
+    }
+    return buffer;
+}
+
+void Codec2Client::Component::InputBuffers::clear() {
+    for (Slot& slot : mSlots) {
+        if (slot.state.load() == kHeldSlot) {
+            (void)remove(slot.frameIndex.load());
+        }
+    }
+    std::map<uint64_t, std::pair<std::vector<std::shared_ptr<C2Buffer>>, size_t>> released;
+    {
+        std::lock_guard<std::mutex> lock(mOverflowMutex);
+        released.swap(mOverflow);
+        mNumOverflow.store(0);
+    }
+}
+
 // Codec2Client::Component
 
 Codec2Client::Component::Base* Codec2Client::Component::base() const {
@@ -858,22 +1008,15 @@ size_t Codec2Client::Component::handleOnWorkDone(
     }
 
     size_t numDiscardedInputBuffers = 0;
-    {
-        std::lock_guard<std::mutex> lock(mInputBuffersMutex);
-        for (uint64_t inputIndex : inputDone) {
-            auto it = mInputBuffers.find(inputIndex);
-            if (it == mInputBuffers.end()) {
-                ALOGV("onWorkDone -- returned consumed/unknown "
-                      "input frame: index %llu",
-                        (long long)inputIndex);
-            } else {
-                ALOGV("onWorkDone -- processed input frame: "
-                      "index %llu (containing %zu buffers)",
-                        (long long)inputIndex, it->second.size());
-                mInputBuffers.erase(it);
-                mInputBufferCount.erase(inputIndex);
-                ++numDiscardedInputBuffers;
-            }
+    for (uint64_t inputIndex : inputDone) {
+        if (!mInputBuffers.remove(inputIndex)) {
+            ALOGV("onWorkDone -- returned consumed/unknown "
+                  "input frame: index %llu",
+                    (long long)inputIndex);
+        } else {
+            ALOGV("onWorkDone -- processed input frame: index %llu",
+                    (long long)inputIndex);
+            ++numDiscardedInputBuffers;
         }
     }
 
@@ -893,62 +1036,30 @@ size_t Codec2Client::Component::handleOnWorkDone(
 std::shared_ptr<C2Buffer> Codec2Client::Component::freeInputBuffer(
         uint64_t frameIndex,
         size_t bufferIndex) {
-    std::shared_ptr<C2Buffer> buffer;
-    std::lock_guard<std::mutex> lock(mInputBuffersMutex);
-    auto it = mInputBuffers.find(frameIndex);
-    if (it == mInputBuffers.end()) {
-        ALOGI("freeInputBuffer -- Unrecognized input frame index %llu.",
-              static_cast<long long unsigned>(frameIndex));
-        return nullptr;
-    }
-    if (bufferIndex >= it->second.size()) {
-        ALOGI("freeInputBuffer -- Input buffer no. %zu is invalid in "
-              "input frame index %llu.",
-              bufferIndex, static_cast<long long unsigned>(frameIndex));
-        return nullptr;
-    }
-    buffer = it->second[bufferIndex];
-    if (!buffer) {
-        ALOGI("freeInputBuffer -- Input buffer no. %zu in "
-              "input frame index %llu has already been freed.",
-              bufferIndex, static_cast<long long unsigned>(frameIndex));
-        return nullptr;
-    }
-    it->second[bufferIndex] = nullptr;
-    if (--mInputBufferCount[frameIndex] == 0) {
-        mInputBuffers.erase(it);
-        mInputBufferCount.erase(frameIndex);
-    }
-    return buffer;
+    return mInputBuffers.remove(frameIndex, bufferIndex);
 }
 
 c2_status_t Codec2Client::Component::queue(
         std::list<std::unique_ptr<C2Work>>* const items) {
     // remember input buffers queued to hold reference to them
-    {
-        std::lock_guard<std::mutex> lock(mInputBuffersMutex);
-        for (const std::unique_ptr<C2Work> &work : *items) {
-            if (!work) {
-                continue;
-            }
-            if (work->input.buffers.size() == 0) {
-                continue;
-            }
+    for (const std::unique_ptr<C2Work> &work : *items) {
+        if (!work) {
+            continue;
+        }
+        if (work->input.buffers.size() == 0) {
+            continue;
+        }
 
-            uint64_t inputIndex = work->input.ordinal.frameIndex.peeku();
-            auto res = mInputBuffers.emplace(inputIndex, work->input.buffers);
-            if (!res.second) {
-                // TODO: append? - for now we are replacing
-                res.first->second = work->input.buffers;
-                ALOGI("queue -- duplicate input frame: index %llu. "
-                      "Discarding the old input frame...",
-                        (long long)inputIndex);
-            }
-            mInputBufferCount[inputIndex] = work->input.buffers.size();
-            ALOGV("queue -- queueing input frame: "
-                  "index %llu (containing %zu buffers)",
-                    (long long)inputIndex, work->input.buffers.size());
+        uint64_t inputIndex = work->input.ordinal.frameIndex.peeku();
+        if (!mInputBuffers.add(inputIndex, work->input.buffers)) {
+            // TODO: append? - for now we are replacing
+            ALOGI("queue -- duplicate input frame: index %llu. "
+                  "Discarding the old input frame...",
+                    (long long)inputIndex);
         }
+        ALOGV("queue -- queueing input frame: "
+              "index %llu (containing %zu buffers)",
+                (long long)inputIndex, work->input.buffers.size());
     }
 
     WorkBundle workBundle;
@@ -1009,18 +1120,13 @@ c2_status_t Codec2Client::Component::flush(
 
     // Input buffers' lifetime management
     for (uint64_t flushedIndex : flushedIndices) {
-        std::lock_guard<std::mutex> lock(mInputBuffersMutex);
-        auto it = mInputBuffers.find(flushedIndex);
-        if (it == mInputBuffers.end()) {
+        if (!mInputBuffers.remove(flushedIndex)) {
             ALOGV("flush -- returned consumed/unknown input frame: "
                   "index %llu",
                     (long long)flushedIndex);
         } else {
-            ALOGV("flush -- returned unprocessed input frame: "
-                  "index %llu (containing %zu buffers)",
-                    (long long)flushedIndex, mInputBufferCount[flushedIndex]);
-            mInputBuffers.erase(it);
-            mInputBufferCount.erase(flushedIndex);
+            ALOGV("flush -- returned unprocessed input frame: index %llu",
+                    (long long)flushedIndex);
         }
     }
 
@@ -1081,10 +1187,7 @@ c2_status_t Codec2Client::Component::stop() {
         ALOGE("stop -- call failed. "
                 "Error code = %d", static_cast<int>(status));
     }
-    mInputBuffersMutex.lock();
     mInputBuffers.clear();
-    mInputBufferCount.clear();
-    mInputBuffersMutex.unlock();
     return status;
 }
 
@@ -1100,10 +1203,7 @@ c2_status_t Codec2Client::Component::reset() {
         ALOGE("reset -- call failed. "
                 "Error code = %d", static_cast<int>(status));
     }
-    mInputBuffersMutex.lock();
     mInputBuffers.clear();
-    mInputBufferCount.clear();
-    mInputBuffersMutex.unlock();
     return status;
 }
 
@@ -1119,10 +1219,7 @@ c2_status_t Codec2Client::Component::release() {
         ALOGE("release -- call failed. "
                 "Error code = %d", static_cast<int>(status));
     }
-    mInputBuffersMutex.lock();
     mInputBuffers.clear();
-    mInputBufferCount.clear();
-    mInputBuffersMutex.unlock();
     return status;
 }
 
@@ -29,6 +29,8 @@
 #include <hidl/HidlSupport.h>
 #include <utils/StrongPointer.h>
 
+#include <array>
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -387,23 +389,76 @@ struct Codec2Client::Component : public Codec2Client::Configurable {
 protected:
     Base* base() const;
 
-    // Mutex for mInputBuffers and mInputBufferCount.
-    mutable std::mutex mInputBuffersMutex;
-
-    // Map: frameIndex -> vector of bufferIndices
-    //
-    // mInputBuffers[frameIndex][bufferIndex] may be null if the buffer in that
-    // slot has been freed.
-    mutable std::map<uint64_t, std::vector<std::shared_ptr<C2Buffer>>>
-            mInputBuffers;
-
-    // Map: frameIndex -> number of bufferIndices that have not been freed
+    // Input buffers held while the component may access them, by frame index.
     //
-    // mInputBufferCount[frameIndex] keeps track of the number of non-null
-    // elements in mInputBuffers[frameIndex]. When mInputBufferCount[frameIndex]
-    // decreases to 0, frameIndex can be removed from both mInputBuffers and
-    // mInputBufferCount.
-    mutable std::map<uint64_t, size_t> mInputBufferCount;
+    // The buffers of a frame are kept in a ring slot indexed by the frame index,
+    // with a bit per buffer that has not been released. Releasing a buffer or a
+    // frame clears bits with atomic operations, so it takes constant time and no
+    // lock. Frames whose slot is still in use by an older frame, or that have
+    // more buffers than a slot can hold, are kept in a map guarded by a mutex.
+    class InputBuffers {
+    public:
+        InputBuffers();
+
+        // Hold |buffers| for frame |frameIndex|. Return false if buffers were
+        // already held for |frameIndex|; those are released.
+        bool add(uint64_t frameIndex,
+                 const std::vector<std::shared_ptr<C2Buffer>>& buffers);
+
+        // Release the buffers of frame |frameIndex|. Return false if none were
+        // held.
+        bool remove(uint64_t frameIndex);
+
+        // Release and return buffer |bufferIndex| of frame |frameIndex|, or
+        // nullptr if it is not held.
+        std::shared_ptr<C2Buffer> remove(uint64_t frameIndex, size_t bufferIndex);
+
+        // Release all buffers.
+        void clear();
+
+    private:
+        enum : size_t {
+            kNumSlots = 64,
+            kMaxSlotBuffers = 4,
+        };
+
+        enum SlotState : uint32_t {
+            kFreeSlot,      // holds no frame
+            kClaimedSlot,   // being filled by add()
+            kHeldSlot,      // holds the buffers of frame |frameIndex|
+        };
+
+        struct Slot {
+            std::atomic<uint32_t> state;
+            // frame index of the held buffers; valid only in kHeldSlot state
+            std::atomic<uint64_t> frameIndex;
+            // bit i is set if buffers[i] has not been released
+            std::atomic<uint32_t> pending;
+            // number of threads accessing the slot for the current frame index
+            std::atomic<uint32_t> users;
+            std::array<std::shared_ptr<C2Buffer>, kMaxSlotBuffers> buffers;
+            // time the buffers were queued; used for logging
+            int64_t queuedNs;
+        };
+
+        // Start accessing |slot| if it holds frame |frameIndex|.
+        static bool Acquire(Slot& slot, uint64_t frameIndex);
+        // Release the buffers of |slot| whose bits in |bits| have been cleared by
+        // the caller, and free the slot if |last|. Stop accessing the slot.
+        static std::shared_ptr<C2Buffer> Release(
+                Slot& slot, uint32_t bits, bool last, size_t bufferIndex);
+
+        std::array<Slot, kNumSlots> mSlots;
+
+        std::mutex mOverflowMutex;
+        // number of frames in mOverflow; read without holding mOverflowMutex
+        std::atomic<size_t> mNumOverflow;
+        // mOverflow[frameIndex][bufferIndex] is null if the buffer has been
+        // released; the count is the number of buffers that have not been.
+        std::map<uint64_t, std::pair<std::vector<std::shared_ptr<C2Buffer>>, size_t>>
+                mOverflow;
+    };
+    InputBuffers mInputBuffers;
 
     ::hardware::google::media::c2::V1_0::utils::DefaultBufferPoolSender
             mBufferPoolSender;
@@ -423,7 +478,7 @@ protected:
     struct HidlListener;
     // Return the number of input buffers that should be discarded.
     size_t handleOnWorkDone(const std::list<std::unique_ptr<C2Work>> &workItems);
-    // Remove an input buffer from mInputBuffers and return it.
+    // Release an input buffer from mInputBuffers and return it.
     std::shared_ptr<C2Buffer> freeInputBuffer(uint64_t frameIndex, size_t bufferIndex);
 
 };
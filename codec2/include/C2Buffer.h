@@ -73,7 +73,8 @@ public:
      * \todo a mechanism to cancel a wait - for now the only way to do this is to abandon the
      * event, but fences are shared so canceling a wait will cancel all waits.
      *
-     * \param timeoutNs           the maximum time to wait in nsecs
+     * \param timeoutNs           the maximum time to wait in nsecs. A negative value waits
+     *                            indefinitely.
      *
      * \retval C2_OK            the fence has been signaled
      * \retval C2_TIMED_OUT     the fence has not been signaled within the timeout
@@ -141,6 +142,11 @@ private:
  */
 class C2Event {
 public:
+    /**
+     * Creates a new (pending) event.
+     */
+    C2Event();
+
     /**
      * Returns a fence for this event.
      */
@@ -219,11 +225,16 @@ public:
      * Acquires the object protected by an acquire fence. Any errors during the mapping will be
      * passed to the object.
      *
-     * \return acquired object potentially invalidated if waiting for the fence failed.
+     * \return acquired object, or an object carrying the error of the wait if waiting for the
+     *         fence failed (e.g. C2_BAD_STATE if the fence was abandoned).
      */
     T get() {
-        // TODO:
-        // wait();
+        // this is a no-op for null-fences (already signaled)
+        c2_status_t err = C2Fence::wait(-1 /* indefinitely */);
+        if (err != C2_OK) {
+            // the producer did not finish, so the content of the object is undefined
+            return T(err);
+        }
         return mT;
     }
 
@@ -1051,6 +1062,7 @@ protected:
 
 private:
     friend struct _C2BlockFactory;
+    template<typename U> friend class C2Acquirable;
     std::shared_ptr<Impl> mImpl;
     uint32_t mOffset; /**< offset into the linear block backing this read view */
 };
@@ -1093,6 +1105,7 @@ protected:
 
 private:
     friend struct _C2BlockFactory;
+    template<typename U> friend class C2Acquirable;
     std::shared_ptr<Impl> mImpl;
 };
 
@@ -1879,6 +1892,7 @@ protected:
 
 private:
     friend struct _C2BlockFactory;
+    template<typename U> friend class C2Acquirable;
     std::shared_ptr<Impl> mImpl;
 };
 
@@ -2013,6 +2027,44 @@ public:
      */
     const std::vector<C2ConstGraphicBlock> graphicBlocks() const;
 
+    /**
+     * A non-owning read-only view over the blocks of a buffer. This is valid only as long as the
+     * buffer (data) it was obtained from.
+     */
+    template<typename T>
+    class Span {
+    public:
+        inline constexpr Span() : mData(nullptr), mSize(0) {}
+        inline constexpr Span(const T *data, size_t size) : mData(data), mSize(size) {}
+
+        inline const T *begin() const { return mData; }
+        inline const T *end() const { return mData + mSize; }
+        inline const T *data() const { return mData; }
+        inline size_t size() const { return mSize; }
+        inline bool empty() const { return mSize == 0; }
+        inline const T &operator[](size_t ix) const { return mData[ix]; }
+        inline const T &front() const { return mData[0]; }
+        inline const T &back() const { return mData[mSize - 1]; }
+
+    private:
+        const T *mData;
+        size_t mSize;
+    };
+
+    /**
+     * Gets the linear blocks of this buffer without copying them.
+     * \return a view of the const linear blocks of this buffer.
+     * \retval empty view if this buffer does not contain linear block(s).
+     */
+    Span<C2ConstLinearBlock> linearBlockSpan() const;
+
+    /**
+     * Gets the graphic blocks of this buffer without copying them.
+     * \return a view of the const graphic blocks of this buffer.
+     * \retval empty view if this buffer does not contain graphic block(s).
+     */
+    Span<C2ConstGraphicBlock> graphicBlockSpan() const;
+
 private:
     class Impl;
     std::shared_ptr<Impl> mImpl;
@@ -2021,6 +2073,8 @@ protected:
     // no public constructor
     explicit C2BufferData(const std::vector<C2ConstLinearBlock> &blocks);
     explicit C2BufferData(const std::vector<C2ConstGraphicBlock> &blocks);
+    explicit C2BufferData(const C2ConstLinearBlock &block);
+    explicit C2BufferData(const C2ConstGraphicBlock &block);
 };
 
 /**
@@ -2166,6 +2220,8 @@ protected:
     // no public constructor
     explicit C2Buffer(const std::vector<C2ConstLinearBlock> &blocks);
     explicit C2Buffer(const std::vector<C2ConstGraphicBlock> &blocks);
+    explicit C2Buffer(const C2ConstLinearBlock &block);
+    explicit C2Buffer(const C2ConstGraphicBlock &block);
 
 private:
     class Impl;
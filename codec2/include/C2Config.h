@@ -58,6 +58,7 @@ struct C2Config {
     enum bitrate_mode_t : uint32_t;         ///< bitrate control mode
     enum drc_compression_mode_t : int32_t;  ///< DRC compression mode
     enum drc_effect_type_t : int32_t;       ///< DRC effect type
+    enum encoding_deadline_t : uint32_t;    ///< encoding deadline
     enum intra_refresh_mode_t : uint32_t;   ///< intra refresh modes
     enum level_t : uint32_t;                ///< coding level
     enum ordinal_key_t : uint32_t;          ///< work ordering keys
@@ -238,6 +239,15 @@ enum C2ParamIndexKind : C2Param::type_index_t {
     kParamIndexMinFrameRate, // input-surface, float
     kParamIndexTimestampGapAdjustment, // input-surface, struct
 
+    kParamIndexCpuAffinity, // all, u32[]
+    kParamIndexLowLatencyMode, // all, bool
+    kParamIndexThreadCount, // all, u32
+    kParamIndexRowMultiThreading, // video, bool
+    kParamIndexTileColumns, // video, u32
+    kParamIndexEncodingDeadline, // video, enum
+    kParamIndexKeyFrameOnlyDecoding, // video decoder, bool
+    kParamIndexLookAhead, // video encoder, u32
+
     // deprecated indices due to renaming
     kParamIndexAacStreamFormat = kParamIndexAacPackaging,
     kParamIndexCsd = kParamIndexInitData,
@@ -1100,6 +1110,119 @@ typedef C2GlobalParam<C2Tuning, C2Int32Value, kParamIndexRealTimePriority>
         C2RealTimePriorityTuning;
 constexpr char C2_PARAMKEY_PRIORITY[] = "algo.priority";
 
+/**
+ * CPU affinity.
+ *
+ * List of CPUs that the component shall run its processing (and the threads of its codec
+ * library) on. Buffers allocated by the component while processing are thus allocated from memory
+ * local to these CPUs on NUMA systems. An empty list (default) leaves placement to the system.
+ *
+ * This is a hint that is applied when the component is started. CPUs that are not available to
+ * the component are ignored.
+ */
+typedef C2GlobalParam<C2Tuning, C2Uint32Array, kParamIndexCpuAffinity> C2CpuAffinityTuning;
+constexpr char C2_PARAMKEY_CPU_AFFINITY[] = "algo.cpu-affinity";
+
+/**
+ * Low latency mode.
+ *
+ * If true, the client wants each output as soon as possible, e.g. for real-time communication.
+ * Components shall not hold work beyond what they need to produce output, and the client keeps
+ * only the work needed to keep up with the component in flight. This may reduce throughput.
+ *
+ * Video decoders may output frames in decoding order in this mode. This is only correct for
+ * streams without frame reordering, which is the norm for real-time streams.
+ *
+ * This is applied when the component is started.
+ */
+typedef C2GlobalParam<C2Tuning, C2EasyBoolValue, kParamIndexLowLatencyMode>
+        C2LowLatencyModeTuning;
+constexpr char C2_PARAMKEY_LOW_LATENCY_MODE[] = "algo.low-latency";
+
+/**
+ * Thread count.
+ *
+ * Maximum number of threads the codec library of the component may use. 0 (default) lets the
+ * component choose based on the CPUs available to it. Values above the number of available CPUs
+ * are treated as the number of available CPUs.
+ *
+ * This is applied when the component is started.
+ */
+typedef C2GlobalParam<C2Tuning, C2Uint32Value, kParamIndexThreadCount> C2ThreadCountTuning;
+constexpr char C2_PARAMKEY_THREAD_COUNT[] = "algo.thread-count";
+
+/**
+ * Row based multi-threading.
+ *
+ * If true, video codecs that support it spread the rows of a tile over multiple threads, so that
+ * streams with few tiles can still use all threads of the component.
+ *
+ * This is applied when the component is started.
+ */
+typedef C2GlobalParam<C2Tuning, C2EasyBoolValue, kParamIndexRowMultiThreading>
+        C2RowMultiThreadingTuning;
+constexpr char C2_PARAMKEY_ROW_MULTI_THREADING[] = "algo.row-mt";
+
+/**
+ * Tile columns.
+ *
+ * Number of tile columns video encoders that support tiles should split each frame into. Tiles
+ * can be encoded (and decoded) in parallel at a small cost in coding efficiency. 0 (default) lets
+ * the component choose based on its thread count. Components may round this down to what the
+ * coding standard and the frame width allow.
+ *
+ * This is applied when the component is started.
+ */
+typedef C2GlobalParam<C2Tuning, C2Uint32Value, kParamIndexTileColumns> C2TileColumnsTuning;
+constexpr char C2_PARAMKEY_TILE_COLUMNS[] = "algo.tile-columns";
+
+/**
+ * Encoding deadline.
+ */
+C2ENUM(C2Config::encoding_deadline_t, uint32_t,
+    DEADLINE_REALTIME,      ///< encode each frame as fast as possible
+    DEADLINE_GOOD_QUALITY,  ///< trade encoding speed for quality
+)
+
+/**
+ * Encoding deadline of software video encoders. Real-time encoding (default) is suited for
+ * capture and communication; good quality encoding for transcoding where speed matters less.
+ *
+ * This is applied when the component is started.
+ */
+typedef C2GlobalParam<C2Tuning, C2SimpleValueStruct<C2Config::encoding_deadline_t>,
+                kParamIndexEncodingDeadline>
+        C2EncodingDeadlineTuning;
+constexpr char C2_PARAMKEY_ENCODING_DEADLINE[] = "algo.encoding-deadline";
+
+/**
+ * Key frame only decoding.
+ *
+ * If true, video decoders decode only key frames (sync frames) and skip all other frames, which
+ * produce no output. Decoders use a single thread and output each key frame as soon as it is
+ * decoded. This is meant for extracting thumbnails, where only a sync frame is needed and the
+ * component is torn down right after.
+ *
+ * This is applied when the component is started.
+ */
+typedef C2GlobalParam<C2Tuning, C2EasyBoolValue, kParamIndexKeyFrameOnlyDecoding>
+        C2KeyFrameOnlyDecodingTuning;
+constexpr char C2_PARAMKEY_KEY_FRAME_ONLY_DECODING[] = "algo.key-frame-only";
+
+/**
+ * Encoder look-ahead in frames.
+ *
+ * If non-zero, video encoders hold back this many input frames and analyze them before encoding
+ * a frame, e.g. to place key frames at scene changes and to spend more bits on frames that later
+ * frames predict from. This delays the output by the same number of frames, and is meant for
+ * offline encoding where quality per bit matters more than latency. 0 (default) encodes each
+ * frame as soon as it is queued.
+ *
+ * This is applied when the component is started.
+ */
+typedef C2GlobalParam<C2Tuning, C2Uint32Value, kParamIndexLookAhead> C2LookAheadTuning;
+constexpr char C2_PARAMKEY_LOOK_AHEAD[] = "algo.look-ahead";
+
 /* ------------------------------------- protected content ------------------------------------- */
 
 /**
@@ -1852,7 +1975,9 @@ constexpr char C2_PARAMKEY_MAX_CODED_CHANNEL_COUNT[] = "coded.max-channel-count"
 C2ENUM(C2Config::pcm_encoding_t, uint32_t,
     PCM_16,
     PCM_8,
-    PCM_FLOAT
+    PCM_FLOAT,
+    PCM_24,         ///< packed 24-bit
+    PCM_32
 )
 
 typedef C2StreamParam<C2Info, C2SimpleValueStruct<C2Config::pcm_encoding_t>, kParamIndexPcmEncoding>
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <codec2/hidl/client.h>
+
+#include <C2Buffer.h>
+#include <C2PlatformSupport.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace android {
+
+namespace {
+
+// Exposes the input buffer tracker of Codec2Client::Component. Never instantiated.
+struct ComponentAccess : public Codec2Client::Component {
+    using Codec2Client::Component::InputBuffers;
+};
+typedef ComponentAccess::InputBuffers InputBuffers;
+
+}  // namespace
+
+class C2InputBuffersTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::shared_ptr<C2BlockPool> pool;
+        ASSERT_EQ(C2_OK, GetCodec2BlockPool(C2BlockPool::BASIC_LINEAR, nullptr, &pool));
+        ASSERT_EQ(C2_OK, pool->fetchLinearBlock(
+                16, { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE }, &mBlock));
+    }
+
+    // Returns |count| new buffers sharing the same block. Each buffer is a distinct
+    // object so that its release can be observed.
+    std::vector<std::shared_ptr<C2Buffer>> makeBuffers(size_t count) {
+        std::vector<std::shared_ptr<C2Buffer>> buffers;
+        for (size_t i = 0; i < count; ++i) {
+            buffers.push_back(C2Buffer::CreateLinearBuffer(mBlock->share(0, 16, C2Fence())));
+        }
+        return buffers;
+    }
+
+    static std::vector<std::weak_ptr<C2Buffer>> watch(
+            const std::vector<std::shared_ptr<C2Buffer>> &buffers) {
+        return std::vector<std::weak_ptr<C2Buffer>>(buffers.begin(), buffers.end());
+    }
+
+    std::shared_ptr<C2LinearBlock> mBlock;
+};
+
+TEST_F(C2InputBuffersTest, OverflowTest) {
+    InputBuffers inputBuffers;
+
+    // frames 0 and 64 share a ring slot, so frame 64 overflows
+    std::vector<std::shared_ptr<C2Buffer>> buffers0 = makeBuffers(2);
+    std::vector<std::shared_ptr<C2Buffer>> buffers64 = makeBuffers(2);
+    // more buffers than a ring slot holds
+    std::vector<std::shared_ptr<C2Buffer>> buffers1 = makeBuffers(6);
+    std::vector<std::weak_ptr<C2Buffer>> watched0 = watch(buffers0);
+    std::vector<std::weak_ptr<C2Buffer>> watched64 = watch(buffers64);
+    std::vector<std::weak_ptr<C2Buffer>> watched1 = watch(buffers1);
+
+    EXPECT_TRUE(inputBuffers.add(0, buffers0));
+    EXPECT_TRUE(inputBuffers.add(64, buffers64));
+    EXPECT_TRUE(inputBuffers.add(1, buffers1));
+    // adding a frame again replaces its buffers
+    EXPECT_FALSE(inputBuffers.add(64, buffers64));
+    buffers0.clear();
+    buffers64.clear();
+    buffers1.clear();
+
+    for (size_t i = 0; i < watched1.size(); ++i) {
+        std::shared_ptr<C2Buffer> buffer = inputBuffers.remove(1, i);
+        EXPECT_EQ(watched1[i].lock(), buffer) << "buffer " << i;
+        EXPECT_EQ(nullptr, inputBuffers.remove(1, i)) << "buffer " << i;
+    }
+    EXPECT_FALSE(inputBuffers.remove(1));
+
+    EXPECT_EQ(watched64[1].lock(), inputBuffers.remove(64, 1));
+    EXPECT_TRUE(inputBuffers.remove(64));
+    EXPECT_FALSE(inputBuffers.remove(64));
+    EXPECT_TRUE(inputBuffers.remove(0));
+    EXPECT_EQ(nullptr, inputBuffers.remove(0, 0));
+
+    // the slot of frame 0 is free again
+    std::vector<std::shared_ptr<C2Buffer>> buffers128 = makeBuffers(1);
+    std::vector<std::weak_ptr<C2Buffer>> watched128 = watch(buffers128);
+    EXPECT_TRUE(inputBuffers.add(128, buffers128));
+    buffers128.clear();
+    inputBuffers.clear();
+    EXPECT_FALSE(inputBuffers.remove(128));
+
+    for (const std::vector<std::weak_ptr<C2Buffer>> &watched :
+            { watched0, watched64, watched1, watched128 }) {
+        for (const std::weak_ptr<C2Buffer> &buffer : watched) {
+            EXPECT_TRUE(buffer.expired());
+        }
+    }
+}
+
+TEST_F(C2InputBuffersTest, LargeFrameIndexTest) {
+    InputBuffers inputBuffers;
+
+    // all frame indices are valid, including the largest ones
+    for (uint64_t frameIndex : { UINT64_MAX, UINT64_MAX - 1 }) {
+        std::vector<std::shared_ptr<C2Buffer>> buffers = makeBuffers(2);
+        std::vector<std::weak_ptr<C2Buffer>> watched = watch(buffers);
+        EXPECT_TRUE(inputBuffers.add(frameIndex, buffers)) << "frame " << frameIndex;
+        buffers.clear();
+        EXPECT_EQ(watched[0].lock(), inputBuffers.remove(frameIndex, 0)) << "frame " << frameIndex;
+        EXPECT_TRUE(inputBuffers.remove(frameIndex)) << "frame " << frameIndex;
+        EXPECT_FALSE(inputBuffers.remove(frameIndex)) << "frame " << frameIndex;
+        for (const std::weak_ptr<C2Buffer> &buffer : watched) {
+            EXPECT_TRUE(buffer.expired()) << "frame " << frameIndex;
+        }
+    }
+}
+
+TEST_F(C2InputBuffersTest, ConcurrentAddRemoveTest) {
+    constexpr uint64_t kNumFrames = 4096;
+    // Every kLargeFramePeriod-th frame has more buffers than a ring slot holds.
+    constexpr uint64_t kLargeFramePeriod = 7;
+    constexpr size_t kNumBuffers = 2;
+    constexpr size_t kNumLargeBuffers = 5;
+
+    InputBuffers inputBuffers;
+    std::vector<std::vector<std::weak_ptr<C2Buffer>>> watched(kNumFrames);
+    std::vector<std::vector<std::shared_ptr<C2Buffer>>> frames(kNumFrames);
+    for (uint64_t i = 0; i < kNumFrames; ++i) {
+        frames[i] = makeBuffers(i % kLargeFramePeriod == 0 ? kNumLargeBuffers : kNumBuffers);
+        watched[i] = watch(frames[i]);
+    }
+
+    // The producer is not throttled, so it runs ahead of the consumers and frames whose
+    // ring slot still holds an older frame go to the overflow map.
+    std::atomic<uint64_t> numAdded(0);
+    std::thread producer([&inputBuffers, &frames, &numAdded] {
+        for (uint64_t i = 0; i < kNumFrames; ++i) {
+            EXPECT_TRUE(inputBuffers.add(i, frames[i])) << "frame " << i;
+            frames[i].clear();
+            numAdded.store(i + 1);
+        }
+    });
+
+    // Each consumer releases one buffer index of every frame, concurrently with the
+    // producer and with each other.
+    std::atomic<size_t> numMissing(0);
+    auto consume = [&inputBuffers, &watched, &numAdded, &numMissing](size_t bufferIndex) {
+        for (uint64_t i = 0; i < kNumFrames; ++i) {
+            while (numAdded.load() <= i) {
+                std::this_thread::yield();
+            }
+            std::shared_ptr<C2Buffer> expected = watched[i][bufferIndex].lock();
+            if (!expected || inputBuffers.remove(i, bufferIndex) != expected) {
+                ++numMissing;
+            }
+        }
+    };
+    std::vector<std::thread> consumers;
+    for (size_t bufferIndex = 0; bufferIndex < kNumBuffers; ++bufferIndex) {
+        consumers.emplace_back(consume, bufferIndex);
+    }
+    producer.join();
+    for (std::thread &consumer : consumers) {
+        consumer.join();
+    }
+    EXPECT_EQ(0u, numMissing.load());
+
+    // Only the large frames still hold buffers.
+    for (uint64_t i = 0; i < kNumFrames; ++i) {
+        bool large = i % kLargeFramePeriod == 0;
+        EXPECT_EQ(large, inputBuffers.remove(i)) << "frame " << i;
+        for (const std::weak_ptr<C2Buffer> &buffer : watched[i]) {
+            EXPECT_TRUE(buffer.expired()) << "frame " << i;
+        }
+    }
+}
+
+}  // namespace android
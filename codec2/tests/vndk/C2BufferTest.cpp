@@ -21,11 +21,63 @@
 #include <C2Buffer.h>
 #include <C2BufferPriv.h>
 #include <C2ParamDef.h>
+#include <C2Work.h>
 
 #include <system/graphics.h>
 
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Counts heap allocations made on the current thread while enabled. Used to verify the
+// per-buffer allocation cost of C2Buffer.
+thread_local bool gCountAllocations = false;
+thread_local size_t gAllocationCount = 0;
+
+}  // namespace
+
+void *operator new(size_t size) {
+    if (gCountAllocations) {
+        ++gAllocationCount;
+    }
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
 namespace android {
 
+class AllocationCounter {
+public:
+    AllocationCounter() {
+        gAllocationCount = 0;
+        gCountAllocations = true;
+    }
+
+    ~AllocationCounter() {
+        gCountAllocations = false;
+    }
+
+    size_t stop() {
+        gCountAllocations = false;
+        return gAllocationCount;
+    }
+};
+
 class C2BufferUtilsTest : public ::testing::Test {
     static void StaticSegmentTest() {
         // constructor
@@ -426,6 +478,80 @@ TEST_F(C2BufferTest, BlockPoolTest) {
     }
 }
 
+TEST_F(C2BufferTest, SubBlockPoolTest) {
+    // Small blocks, e.g. decoded audio frames, are carved out of a shared allocation.
+    constexpr size_t kCapacity = 4608u;
+    constexpr size_t kNumBlocks = 16u;
+
+    std::shared_ptr<C2BlockPool> blockPool(makeLinearBlockPool());
+
+    std::vector<std::shared_ptr<C2LinearBlock>> blocks;
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+        std::shared_ptr<C2LinearBlock> block;
+        ASSERT_EQ(C2_OK, blockPool->fetchLinearBlock(
+                kCapacity,
+                { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE },
+                &block));
+        ASSERT_TRUE(block);
+        ASSERT_EQ(kCapacity, block->size());
+        if (!blocks.empty()) {
+            EXPECT_EQ(blocks.front()->handle(), block->handle());
+            EXPECT_LE(blocks.back()->offset() + kCapacity, block->offset());
+        }
+        C2WriteView writeView = block->map().get();
+        ASSERT_EQ(C2_OK, writeView.error());
+        ASSERT_EQ(kCapacity, writeView.capacity());
+        memset(writeView.data(), (int)i, kCapacity);
+        blocks.push_back(block);
+    }
+
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+        // ranges are relative to the allocation
+        C2ConstLinearBlock constBlock = blocks[i]->share(
+                blocks[i]->offset() + 1u, kCapacity - 2u, C2Fence());
+        C2ReadView readView = constBlock.map().get();
+        ASSERT_EQ(C2_OK, readView.error());
+        ASSERT_EQ(kCapacity - 2u, readView.capacity());
+        for (size_t j = 0; j < readView.capacity(); ++j) {
+            ASSERT_EQ((uint8_t)i, readView.data()[j]) << " at block " << i << ", j = " << j;
+        }
+    }
+}
+
+TEST_F(C2BufferTest, SubBlockPoolLongLivedBlockTest) {
+    // A small block that is held for a long time must not make the pool pin a new slab for
+    // every slab it fills.
+    constexpr size_t kCapacity = 4608u;
+    constexpr size_t kNumBlocks = 2048u;
+
+    std::shared_ptr<C2BlockPool> blockPool(makeLinearBlockPool());
+
+    // keep the first block of each allocation alive
+    std::vector<std::shared_ptr<C2LinearBlock>> pinned;
+    size_t sharedAllocations = 0u;
+    std::shared_ptr<C2LinearBlock> last;
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+        std::shared_ptr<C2LinearBlock> block;
+        ASSERT_EQ(C2_OK, blockPool->fetchLinearBlock(
+                kCapacity,
+                { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE },
+                &block));
+        ASSERT_TRUE(block);
+        if (!pinned.empty() && pinned.back()->handle() == block->handle()) {
+            if (last == pinned.back()) {
+                ++sharedAllocations;
+            }
+        } else {
+            pinned.push_back(block);
+        }
+        last = block;
+    }
+    // once two slabs are pinned, small blocks are allocated individually
+    EXPECT_EQ(2u, sharedAllocations);
+    EXPECT_EQ(last, pinned.back());
+    EXPECT_EQ(0u, last->offset());
+}
+
 void fillPlane(const C2Rect rect, const C2PlaneInfo info, uint8_t *addr, uint8_t value) {
     for (uint32_t row = 0; row < rect.height / info.rowSampling; ++row) {
         int32_t rowOffset = (row + rect.top / info.rowSampling) * info.rowInc;
@@ -746,6 +872,206 @@ TEST_F(C2BufferTest, BufferTest) {
     EXPECT_FALSE(buffer->hasInfo(info2->type()));
 }
 
+TEST_F(C2BufferTest, BufferAllocationCountTest) {
+    std::shared_ptr<C2BlockPool> alloc(makeLinearBlockPool());
+    constexpr size_t kCapacity = 1024u;
+    std::shared_ptr<C2LinearBlock> block;
+
+    ASSERT_EQ(C2_OK, alloc->fetchLinearBlock(
+            kCapacity,
+            { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE },
+            &block));
+    C2ConstLinearBlock constBlock = block->share(0, kCapacity, C2Fence());
+    std::shared_ptr<C2Info> info1(new C2Number1Info(1));
+    std::shared_ptr<C2Info> info2(new C2Number2Info(2));
+    std::function<void(void)> arg = [](){};
+
+    // warm up the recycler of this thread
+    C2Buffer::CreateLinearBuffer(constBlock).reset();
+
+    // a buffer with a single block reuses the memory of the buffer (with its control block),
+    // the buffer impl and the buffer data impl.
+    size_t count;
+    std::shared_ptr<C2Buffer> buffer;
+    {
+        AllocationCounter counter;
+        buffer = C2Buffer::CreateLinearBuffer(constBlock);
+        count = counter.stop();
+    }
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0u, count);
+
+    // a few infos and destroy notifications are stored inline
+    {
+        AllocationCounter counter;
+        (void)buffer->setInfo(info1);
+        (void)buffer->setInfo(info2);
+        (void)buffer->registerOnDestroyNotify(&DestroyCallback, &arg);
+        (void)buffer->registerOnDestroyNotify(&DestroyCallback, nullptr);
+        (void)buffer->hasInfo(info1->type());
+        (void)buffer->getInfo(info2->type());
+        count = counter.stop();
+    }
+    EXPECT_EQ(0u, count);
+    EXPECT_TRUE(buffer->hasInfo(info1->type()));
+    EXPECT_TRUE(buffer->hasInfo(info2->type()));
+
+    // accessing the blocks through the span does not copy
+    {
+        AllocationCounter counter;
+        C2BufferData::Span<C2ConstLinearBlock> blocks = buffer->data().linearBlockSpan();
+        ASSERT_EQ(1u, blocks.size());
+        (void)blocks.front().handle();
+        count = counter.stop();
+    }
+    EXPECT_EQ(0u, count);
+    EXPECT_EQ(block->handle(), buffer->data().linearBlockSpan().front().handle());
+
+    {
+        AllocationCounter counter;
+        (void)buffer->unregisterOnDestroyNotify(&DestroyCallback, &arg);
+        (void)buffer->unregisterOnDestroyNotify(&DestroyCallback, nullptr);
+        (void)buffer->removeInfo(info1->type());
+        buffer.reset();
+        count = counter.stop();
+    }
+    EXPECT_EQ(0u, count);
+
+    // the memory of a released buffer is recycled for the next one
+    {
+        AllocationCounter counter;
+        buffer = C2Buffer::CreateLinearBuffer(constBlock);
+        count = counter.stop();
+    }
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0u, count);
+}
+
+TEST_F(C2BufferTest, BufferCrossThreadRecycleTest) {
+    std::shared_ptr<C2BlockPool> alloc(makeLinearBlockPool());
+    constexpr size_t kCapacity = 1024u;
+    // more than a thread caches by itself
+    constexpr size_t kNumBuffers = 64u;
+    std::shared_ptr<C2LinearBlock> block;
+
+    ASSERT_EQ(C2_OK, alloc->fetchLinearBlock(
+            kCapacity,
+            { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE },
+            &block));
+    C2ConstLinearBlock constBlock = block->share(0, kCapacity, C2Fence());
+
+    std::vector<std::shared_ptr<C2Buffer>> buffers;
+    buffers.reserve(kNumBuffers);
+    for (size_t i = 0; i < kNumBuffers; ++i) {
+        buffers.push_back(C2Buffer::CreateLinearBuffer(constBlock));
+    }
+
+    // buffers are usually released on another thread than the one creating them
+    std::thread([&buffers] { buffers.clear(); }).join();
+
+    // their memory is recycled for buffers created on this thread
+    size_t count;
+    {
+        AllocationCounter counter;
+        for (size_t i = 0; i < kNumBuffers; ++i) {
+            buffers.push_back(C2Buffer::CreateLinearBuffer(constBlock));
+        }
+        count = counter.stop();
+    }
+    EXPECT_EQ(kNumBuffers, buffers.size());
+    EXPECT_EQ(0u, count);
+}
+
+TEST_F(C2BufferTest, EventFenceTest) {
+    C2Event event;
+    C2Fence fence = event.fence();
+    EXPECT_TRUE(fence.valid());
+    EXPECT_FALSE(fence.ready());
+    EXPECT_FALSE(fence.isHW());
+    EXPECT_EQ(C2_TIMED_OUT, fence.wait(1000000 /* 1ms */));
+    EXPECT_EQ(C2_OK, event.fire());
+    EXPECT_EQ(C2_DUPLICATE, event.fire());
+    EXPECT_TRUE(fence.ready());
+    EXPECT_EQ(C2_OK, fence.wait(0));
+
+    C2Event abandoned;
+    fence = abandoned.fence();
+    EXPECT_EQ(C2_OK, abandoned.abandon());
+    EXPECT_EQ(C2_BAD_STATE, abandoned.fire());
+    EXPECT_FALSE(fence.valid());
+    EXPECT_EQ(C2_BAD_STATE, fence.wait(0));
+
+    C2Event event1;
+    C2Event event2;
+    C2Event merged;
+    fence = merged.fence();
+    ASSERT_EQ(C2_OK, merged.merge({ event1.fence(), event2.fence(), C2Fence() }));
+    EXPECT_EQ(C2_DUPLICATE, merged.merge({}));
+    EXPECT_FALSE(fence.ready());
+    EXPECT_EQ(C2_OK, event1.fire());
+    EXPECT_FALSE(fence.ready());
+    EXPECT_EQ(C2_TIMED_OUT, fence.wait(1000000 /* 1ms */));
+    EXPECT_EQ(C2_OK, event2.fire());
+    EXPECT_TRUE(fence.ready());
+    EXPECT_EQ(C2_OK, fence.wait(0));
+
+    // null-fence has fired
+    EXPECT_TRUE(C2Fence().ready());
+    EXPECT_EQ(C2_OK, C2Fence().wait(0));
+    EXPECT_EQ(-1, C2Fence().fd());
+}
+
+TEST_F(C2BufferTest, FenceOverlapTest) {
+    std::shared_ptr<C2BlockPool> pool(makeLinearBlockPool());
+    constexpr size_t kCapacity = 65536u;
+    std::shared_ptr<C2LinearBlock> block;
+    ASSERT_EQ(C2_OK, pool->fetchLinearBlock(
+            kCapacity,
+            { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE },
+            &block));
+
+    // The producer hands the block downstream before it is done writing to it.
+    C2Event written;
+    C2ConstLinearBlock constBlock = block->share(0, kCapacity, written.fence());
+
+    // The consumer can map it right away; the mapping does not wait for the producer.
+    C2Acquirable<C2ReadView> acquirable = constBlock.map();
+    EXPECT_FALSE(acquirable.ready());
+    EXPECT_EQ(C2_TIMED_OUT, acquirable.wait(0));
+
+    std::atomic_bool producerDone(false);
+    std::thread producer([&block, &written, &producerDone] {
+        // always signal the fence so that the consumer is not blocked on a failure
+        C2WriteView view = block->map().get();
+        EXPECT_EQ(C2_OK, view.error());
+        if (view.error() == C2_OK) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            for (size_t i = 0; i < kCapacity; ++i) {
+                view.data()[i] = i & 0xFF;
+            }
+        }
+        producerDone = true;
+        EXPECT_EQ(C2_OK, written.fire());
+    });
+
+    // get() waits for the acquire fence
+    C2ReadView view = acquirable.get();
+    EXPECT_TRUE(producerDone);
+    producer.join();
+    ASSERT_EQ(C2_OK, view.error());
+    ASSERT_EQ(kCapacity, view.capacity());
+    for (size_t i = 0; i < kCapacity; ++i) {
+        ASSERT_EQ((uint8_t)(i & 0xFF), view.data()[i]) << "at " << i;
+    }
+
+    // If the producer abandons the block, the consumer gets the error of the wait.
+    C2Event abandoned;
+    C2ConstLinearBlock abandonedBlock = block->share(0, kCapacity, abandoned.fence());
+    C2Acquirable<C2ReadView> abandonedAcquirable = abandonedBlock.map();
+    ASSERT_EQ(C2_OK, abandoned.abandon());
+    EXPECT_EQ(C2_BAD_STATE, abandonedAcquirable.get().error());
+}
+
 TEST_F(C2BufferTest, MultipleLinearMapTest) {
     std::shared_ptr<C2BlockPool> pool(makeLinearBlockPool());
     constexpr size_t kCapacity = 524288u;
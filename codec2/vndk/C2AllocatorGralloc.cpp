@@ -22,9 +22,11 @@
 #include <android/hardware/graphics/mapper/2.0/IMapper.h>
 #include <cutils/native_handle.h>
 #include <hardware/gralloc.h>
+#include <unistd.h>
 
 #include <C2AllocatorGralloc.h>
 #include <C2Buffer.h>
+#include <C2FenceFactory.h>
 #include <C2PlatformSupport.h>
 
 namespace android {
@@ -349,8 +351,10 @@ c2_status_t C2AllocationGralloc::map(
     ALOGV("mapping buffer with usage %#llx => %#llx",
           (long long)usage.expected, (long long)grallocUsage);
 
-    // TODO
-    (void) fence;
+    if (fence) {
+        // locking is synchronous, so the contents are accessible once mapped
+        *fence = C2Fence();
+    }
 
     if (mBuffer && mLocked) {
         ALOGD("already mapped");
@@ -555,19 +559,22 @@ c2_status_t C2AllocationGralloc::map(
 
 c2_status_t C2AllocationGralloc::unmap(
         uint8_t **addr, C2Rect rect, C2Fence *fence /* nullable */) {
-    // TODO: check addr and size, use fence
+    // TODO: check addr and size
     (void)addr;
     (void)rect;
     c2_status_t err = C2_OK;
     mMapper->unlock(
             const_cast<native_handle_t *>(mBuffer),
             [&err, &fence](const auto &maperr, const auto &releaseFence) {
-                // TODO
-                (void) fence;
-                (void) releaseFence;
                 err = maperr2error(maperr);
-                if (err == C2_OK) {
-                    // TODO: fence
+                if (err == C2_OK && fence) {
+                    const native_handle_t *handle = releaseFence.getNativeHandle();
+                    int fenceFd = -1;
+                    if (handle && handle->numFds > 0) {
+                        // the release fence handle is only valid during this callback
+                        fenceFd = dup(handle->data[0]);
+                    }
+                    *fence = _C2FenceFactory::CreateSyncFence(fenceFd);
                 }
             });
     if (err == C2_OK) {
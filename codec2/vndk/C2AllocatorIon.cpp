@@ -19,6 +19,7 @@
 #include <utils/Log.h>
 
 #include <list>
+#include <mutex>
 
 #include <ion/ion.h>
 #include <sys/mman.h>
@@ -229,8 +230,12 @@ public:
     }
 
     c2_status_t map(size_t offset, size_t size, C2MemoryUsage usage, C2Fence *fence, void **addr) {
-        (void)fence; // TODO: wait for fence
+        if (fence) {
+            *fence = C2Fence(); // mapping is synchronous, contents are accessible right away
+        }
         *addr = nullptr;
+        // blocks carved from the same allocation may be mapped and unmapped concurrently
+        std::lock_guard<std::mutex> lock(mMappingLock);
         if (!mMappings.empty()) {
             ALOGV("multiple map");
             // TODO: technically we should return DUPLICATE here, but our block views don't
@@ -289,6 +294,7 @@ public:
     }
 
     c2_status_t unmap(void *addr, size_t size, C2Fence *fence) {
+        std::lock_guard<std::mutex> lock(mMappingLock);
         if (mMapFd < 0 || mMappings.empty()) {
             ALOGD("tried to unmap unmapped buffer");
             return C2_NOT_FOUND;
@@ -362,6 +368,7 @@ private:
         size_t alignmentBytes;
         size_t size;
     };
+    std::mutex mMappingLock;
     std::list<Mapping> mMappings;
 };
 
@@ -18,14 +18,19 @@
 #define LOG_TAG "C2Buffer"
 #include <utils/Log.h>
 
+#include <algorithm>
+#include <iterator>
 #include <list>
 #include <map>
 #include <mutex>
+#include <type_traits>
 
 #include <C2AllocatorIon.h>
 #include <C2AllocatorGralloc.h>
 #include <C2BufferPriv.h>
 #include <C2BlockInternal.h>
+#include <C2FenceFactory.h>
+#include <C2RecyclerInternal.h>
 #include <bufferpool/ClientManager.h>
 
 namespace {
@@ -105,6 +110,127 @@ class BufferDataBuddy : public C2BufferData {
     friend class ::C2Buffer;
 };
 
+class BufferBuddy : public C2Buffer {
+public:
+    explicit BufferBuddy(const std::vector<C2ConstLinearBlock> &blocks) : C2Buffer(blocks) {}
+    explicit BufferBuddy(const std::vector<C2ConstGraphicBlock> &blocks) : C2Buffer(blocks) {}
+    explicit BufferBuddy(const C2ConstLinearBlock &block) : C2Buffer(block) {}
+    explicit BufferBuddy(const C2ConstGraphicBlock &block) : C2Buffer(block) {}
+};
+
+/**
+ * A vector that keeps up to N elements inline and only allocates from the heap when it grows
+ * beyond that. Most buffers carry at most a couple of blocks, infos and notifications, so this
+ * avoids a heap allocation per element (list/map) or per container (vector) for the common case.
+ *
+ * Iterators are plain pointers and are invalidated by any modification.
+ */
+template<typename T, size_t N>
+class SmallVector {
+public:
+    typedef T *iterator;
+    typedef const T *const_iterator;
+
+    SmallVector() : mSize(0), mOnHeap(false) {}
+
+    template<typename It>
+    SmallVector(It first, It last) : SmallVector() {
+        size_t count = std::distance(first, last);
+        if (count > N) {
+            mHeap.reserve(count);
+            mOnHeap = true;
+        }
+        for (; first != last; ++first) {
+            emplace_back(*first);
+        }
+    }
+
+    SmallVector(const SmallVector &other) : SmallVector(other.begin(), other.end()) {}
+
+    SmallVector &operator=(const SmallVector &) = delete;
+
+    ~SmallVector() {
+        clear();
+    }
+
+    size_t size() const { return mOnHeap ? mHeap.size() : mSize; }
+    bool empty() const { return size() == 0; }
+
+    T *data() { return mOnHeap ? mHeap.data() : inlineData(); }
+    const T *data() const { return mOnHeap ? mHeap.data() : inlineData(); }
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + size(); }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + size(); }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args) {
+        if (!mOnHeap && mSize == N) {
+            spill();
+        }
+        if (mOnHeap) {
+            mHeap.emplace_back(std::forward<Args>(args)...);
+        } else {
+            new (inlineData() + mSize) T(std::forward<Args>(args)...);
+            ++mSize;
+        }
+    }
+
+    /**
+     * Inserts an element before |pos|. Returns an iterator to the inserted element.
+     */
+    template<typename... Args>
+    iterator emplace(const_iterator pos, Args&&... args) {
+        size_t ix = pos - begin();
+        emplace_back(std::forward<Args>(args)...);
+        std::rotate(begin() + ix, end() - 1, end());
+        return begin() + ix;
+    }
+
+    iterator erase(const_iterator pos) {
+        size_t ix = pos - begin();
+        std::move(begin() + ix + 1, end(), begin() + ix);
+        pop_back();
+        return begin() + ix;
+    }
+
+    void pop_back() {
+        if (mOnHeap) {
+            mHeap.pop_back();
+        } else {
+            inlineData()[--mSize].~T();
+        }
+    }
+
+    void clear() {
+        while (!mOnHeap && mSize > 0) {
+            pop_back();
+        }
+        mHeap.clear();
+    }
+
+private:
+    T *inlineData() { return reinterpret_cast<T *>(mInline); }
+    const T *inlineData() const { return reinterpret_cast<const T *>(mInline); }
+
+    /** Moves the inline elements to the heap once the inline storage is full. */
+    void spill() {
+        mHeap.reserve(2 * N);
+        for (size_t i = 0; i < mSize; ++i) {
+            mHeap.emplace_back(std::move(inlineData()[i]));
+            inlineData()[i].~T();
+        }
+        mSize = 0;
+        mOnHeap = true;
+    }
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type mInline[N];
+    size_t mSize; ///< number of inline elements, if not on heap
+    bool mOnHeap;
+    std::vector<T> mHeap;
+};
+
 }  // namespace
 
 /* ========================================== 1D BLOCK ========================================= */
@@ -273,9 +399,9 @@ C2ConstLinearBlock::C2ConstLinearBlock(std::shared_ptr<Impl> impl, const _C2Line
 C2Acquirable<C2ReadView> C2ConstLinearBlock::map() const {
     void *base = nullptr;
     uint32_t len = size();
+    C2Fence mapFence;
     c2_status_t error = mImpl->getAllocation()->map(
-            offset(), len, { C2MemoryUsage::CPU_READ, 0 }, nullptr, &base);
-    // TODO: wait on fence
+            offset(), len, { C2MemoryUsage::CPU_READ, 0 }, &mapFence, &base);
     if (error == C2_OK) {
         std::shared_ptr<ReadViewBuddy::Impl> rvi = std::shared_ptr<ReadViewBuddy::Impl>(
                 new ReadViewBuddy::Impl(*mImpl, (uint8_t *)base, offset(), len),
@@ -283,7 +409,11 @@ C2Acquirable<C2ReadView> C2ConstLinearBlock::map() const {
                     (void)i->getAllocation()->unmap(base, len, nullptr);
                     delete i;
         });
-        return AcquirableReadViewBuddy(error, C2Fence(), ReadViewBuddy(rvi, 0, len));
+        // Do not wait for the producer here. The acquire fence covers both the mapping and the
+        // block's own fence, and is waited for in C2Acquirable::get().
+        return AcquirableReadViewBuddy(
+                error, _C2FenceFactory::CreateMergedFence(mapFence, mFence),
+                ReadViewBuddy(rvi, 0, len));
     } else {
         return AcquirableReadViewBuddy(error, C2Fence(), ReadViewBuddy(error));
     }
@@ -303,9 +433,9 @@ C2LinearBlock::C2LinearBlock(std::shared_ptr<Impl> impl, const _C2LinearRangeAsp
 C2Acquirable<C2WriteView> C2LinearBlock::map() {
     void *base = nullptr;
     uint32_t len = size();
+    C2Fence mapFence;
     c2_status_t error = mImpl->getAllocation()->map(
-            offset(), len, { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE }, nullptr, &base);
-    // TODO: wait on fence
+            offset(), len, { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE }, &mapFence, &base);
     if (error == C2_OK) {
         std::shared_ptr<WriteViewBuddy::Impl> rvi = std::shared_ptr<WriteViewBuddy::Impl>(
                 new WriteViewBuddy::Impl(*mImpl, (uint8_t *)base, 0, len),
@@ -313,7 +443,7 @@ C2Acquirable<C2WriteView> C2LinearBlock::map() {
                     (void)i->getAllocation()->unmap(base, len, nullptr);
                     delete i;
         });
-        return AcquirableWriteViewBuddy(error, C2Fence(), WriteViewBuddy(rvi));
+        return AcquirableWriteViewBuddy(error, mapFence, WriteViewBuddy(rvi));
     } else {
         return AcquirableWriteViewBuddy(error, C2Fence(), WriteViewBuddy(error));
     }
@@ -644,7 +774,9 @@ public:
     Impl(const std::shared_ptr<C2Allocator> &allocator)
             : mInit(C2_OK),
               mBufferPoolManager(ClientManager::getInstance()),
-              mAllocator(std::make_shared<_C2BufferPoolAllocator>(allocator)) {
+              mAllocator(std::make_shared<_C2BufferPoolAllocator>(allocator)),
+              mSlabUsage(0u),
+              mSlabOffset(0u) {
         if (mAllocator && mBufferPoolManager) {
             if (mBufferPoolManager->create(
                     mAllocator, &mConnectionId) == ResultStatus::OK) {
@@ -667,32 +799,10 @@ public:
         if (mInit != C2_OK) {
             return mInit;
         }
-        std::vector<uint8_t> params;
-        mAllocator->getLinearParams(capacity, usage, &params);
-        std::shared_ptr<BufferPoolData> bufferPoolData;
-        native_handle_t *cHandle = nullptr;
-        ResultStatus status = mBufferPoolManager->allocate(
-                mConnectionId, params, &cHandle, &bufferPoolData);
-        if (status == ResultStatus::OK) {
-            native_handle_t *handle = native_handle_clone(cHandle);
-            if (handle) {
-                std::shared_ptr<C2LinearAllocation> alloc;
-                std::shared_ptr<C2PooledBlockPoolData> poolData =
-                        std::make_shared<C2PooledBlockPoolData>(bufferPoolData);
-                c2_status_t err = mAllocator->priorLinearAllocation(handle, &alloc);
-                if (err == C2_OK && poolData && alloc) {
-                    *block = _C2BlockFactory::CreateLinearBlock(alloc, poolData, 0, capacity);
-                    if (*block) {
-                        return C2_OK;
-                    }
-                }
-            }
-            return C2_NO_MEMORY;
-        }
-        if (status == ResultStatus::NO_MEMORY) {
-            return C2_NO_MEMORY;
+        if (capacity > 0u && capacity <= MAX_SUB_BLOCK_SIZE) {
+            return fetchSubLinearBlock(capacity, usage, block);
         }
-        return C2_CORRUPTED;
+        return fetchDirectLinearBlock(capacity, usage, block);
     }
 
     c2_status_t fetchGraphicBlock(
@@ -738,10 +848,119 @@ public:
     }
 
 private:
+    enum : uint32_t {
+        SLAB_SIZE = 1024u * 1024u,           ///< size of allocations small blocks are carved from
+        MAX_SUB_BLOCK_SIZE = SLAB_SIZE / 8u, ///< larger blocks are allocated individually
+        SUB_BLOCK_ALIGNMENT = 64u,           ///< alignment of small blocks within a slab
+        MAX_RETIRED_SLABS = 2u,              ///< max. retired slabs kept alive by their blocks
+    };
+
+    /**
+     * Allocates a buffer of |capacity| bytes from the buffer pool.
+     */
+    c2_status_t allocateLinear(
+            uint32_t capacity, C2MemoryUsage usage,
+            std::shared_ptr<C2LinearAllocation> *alloc /* nonnull */,
+            std::shared_ptr<C2PooledBlockPoolData> *poolData /* nonnull */) {
+        std::vector<uint8_t> params;
+        mAllocator->getLinearParams(capacity, usage, &params);
+        std::shared_ptr<BufferPoolData> bufferPoolData;
+        native_handle_t *cHandle = nullptr;
+        ResultStatus status = mBufferPoolManager->allocate(
+                mConnectionId, params, &cHandle, &bufferPoolData);
+        if (status == ResultStatus::OK) {
+            native_handle_t *handle = native_handle_clone(cHandle);
+            if (handle) {
+                *poolData = std::make_shared<C2PooledBlockPoolData>(bufferPoolData);
+                c2_status_t err = mAllocator->priorLinearAllocation(handle, alloc);
+                if (err == C2_OK && *poolData && *alloc) {
+                    return C2_OK;
+                }
+            }
+            return C2_NO_MEMORY;
+        }
+        if (status == ResultStatus::NO_MEMORY) {
+            return C2_NO_MEMORY;
+        }
+        return C2_CORRUPTED;
+    }
+
+    /**
+     * Allocates a block of |capacity| bytes that has its own buffer from the buffer pool.
+     */
+    c2_status_t fetchDirectLinearBlock(
+            uint32_t capacity, C2MemoryUsage usage,
+            std::shared_ptr<C2LinearBlock> *block /* nonnull */) {
+        std::shared_ptr<C2LinearAllocation> alloc;
+        std::shared_ptr<C2PooledBlockPoolData> poolData;
+        c2_status_t err = allocateLinear(capacity, usage, &alloc, &poolData);
+        if (err == C2_OK) {
+            *block = _C2BlockFactory::CreateLinearBlock(alloc, poolData, 0, capacity);
+            if (!*block) {
+                return C2_NO_MEMORY;
+            }
+        }
+        return err;
+    }
+
+    /**
+     * Carves a small block out of the current slab, allocating a new slab if the current one is
+     * exhausted.
+     *
+     * Blocks carved from a slab share its allocation and buffer pool data, so the slab is only
+     * sent (and imported) once by the buffer pool, and each block is described by its range
+     * within the slab. The slab is returned to the buffer pool once this pool and all blocks
+     * carved from it let go of it.
+     *
+     * A single long-lived block keeps its whole slab alive. To bound the memory held this way,
+     * small blocks are allocated individually while MAX_RETIRED_SLABS slabs that this pool has
+     * moved on from are still kept alive by their blocks.
+     */
+    c2_status_t fetchSubLinearBlock(
+            uint32_t capacity, C2MemoryUsage usage,
+            std::shared_ptr<C2LinearBlock> *block /* nonnull */) {
+        std::lock_guard<std::mutex> lock(mSlabLock);
+        uint32_t offset = (mSlabOffset + SUB_BLOCK_ALIGNMENT - 1u) & ~(SUB_BLOCK_ALIGNMENT - 1u);
+        if (!mSlab || mSlabUsage.expected != usage.expected
+                || offset > mSlab->capacity() || capacity > mSlab->capacity() - offset) {
+            if (mSlab) {
+                mRetiredSlabs.emplace_back(mSlab);
+            }
+            mSlab.reset();
+            mSlabPoolData.reset();
+            mRetiredSlabs.remove_if(
+                    [](const std::weak_ptr<C2LinearAllocation> &slab) { return slab.expired(); });
+            if (mRetiredSlabs.size() >= MAX_RETIRED_SLABS) {
+                return fetchDirectLinearBlock(capacity, usage, block);
+            }
+            c2_status_t err = allocateLinear(SLAB_SIZE, usage, &mSlab, &mSlabPoolData);
+            if (err != C2_OK) {
+                mSlab.reset();
+                mSlabPoolData.reset();
+                return err;
+            }
+            mSlabUsage = usage;
+            offset = 0u;
+        }
+        *block = _C2BlockFactory::CreateLinearBlock(mSlab, mSlabPoolData, offset, capacity);
+        if (!*block) {
+            return C2_NO_MEMORY;
+        }
+        mSlabOffset = offset + capacity;
+        return C2_OK;
+    }
+
     c2_status_t mInit;
     const android::sp<ClientManager> mBufferPoolManager;
     ConnectionId mConnectionId; // locally
     const std::shared_ptr<_C2BufferPoolAllocator> mAllocator;
+
+    std::mutex mSlabLock;
+    std::shared_ptr<C2LinearAllocation> mSlab; ///< current slab for small blocks
+    std::shared_ptr<C2PooledBlockPoolData> mSlabPoolData;
+    C2MemoryUsage mSlabUsage;
+    uint32_t mSlabOffset; ///< first unused byte of the current slab
+    std::list<std::weak_ptr<C2LinearAllocation>> mRetiredSlabs; ///< previous slabs
 };
 
 C2PooledBlockPool::C2PooledBlockPool(
@@ -843,7 +1062,7 @@ public:
     private:
         friend class _C2MappingBlock2DImpl;
 
-        Mapped(const std::shared_ptr<_C2Block2DImpl> &impl, bool writable, C2Fence *fence __unused)
+        Mapped(const std::shared_ptr<_C2Block2DImpl> &impl, bool writable, C2Fence *fence)
             : mImpl(impl), mWritable(writable) {
             memset(mData, 0, sizeof(mData));
             const C2Rect crop = mImpl->crop();
@@ -852,9 +1071,12 @@ public:
             mError = mImpl->getAllocation()->map(
                     crop,
                     { C2MemoryUsage::CPU_READ, writable ? C2MemoryUsage::CPU_WRITE : 0 },
-                    nullptr,
+                    fence != nullptr ? &mAcquireFence : nullptr,
                     &mLayout,
                     mData);
+            if (fence != nullptr) {
+                *fence = mAcquireFence;
+            }
             if (mError != C2_OK) {
                 memset(&mLayout, 0, sizeof(mLayout));
                 memset(mData, 0, sizeof(mData));
@@ -910,9 +1132,13 @@ public:
         /** returns whether the mapping is writable */
         bool writable() const { return mWritable; }
 
+        /** returns the acquire fence of the mapping */
+        C2Fence acquireFence() const { return mAcquireFence; }
+
     private:
         const std::shared_ptr<_C2Block2DImpl> mImpl;
         bool mWritable;
+        C2Fence mAcquireFence;
         c2_status_t mError;
         uint8_t *mData[C2PlanarLayout::MAX_NUM_PLANES];
         uint8_t *mOffsetData[C2PlanarLayout::MAX_NUM_PLANES];
@@ -937,7 +1163,8 @@ public:
                 existing = std::shared_ptr<Mapped>(new Mapped(C2_CANNOT_DO));
             }
             if (fence != nullptr) {
-                *fence = C2Fence();
+                // the existing mapping may still be pending
+                *fence = existing->acquireFence();
             }
         }
         return existing;
@@ -1038,8 +1265,11 @@ C2Acquirable<const C2GraphicView> C2ConstGraphicBlock::map() const {
         mImpl->map(false /* writable */, &fence);
     std::shared_ptr<GraphicViewBuddy::Impl> gvi =
         std::shared_ptr<GraphicViewBuddy::Impl>(new GraphicViewBuddy::Impl(*mImpl, mapping));
+    // Do not wait for the producer here. The acquire fence covers both the mapping and the
+    // block's own fence, and is waited for in C2Acquirable::get().
     return AcquirableConstGraphicViewBuddy(
-            mapping->error(), fence, GraphicViewBuddy(gvi, C2PlanarSection(*mImpl, crop())));
+            mapping->error(), _C2FenceFactory::CreateMergedFence(fence, mFence),
+            GraphicViewBuddy(gvi, C2PlanarSection(*mImpl, crop())));
 }
 
 C2ConstGraphicBlock C2ConstGraphicBlock::subBlock(const C2Rect &rect) const {
@@ -1140,34 +1370,67 @@ class C2BufferData::Impl {
 public:
     explicit Impl(const std::vector<C2ConstLinearBlock> &blocks)
         : mType(blocks.size() == 1 ? LINEAR : LINEAR_CHUNKS),
-          mLinearBlocks(blocks) {
+          mLinearBlocks(blocks.begin(), blocks.end()) {
     }
 
     explicit Impl(const std::vector<C2ConstGraphicBlock> &blocks)
         : mType(blocks.size() == 1 ? GRAPHIC : GRAPHIC_CHUNKS),
-          mGraphicBlocks(blocks) {
+          mGraphicBlocks(blocks.begin(), blocks.end()) {
+    }
+
+    explicit Impl(const C2ConstLinearBlock &block)
+        : mType(LINEAR), mLinearBlocks(&block, &block + 1) {
+    }
+
+    explicit Impl(const C2ConstGraphicBlock &block)
+        : mType(GRAPHIC), mGraphicBlocks(&block, &block + 1) {
     }
 
     type_t type() const { return mType; }
-    const std::vector<C2ConstLinearBlock> &linearBlocks() const { return mLinearBlocks; }
-    const std::vector<C2ConstGraphicBlock> &graphicBlocks() const { return mGraphicBlocks; }
+
+    Span<C2ConstLinearBlock> linearBlocks() const {
+        return Span<C2ConstLinearBlock>(mLinearBlocks.data(), mLinearBlocks.size());
+    }
+
+    Span<C2ConstGraphicBlock> graphicBlocks() const {
+        return Span<C2ConstGraphicBlock>(mGraphicBlocks.data(), mGraphicBlocks.size());
+    }
 
 private:
     type_t mType;
-    std::vector<C2ConstLinearBlock> mLinearBlocks;
-    std::vector<C2ConstGraphicBlock> mGraphicBlocks;
+    // buffers almost always contain a single block
+    SmallVector<C2ConstLinearBlock, 1> mLinearBlocks;
+    SmallVector<C2ConstGraphicBlock, 1> mGraphicBlocks;
 };
 
-C2BufferData::C2BufferData(const std::vector<C2ConstLinearBlock> &blocks) : mImpl(new Impl(blocks)) {}
-C2BufferData::C2BufferData(const std::vector<C2ConstGraphicBlock> &blocks) : mImpl(new Impl(blocks)) {}
+// buffers are created for every frame, so recycle the memory of their implementation objects
+
+C2BufferData::C2BufferData(const std::vector<C2ConstLinearBlock> &blocks)
+    : mImpl(std::allocate_shared<Impl>(_C2RecyclingAllocator<Impl>(), blocks)) {}
+C2BufferData::C2BufferData(const std::vector<C2ConstGraphicBlock> &blocks)
+    : mImpl(std::allocate_shared<Impl>(_C2RecyclingAllocator<Impl>(), blocks)) {}
+C2BufferData::C2BufferData(const C2ConstLinearBlock &block)
+    : mImpl(std::allocate_shared<Impl>(_C2RecyclingAllocator<Impl>(), block)) {}
+C2BufferData::C2BufferData(const C2ConstGraphicBlock &block)
+    : mImpl(std::allocate_shared<Impl>(_C2RecyclingAllocator<Impl>(), block)) {}
 
 C2BufferData::type_t C2BufferData::type() const { return mImpl->type(); }
 
 const std::vector<C2ConstLinearBlock> C2BufferData::linearBlocks() const {
-    return mImpl->linearBlocks();
+    Span<C2ConstLinearBlock> blocks = mImpl->linearBlocks();
+    return std::vector<C2ConstLinearBlock>(blocks.begin(), blocks.end());
 }
 
 const std::vector<C2ConstGraphicBlock> C2BufferData::graphicBlocks() const {
+    Span<C2ConstGraphicBlock> blocks = mImpl->graphicBlocks();
+    return std::vector<C2ConstGraphicBlock>(blocks.begin(), blocks.end());
+}
+
+C2BufferData::Span<C2ConstLinearBlock> C2BufferData::linearBlockSpan() const {
+    return mImpl->linearBlocks();
+}
+
+C2BufferData::Span<C2ConstGraphicBlock> C2BufferData::graphicBlockSpan() const {
     return mImpl->graphicBlocks();
 }
 
@@ -1177,6 +1440,10 @@ public:
         : mThis(thiz), mData(blocks) {}
     Impl(C2Buffer *thiz, const std::vector<C2ConstGraphicBlock> &blocks)
         : mThis(thiz), mData(blocks) {}
+    Impl(C2Buffer *thiz, const C2ConstLinearBlock &block)
+        : mThis(thiz), mData(block) {}
+    Impl(C2Buffer *thiz, const C2ConstGraphicBlock &block)
+        : mThis(thiz), mData(block) {}
 
     ~Impl() {
         for (const auto &pair : mNotify) {
@@ -1221,18 +1488,21 @@ public:
     }
 
     c2_status_t setInfo(const std::shared_ptr<C2Info> &info) {
-        // To "update" you need to erase the existing one if any, and then insert.
-        (void) mInfos.erase(info->coreIndex());
-        (void) mInfos.insert({ info->coreIndex(), info });
+        auto it = lowerBound(info->coreIndex());
+        if (it != mInfos.end() && it->first == info->coreIndex()) {
+            it->second = info;
+        } else {
+            (void) mInfos.emplace(it, info->coreIndex(), info);
+        }
         return C2_OK;
     }
 
     bool hasInfo(C2Param::Type index) const {
-        return mInfos.count(index.coreIndex()) > 0;
+        return findInfo(index.coreIndex()) != mInfos.end();
     }
 
     std::shared_ptr<const C2Info> getInfo(C2Param::Type index) const {
-        auto it = mInfos.find(index.coreIndex());
+        auto it = findInfo(index.coreIndex());
         if (it == mInfos.end()) {
             return nullptr;
         }
@@ -1240,7 +1510,7 @@ public:
     }
 
     std::shared_ptr<C2Info> removeInfo(C2Param::Type index) {
-        auto it = mInfos.find(index.coreIndex());
+        auto it = findInfo(index.coreIndex());
         if (it == mInfos.end()) {
             return nullptr;
         }
@@ -1250,17 +1520,48 @@ public:
     }
 
 private:
+    typedef std::pair<C2Param::CoreIndex, std::shared_ptr<C2Info>> InfoEntry;
+    typedef SmallVector<InfoEntry, 4> Infos;
+
+    // infos are kept sorted by core index, so that info() returns them in a stable order
+    Infos::const_iterator lowerBound(C2Param::CoreIndex index) const {
+        return std::lower_bound(
+                mInfos.begin(), mInfos.end(), index,
+                [] (const InfoEntry &entry, C2Param::CoreIndex key) { return entry.first < key; });
+    }
+
+    Infos::iterator lowerBound(C2Param::CoreIndex index) {
+        return const_cast<Infos::iterator>(
+                const_cast<const Impl *>(this)->lowerBound(index));
+    }
+
+    Infos::const_iterator findInfo(C2Param::CoreIndex index) const {
+        auto it = lowerBound(index);
+        return (it != mInfos.end() && it->first == index) ? it : mInfos.end();
+    }
+
+    Infos::iterator findInfo(C2Param::CoreIndex index) {
+        return const_cast<Infos::iterator>(
+                const_cast<const Impl *>(this)->findInfo(index));
+    }
+
     C2Buffer * const mThis;
     BufferDataBuddy mData;
-    std::map<C2Param::CoreIndex, std::shared_ptr<C2Info>> mInfos;
-    std::list<std::pair<OnDestroyNotify, void *>> mNotify;
+    Infos mInfos;
+    SmallVector<std::pair<OnDestroyNotify, void *>, 2> mNotify;
 };
 
 C2Buffer::C2Buffer(const std::vector<C2ConstLinearBlock> &blocks)
-    : mImpl(new Impl(this, blocks)) {}
+    : mImpl(std::allocate_shared<Impl>(_C2RecyclingAllocator<Impl>(), this, blocks)) {}
 
 C2Buffer::C2Buffer(const std::vector<C2ConstGraphicBlock> &blocks)
-    : mImpl(new Impl(this, blocks)) {}
+    : mImpl(std::allocate_shared<Impl>(_C2RecyclingAllocator<Impl>(), this, blocks)) {}
+
+C2Buffer::C2Buffer(const C2ConstLinearBlock &block)
+    : mImpl(std::allocate_shared<Impl>(_C2RecyclingAllocator<Impl>(), this, block)) {}
+
+C2Buffer::C2Buffer(const C2ConstGraphicBlock &block)
+    : mImpl(std::allocate_shared<Impl>(_C2RecyclingAllocator<Impl>(), this, block)) {}
 
 const C2BufferData C2Buffer::data() const { return mImpl->data(); }
 
@@ -1294,11 +1595,13 @@ std::shared_ptr<C2Info> C2Buffer::removeInfo(C2Param::Type index) {
 
 // static
 std::shared_ptr<C2Buffer> C2Buffer::CreateLinearBuffer(const C2ConstLinearBlock &block) {
-    return std::shared_ptr<C2Buffer>(new C2Buffer({ block }));
+    return std::allocate_shared<BufferBuddy>(
+            _C2RecyclingAllocator<BufferBuddy>(), block);
 }
 
 // static
 std::shared_ptr<C2Buffer> C2Buffer::CreateGraphicBuffer(const C2ConstGraphicBlock &block) {
-    return std::shared_ptr<C2Buffer>(new C2Buffer({ block }));
+    return std::allocate_shared<BufferBuddy>(
+            _C2RecyclingAllocator<BufferBuddy>(), block);
 }
 
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "C2Fence"
+#include <utils/Log.h>
+
+#include <android/sync.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <mutex>
+
+#include <C2Buffer.h>
+#include <C2FenceFactory.h>
+
+/**
+ * Fence implementation interface.
+ */
+class C2Fence::Impl {
+public:
+    virtual ~Impl() = default;
+
+    virtual c2_status_t wait(c2_nsecs_t timeoutNs) = 0;
+    virtual bool valid() const = 0;
+    virtual bool ready() const = 0;
+    virtual int fd() const = 0;
+    virtual bool isHW() const = 0;
+};
+
+C2Fence::C2Fence(std::shared_ptr<Impl> impl) : mImpl(impl) {}
+
+c2_status_t C2Fence::wait(c2_nsecs_t timeoutNs) {
+    return mImpl ? mImpl->wait(timeoutNs) : C2_OK;
+}
+
+bool C2Fence::valid() const {
+    return mImpl ? mImpl->valid() : true;
+}
+
+bool C2Fence::ready() const {
+    return mImpl ? mImpl->ready() : true;
+}
+
+int C2Fence::fd() const {
+    return mImpl ? mImpl->fd() : -1;
+}
+
+bool C2Fence::isHW() const {
+    return mImpl ? mImpl->isHW() : false;
+}
+
+/* ======================================= SYNC FENCE ====================================== */
+
+/**
+ * Fence backed by a sync_file file descriptor, e.g. a fence produced by gralloc or the GPU.
+ */
+class _C2FenceFactory::SyncFenceImpl : public C2Fence::Impl {
+public:
+    explicit SyncFenceImpl(int fenceFd) : mFenceFd(fenceFd) {}
+
+    virtual ~SyncFenceImpl() override {
+        close(mFenceFd);
+    }
+
+    virtual c2_status_t wait(c2_nsecs_t timeoutNs) override {
+        int timeoutMs = -1;
+        if (timeoutNs >= 0) {
+            // round up so that we do not return before the requested timeout
+            c2_nsecs_t ms = (timeoutNs + 999999) / 1000000;
+            timeoutMs = ms > INT_MAX ? INT_MAX : (int)ms;
+        }
+        if (sync_wait(mFenceFd, timeoutMs) == 0) {
+            return C2_OK;
+        }
+        switch (errno) {
+            case ETIME:     return C2_TIMED_OUT;
+            case EACCES:    return C2_REFUSED;
+            default:
+                ALOGD("sync_wait failed: %d", errno);
+                return C2_CORRUPTED;
+        }
+    }
+
+    virtual bool valid() const override {
+        return mFenceFd >= 0;
+    }
+
+    virtual bool ready() const override {
+        return sync_wait(mFenceFd, 0) == 0;
+    }
+
+    virtual int fd() const override {
+        return dup(mFenceFd);
+    }
+
+    virtual bool isHW() const override {
+        return true;
+    }
+
+private:
+    const int mFenceFd;
+};
+
+C2Fence _C2FenceFactory::CreateSyncFence(int fenceFd) {
+    if (fenceFd < 0) {
+        return C2Fence();
+    }
+    return C2Fence(std::make_shared<SyncFenceImpl>(fenceFd));
+}
+
+/* ====================================== MERGED FENCE ===================================== */
+
+/**
+ * Fence that is signaled once all of its (non-mergeable) fences are signaled.
+ */
+class _C2FenceFactory::MergedFenceImpl : public C2Fence::Impl {
+public:
+    explicit MergedFenceImpl(const std::vector<C2Fence> &fences) : mFences(fences) {}
+
+    virtual ~MergedFenceImpl() override = default;
+
+    virtual c2_status_t wait(c2_nsecs_t timeoutNs) override {
+        typedef std::chrono::steady_clock clock;
+        const clock::time_point deadline = clock::now() + std::chrono::nanoseconds(timeoutNs);
+        for (C2Fence &fence : mFences) {
+            c2_nsecs_t remainingNs = -1;
+            if (timeoutNs >= 0) {
+                remainingNs = std::max(
+                        (c2_nsecs_t)0,
+                        (c2_nsecs_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                deadline - clock::now()).count());
+            }
+            c2_status_t err = fence.wait(remainingNs);
+            if (err != C2_OK) {
+                return err;
+            }
+        }
+        return C2_OK;
+    }
+
+    virtual bool valid() const override {
+        return std::all_of(mFences.begin(), mFences.end(),
+                           [](const C2Fence &fence) { return fence.valid(); });
+    }
+
+    virtual bool ready() const override {
+        return std::all_of(mFences.begin(), mFences.end(),
+                           [](const C2Fence &fence) { return fence.ready(); });
+    }
+
+    virtual int fd() const override {
+        // software fences cannot be represented as a file descriptor
+        return -1;
+    }
+
+    virtual bool isHW() const override {
+        return false;
+    }
+
+private:
+    std::vector<C2Fence> mFences;
+};
+
+C2Fence _C2FenceFactory::CreateMergedFence(const std::vector<C2Fence> &fences) {
+    std::vector<C2Fence> others;
+    int mergedFd = -1;
+    for (const C2Fence &fence : fences) {
+        if (!fence.mImpl) {
+            continue;
+        }
+        int fd = fence.isHW() ? fence.fd() : -1;
+        if (fd < 0) {
+            others.push_back(fence);
+            continue;
+        }
+        if (mergedFd < 0) {
+            mergedFd = fd;
+            continue;
+        }
+        int merged = sync_merge("C2MergedFence", mergedFd, fd);
+        close(fd);
+        if (merged < 0) {
+            ALOGD("sync_merge failed: %d", errno);
+            others.push_back(fence);
+            continue;
+        }
+        close(mergedFd);
+        mergedFd = merged;
+    }
+    if (mergedFd >= 0) {
+        others.push_back(CreateSyncFence(mergedFd));
+    }
+    if (others.empty()) {
+        return C2Fence();
+    } else if (others.size() == 1u) {
+        return others.front();
+    }
+    return C2Fence(std::make_shared<MergedFenceImpl>(others));
+}
+
+C2Fence _C2FenceFactory::CreateMergedFence(const C2Fence &fence1, const C2Fence &fence2) {
+    if (!fence1.mImpl) {
+        return fence2;
+    } else if (!fence2.mImpl) {
+        return fence1;
+    }
+    return CreateMergedFence(std::vector<C2Fence>{ fence1, fence2 });
+}
+
+/* ========================================= EVENT ========================================= */
+
+/**
+ * Software fence signaled via a C2Event.
+ */
+class _C2FenceFactory::EventFenceImpl : public C2Fence::Impl {
+public:
+    EventFenceImpl() : mState(PENDING) {}
+
+    virtual ~EventFenceImpl() override = default;
+
+    virtual c2_status_t wait(c2_nsecs_t timeoutNs) override {
+        typedef std::chrono::steady_clock clock;
+        const clock::time_point start = clock::now();
+        std::unique_lock<std::mutex> lock(mLock);
+        auto signaled = [this] { return mState != PENDING; };
+        if (timeoutNs < 0) {
+            mCond.wait(lock, signaled);
+        } else if (!mCond.wait_for(lock, std::chrono::nanoseconds(timeoutNs), signaled)) {
+            return C2_TIMED_OUT;
+        }
+        if (mState == MERGED) {
+            C2Fence merged = mMerged;
+            lock.unlock();
+            c2_nsecs_t remainingNs = -1;
+            if (timeoutNs >= 0) {
+                remainingNs = std::max(
+                        (c2_nsecs_t)0,
+                        timeoutNs - (c2_nsecs_t)std::chrono::duration_cast<
+                                std::chrono::nanoseconds>(clock::now() - start).count());
+            }
+            return merged.wait(remainingNs);
+        }
+        return mState == FIRED ? C2_OK : C2_BAD_STATE;
+    }
+
+    virtual bool valid() const override {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mState == MERGED ? mMerged.valid() : mState != ABANDONED;
+    }
+
+    virtual bool ready() const override {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mState == MERGED ? mMerged.ready() : mState == FIRED;
+    }
+
+    virtual int fd() const override {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mState == MERGED ? mMerged.fd() : -1;
+    }
+
+    virtual bool isHW() const override {
+        return false;
+    }
+
+    c2_status_t fire() {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mState == FIRED) {
+            return C2_DUPLICATE;
+        } else if (mState != PENDING) {
+            return C2_BAD_STATE;
+        }
+        mState = FIRED;
+        mCond.notify_all();
+        return C2_OK;
+    }
+
+    c2_status_t abandon() {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mState == ABANDONED) {
+            return C2_DUPLICATE;
+        } else if (mState != PENDING) {
+            return C2_BAD_STATE;
+        }
+        mState = ABANDONED;
+        mCond.notify_all();
+        return C2_OK;
+    }
+
+    c2_status_t merge(const std::vector<C2Fence> &fences) {
+        C2Fence merged = CreateMergedFence(fences);
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mState == MERGED) {
+            return C2_DUPLICATE;
+        } else if (mState != PENDING) {
+            return C2_BAD_STATE;
+        }
+        mMerged = merged;
+        mState = MERGED;
+        // waiters switch over to the merged fence
+        mCond.notify_all();
+        return C2_OK;
+    }
+
+private:
+    enum state_t {
+        PENDING,
+        FIRED,
+        ABANDONED,
+        MERGED,
+    };
+
+    mutable std::mutex mLock;
+    std::condition_variable mCond;
+    state_t mState;
+    C2Fence mMerged;
+};
+
+C2Fence _C2FenceFactory::CreateEventFence(const std::shared_ptr<EventFenceImpl> &impl) {
+    return C2Fence(impl);
+}
+
+class C2Event::Impl {
+public:
+    Impl() : mFence(std::make_shared<_C2FenceFactory::EventFenceImpl>()) {}
+
+    ~Impl() {
+        // abandon the fence(s) if this event is destroyed without being signaled
+        if (mFence->abandon() == C2_OK) {
+            ALOGW("event destroyed without being signaled");
+        }
+    }
+
+    const std::shared_ptr<_C2FenceFactory::EventFenceImpl> mFence;
+};
+
+C2Event::C2Event() : mImpl(std::make_shared<Impl>()) {}
+
+C2Fence C2Event::fence() const {
+    return _C2FenceFactory::CreateEventFence(mImpl->mFence);
+}
+
+c2_status_t C2Event::fire() {
+    return mImpl->mFence->fire();
+}
+
+c2_status_t C2Event::merge(std::vector<C2Fence> fences) {
+    return mImpl->mFence->merge(fences);
+}
+
+c2_status_t C2Event::abandon() {
+    return mImpl->mFence->abandon();
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_STAGEFRIGHT_C2FENCE_FACTORY_H_
+#define ANDROID_STAGEFRIGHT_C2FENCE_FACTORY_H_
+
+#include <C2Buffer.h>
+
+#include <memory>
+#include <vector>
+
+/**
+ * Internal only interface for creating fences by allocator and buffer passing implementations.
+ */
+struct _C2FenceFactory {
+    class SyncFenceImpl;
+    class EventFenceImpl;
+    class MergedFenceImpl;
+
+    /**
+     * Creates a fence backed by a sync_file file descriptor.
+     *
+     * \param fenceFd   sync_file fd. The created fence takes ownership of it.
+     *
+     * \return a hardware fence, or a null-fence (that has fired) if |fenceFd| is negative.
+     */
+    static C2Fence CreateSyncFence(int fenceFd);
+
+    /**
+     * Creates a fence that is signaled once all of |fences| are signaled, and abandoned if any of
+     * them is abandoned. Null-fences are skipped, and sync_file fences are merged into a single
+     * sync_file.
+     *
+     * \return the merged fence. This is a null-fence if all of |fences| are null-fences.
+     */
+    static C2Fence CreateMergedFence(const std::vector<C2Fence> &fences);
+
+    /**
+     * Creates a fence that is signaled once both |fence1| and |fence2| are signaled. This does
+     * not allocate if either of them is a null-fence.
+     */
+    static C2Fence CreateMergedFence(const C2Fence &fence1, const C2Fence &fence2);
+
+    /**
+     * Creates a fence for the event implementation |impl|.
+     */
+    static C2Fence CreateEventFence(const std::shared_ptr<EventFenceImpl> &impl);
+};
+
+#endif // ANDROID_STAGEFRIGHT_C2FENCE_FACTORY_H_
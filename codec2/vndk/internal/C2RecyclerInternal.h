@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_STAGEFRIGHT_C2RECYCLER_INTERNAL_H_
+#define ANDROID_STAGEFRIGHT_C2RECYCLER_INTERNAL_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+
+/**
+ * Internal only cache of free memory blocks of a fixed size and alignment.
+ *
+ * Freed blocks are kept on a free list of the thread that frees them, and are reused by the next
+ * allocation on that thread. Buffers are usually allocated on one thread and freed on another,
+ * so a thread that caches more than MAX_CACHED blocks moves a batch of them to a pool shared by
+ * all threads, and a thread that runs out of blocks takes a batch from that pool. The shared
+ * pool keeps at most MAX_SHARED blocks and returns the rest to the system allocator. A thread
+ * moves its blocks to the shared pool when it exits.
+ */
+template<size_t SIZE, size_t ALIGN>
+class _C2Recycler {
+public:
+    enum : size_t {
+        MAX_CACHED = 32,
+        MAX_SHARED = 256,
+        // number of blocks moved between a thread and the shared pool at once
+        BATCH = MAX_CACHED / 2,
+    };
+
+    static void *allocate() {
+        State &state = sState;
+        if (!state.head && !state.destroyed) {
+            // make sure the free list is released when this thread exits
+            (void)drainer();
+            SharedPool::Get().take(&state, BATCH);
+        }
+        if (state.head) {
+            Node *node = state.head;
+            state.head = node->next;
+            --state.count;
+            return node;
+        }
+        return ::operator new(BLOCK_SIZE);
+    }
+
+    static void deallocate(void *ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        Node *node = static_cast<Node *>(ptr);
+        node->next = nullptr;
+        State &state = sState;
+        // the free list of this thread may already be gone if a block is freed while the
+        // thread (or the process) is exiting.
+        if (state.destroyed) {
+            State single = { node, 1, false };
+            SharedPool::Get().give(&single, 1);
+            return;
+        }
+        // make sure the free list is released when this thread exits
+        (void)drainer();
+        node->next = state.head;
+        state.head = node;
+        ++state.count;
+        if (state.count > MAX_CACHED) {
+            SharedPool::Get().give(&state, BATCH);
+        }
+    }
+
+private:
+    struct Node {
+        Node *next;
+    };
+
+    static_assert(ALIGN <= alignof(std::max_align_t), "over-aligned types are not supported");
+    static constexpr size_t BLOCK_SIZE = SIZE < sizeof(Node) ? sizeof(Node) : SIZE;
+
+    /**
+     * Free list of a thread. This is trivially destructible so that it remains accessible
+     * during thread exit, after the drainer has released the cached blocks.
+     */
+    struct State {
+        Node *head;
+        size_t count;
+        bool destroyed;
+    };
+
+    /**
+     * Free list shared by all threads. It is never destroyed, so that threads (and blocks
+     * freed) during process exit can still use it.
+     */
+    class SharedPool {
+    public:
+        static SharedPool &Get() {
+            static SharedPool *sInstance = new SharedPool;
+            return *sInstance;
+        }
+
+        /**
+         * Moves up to |n| blocks from the front of |state| to this pool. Blocks that do not fit
+         * are returned to the system allocator.
+         */
+        void give(State *state, size_t n) {
+            Node *head = state->head;
+            Node *tail = nullptr;
+            size_t count = 0;
+            for (Node *node = head; node && count < n; node = node->next) {
+                tail = node;
+                ++count;
+            }
+            if (count == 0) {
+                return;
+            }
+            state->head = tail->next;
+            state->count -= count;
+            tail->next = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                while (head && mCount < MAX_SHARED) {
+                    Node *node = head;
+                    head = node->next;
+                    node->next = mHead;
+                    mHead = node;
+                    ++mCount;
+                }
+            }
+            while (head) {
+                Node *node = head;
+                head = node->next;
+                ::operator delete(node);
+            }
+        }
+
+        /**
+         * Moves up to |n| blocks from this pool to the front of |state|.
+         */
+        void take(State *state, size_t n) {
+            std::lock_guard<std::mutex> lock(mLock);
+            for (size_t i = 0; i < n && mHead; ++i) {
+                Node *node = mHead;
+                mHead = node->next;
+                --mCount;
+                node->next = state->head;
+                state->head = node;
+                ++state->count;
+            }
+        }
+
+    private:
+        SharedPool() : mHead(nullptr), mCount(0) {}
+
+        std::mutex mLock;
+        Node *mHead;
+        size_t mCount;
+    };
+
+    struct Drainer {
+        ~Drainer() {
+            State &state = sState;
+            SharedPool::Get().give(&state, state.count);
+            state.head = nullptr;
+            state.count = 0;
+            state.destroyed = true;
+        }
+    };
+
+    static Drainer &drainer() {
+        static thread_local Drainer sDrainer;
+        return sDrainer;
+    }
+
+    static thread_local State sState;
+};
+
+template<size_t SIZE, size_t ALIGN>
+thread_local typename _C2Recycler<SIZE, ALIGN>::State _C2Recycler<SIZE, ALIGN>::sState =
+    { nullptr, 0, false };
+
+/**
+ * Standard allocator that recycles single-object allocations via _C2Recycler. This is meant to
+ * be used with std::allocate_shared, so that both the object and its control block are recycled.
+ */
+template<typename T>
+struct _C2RecyclingAllocator {
+    typedef T value_type;
+
+    _C2RecyclingAllocator() = default;
+
+    template<typename U>
+    _C2RecyclingAllocator(const _C2RecyclingAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        if (n == 1) {
+            return static_cast<T *>(_C2Recycler<sizeof(T), alignof(T)>::allocate());
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, size_t n) {
+        if (n == 1) {
+            _C2Recycler<sizeof(T), alignof(T)>::deallocate(ptr);
+        } else {
+            ::operator delete(ptr);
+        }
+    }
+
+    template<typename U>
+    bool operator==(const _C2RecyclingAllocator<U> &) const { return true; }
+
+    template<typename U>
+    bool operator!=(const _C2RecyclingAllocator<U> &) const { return false; }
+};
+
+#endif  // ANDROID_STAGEFRIGHT_C2RECYCLER_INTERNAL_H_
@@ -153,6 +153,14 @@ private:
     iv_obj_t *mDecHandle;
     std::shared_ptr<C2GraphicBlock> mOutBlock;
     uint8_t *mOutBufferFlush;
+    // decoded pictures when output is scaled (see C2StreamScaledPictureSizeTuning)
+    uint8_t *mOutBufferScale;
+    size_t mOutBufferScaleSize;
+    uint32_t mScaledWidth;
+    uint32_t mScaledHeight;
+    // size of the output pictures last reported to the client (C2StreamPictureSizeInfo)
+    uint32_t mOutputWidth;
+    uint32_t mOutputHeight;
 
     size_t mNumCores;
     IV_COLOR_FORMAT_T mIvColorFormat;
@@ -19,6 +19,9 @@
 #include <log/log.h>
 #include <utils/misc.h>
 
+#include <algorithm>
+#include <cstdlib>
+
 #include <media/hardware/VideoAPI.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaErrors.h>
@@ -147,12 +150,59 @@ public:
                 .withSetter(Setter<decltype(*mRequestSync)>::NonStrictValueWithNoDeps)
                 .build());
 
+        addParameter(
+                DefineParam(mOperatingRate, C2_PARAMKEY_OPERATING_RATE)
+                .withDefault(new C2OperatingRateTuning(0.))
+                .withFields({C2F(mOperatingRate, value).any()})
+                .withSetter(Setter<decltype(*mOperatingRate)>::NonStrictValueWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mRealTimePriority, C2_PARAMKEY_PRIORITY)
+                .withDefault(new C2RealTimePriorityTuning(0))
+                .withFields({C2F(mRealTimePriority, value).any()})
+                .withSetter(Setter<decltype(*mRealTimePriority)>::NonStrictValueWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mCpuAffinity, C2_PARAMKEY_CPU_AFFINITY)
+                .withDefault(C2CpuAffinityTuning::AllocShared(0u))
+                .withFields({ C2F(mCpuAffinity, m.values[0]).any(),
+                              C2F(mCpuAffinity, m.values).any() })
+                .withSetter(Setter<C2CpuAffinityTuning>::NonStrictValuesWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mColorAspects, C2_PARAMKEY_COLOR_ASPECTS)
+                .withDefault(new C2StreamColorAspectsInfo::input(
+                        0u, C2Color::RANGE_UNSPECIFIED, C2Color::PRIMARIES_UNSPECIFIED,
+                        C2Color::TRANSFER_UNSPECIFIED, C2Color::MATRIX_UNSPECIFIED))
+                .withFields({
+                    C2F(mColorAspects, range).inRange(
+                                C2Color::RANGE_UNSPECIFIED,     C2Color::RANGE_OTHER),
+                    C2F(mColorAspects, primaries).inRange(
+                                C2Color::PRIMARIES_UNSPECIFIED, C2Color::PRIMARIES_OTHER),
+                    C2F(mColorAspects, transfer).inRange(
+                                C2Color::TRANSFER_UNSPECIFIED,  C2Color::TRANSFER_OTHER),
+                    C2F(mColorAspects, matrix).inRange(
+                                C2Color::MATRIX_UNSPECIFIED,    C2Color::MATRIX_OTHER)
+                })
+                .withSetter(ColorAspectsSetter)
+                .build());
+
         addParameter(
                 DefineParam(mSyncFramePeriod, C2_PARAMKEY_SYNC_FRAME_INTERVAL)
                 .withDefault(new C2StreamSyncFrameIntervalTuning::output(0u, 1000000))
                 .withFields({C2F(mSyncFramePeriod, value).any()})
                 .withSetter(Setter<decltype(*mSyncFramePeriod)>::StrictValueWithNoDeps)
                 .build());
+
+        addParameter(
+                DefineParam(mLookAhead, C2_PARAMKEY_LOOK_AHEAD)
+                .withDefault(new C2LookAheadTuning(0))
+                .withFields({C2F(mLookAhead, value).inRange(0, MAX_LOOK_AHEAD_FRAMES)})
+                .withSetter(LookAheadSetter)
+                .build());
     }
 
     static C2R BitrateSetter(bool mayBlock, C2P<C2StreamBitrateInfo::output> &me) {
@@ -164,6 +214,12 @@ public:
         return res;
     }
 
+    static C2R LookAheadSetter(bool mayBlock, C2P<C2LookAheadTuning> &me) {
+        (void)mayBlock;
+        me.set().value = c2_min(me.v.value, (uint32_t)MAX_LOOK_AHEAD_FRAMES);
+        return C2R::Ok();
+    }
+
     static C2R SizeSetter(bool mayBlock, const C2P<C2StreamPictureSizeInfo::input> &oldMe,
                           C2P<C2StreamPictureSizeInfo::input> &me) {
         (void)mayBlock;
@@ -317,12 +373,33 @@ public:
         return (uint32_t)c2_max(c2_min(period + 0.5, double(UINT32_MAX)), 1.);
     }
 
+    static C2R ColorAspectsSetter(bool mayBlock, C2P<C2StreamColorAspectsInfo::input> &me) {
+        (void)mayBlock;
+        if (me.v.range > C2Color::RANGE_OTHER) {
+                me.set().range = C2Color::RANGE_OTHER;
+        }
+        if (me.v.primaries > C2Color::PRIMARIES_OTHER) {
+                me.set().primaries = C2Color::PRIMARIES_OTHER;
+        }
+        if (me.v.transfer > C2Color::TRANSFER_OTHER) {
+                me.set().transfer = C2Color::TRANSFER_OTHER;
+        }
+        if (me.v.matrix > C2Color::MATRIX_OTHER) {
+                me.set().matrix = C2Color::MATRIX_OTHER;
+        }
+        return C2R::Ok();
+    }
+
     // unsafe getters
     std::shared_ptr<C2StreamPictureSizeInfo::input> getSize_l() const { return mSize; }
     std::shared_ptr<C2StreamIntraRefreshTuning::output> getIntraRefresh_l() const { return mIntraRefresh; }
     std::shared_ptr<C2StreamFrameRateInfo::output> getFrameRate_l() const { return mFrameRate; }
     std::shared_ptr<C2StreamBitrateInfo::output> getBitrate_l() const { return mBitrate; }
     std::shared_ptr<C2StreamRequestSyncFrameTuning::output> getRequestSync_l() const { return mRequestSync; }
+    std::shared_ptr<C2OperatingRateTuning> getOperatingRate_l() const { return mOperatingRate; }
+    std::shared_ptr<C2RealTimePriorityTuning> getRealTimePriority_l() const { return mRealTimePriority; }
+    uint32_t getLookAhead_l() const { return mLookAhead->value; }
+    std::shared_ptr<C2StreamColorAspectsInfo::input> getColorAspects_l() const { return mColorAspects; }
 
 private:
     std::shared_ptr<C2StreamFormatConfig::input> mInputFormat;
@@ -337,6 +414,11 @@ private:
     std::shared_ptr<C2BitrateTuning::output> mBitrate;
     std::shared_ptr<C2StreamProfileLevelInfo::output> mProfileLevel;
     std::shared_ptr<C2StreamSyncFrameIntervalTuning::output> mSyncFramePeriod;
+    std::shared_ptr<C2OperatingRateTuning> mOperatingRate;
+    std::shared_ptr<C2RealTimePriorityTuning> mRealTimePriority;
+    std::shared_ptr<C2CpuAffinityTuning> mCpuAffinity;
+    std::shared_ptr<C2LookAheadTuning> mLookAhead;
+    std::shared_ptr<C2StreamColorAspectsInfo::input> mColorAspects;
 };
 
 #define ive_api_function  ih264e_api_function
@@ -348,17 +430,92 @@ namespace {
 // From external/libavc/encoder/ih264e_bitstream.h
 constexpr uint32_t MIN_STREAM_SIZE = 0x800;
 
-static size_t GetCPUCoreCount() {
-    long cpuCoreCount = 1;
-#if defined(_SC_NPROCESSORS_ONLN)
-    cpuCoreCount = sysconf(_SC_NPROCESSORS_ONLN);
-#else
-    // _SC_NPROC_ONLN must be defined...
-    cpuCoreCount = sysconf(_SC_NPROC_ONLN);
-#endif
-    CHECK(cpuCoreCount >= 1);
-    ALOGV("Number of CPU cores: %ld", cpuCoreCount);
-    return (size_t)cpuCoreCount;
+/**
+ * Returns the encoder speed preset for an operating point. Background (best effort) encoding,
+ * e.g. of thumbnails, and encoding faster than real time use the faster (and cheaper) presets.
+ */
+static IVE_SPEED_CONFIG GetEncSpeed(float operatingRate, float frameRate, int32_t priority) {
+    if (priority < 0 || operatingRate >= 2 * frameRate) {
+        return IVE_FASTEST;
+    } else if (operatingRate > frameRate) {
+        return IVE_FAST;
+    }
+    return DEFAULT_ENC_SPEED;
+}
+
+// Look-ahead frames whose inter cost is at least this fraction of their intra cost start a new
+// scene, i.e. prediction from the previous frame saves little.
+constexpr float kSceneCutRatio = 0.6f;
+// Minimum distance of look-ahead scene cuts from the previous key frame, in frames.
+constexpr uint32_t kMinSceneCutInterval = 8;
+// Maximum QP is lowered by up to this much for frames that later frames mostly predict from.
+constexpr UWORD32 kMaxQpReduction = 6;
+
+/**
+ * First pass of the look-ahead. Estimates the cost of coding a frame from its luma subsampled by
+ * 2 in both directions: per 16x16 macroblock, the intra cost is the SAD from the block mean and
+ * the inter cost is the SAD from the co-located block of the previous frame (there is no motion
+ * search). |prevLuma| holds the subsampled luma of the previous frame, and is replaced by that
+ * of this frame. |luma| is a scratch buffer that is swapped with |prevLuma|, so that the two
+ * buffers are reused from frame to frame.
+ */
+static void AnalyzeFrame(
+        const C2GraphicView &view, uint32_t width, uint32_t height,
+        std::vector<uint8_t> *prevLuma, std::vector<uint8_t> *luma,
+        uint64_t *intraCost, uint64_t *cost) {
+    *intraCost = 0;
+    *cost = 0;
+    const C2PlanarLayout &layout = view.layout();
+    if (layout.type != C2PlanarLayout::TYPE_YUV
+            || layout.planes[C2PlanarLayout::PLANE_Y].allocatedDepth != 8
+            || view.width() < width || view.height() < height) {
+        // no luma to analyze, e.g. RGB input
+        prevLuma->clear();
+        return;
+    }
+    const C2PlaneInfo &plane = layout.planes[C2PlanarLayout::PLANE_Y];
+    const uint8_t *src = view.data()[C2PlanarLayout::PLANE_Y];
+    uint32_t w = width / 2;
+    uint32_t h = height / 2;
+    luma->resize(w * h);
+    uint8_t *dst = luma->data();
+    for (uint32_t y = 0; y < h; ++y) {
+        const uint8_t *row = src + ptrdiff_t(2 * y) * plane.rowInc;
+        for (uint32_t x = 0; x < w; ++x) {
+            dst[y * w + x] = row[ptrdiff_t(2 * x) * plane.colInc];
+        }
+    }
+    bool hasPrev = (prevLuma->size() == luma->size());
+    for (uint32_t by = 0; by < h; by += 8) {
+        uint32_t bh = std::min(h - by, 8u);
+        for (uint32_t bx = 0; bx < w; bx += 8) {
+            uint32_t bw = std::min(w - bx, 8u);
+            uint32_t sum = 0;
+            for (uint32_t y = by; y < by + bh; ++y) {
+                for (uint32_t x = bx; x < bx + bw; ++x) {
+                    sum += dst[y * w + x];
+                }
+            }
+            int32_t mean = sum / (bw * bh);
+            uint32_t intra = 0;
+            uint32_t inter = 0;
+            for (uint32_t y = by; y < by + bh; ++y) {
+                for (uint32_t x = bx; x < bx + bw; ++x) {
+                    intra += std::abs(dst[y * w + x] - mean);
+                    if (hasPrev) {
+                        inter += std::abs(dst[y * w + x] - (*prevLuma)[y * w + x]);
+                    }
+                }
+            }
+            *intraCost += intra;
+            *cost += hasPrev ? std::min(intra, inter) : intra;
+        }
+    }
+    prevLuma->swap(*luma);
+}
+
+static bool IsSceneCut(uint64_t intraCost, uint64_t cost) {
+    return intraCost > 0 && cost >= kSceneCutRatio * intraCost;
 }
 
 }  // namespace
@@ -395,21 +552,29 @@ c2_status_t C2SoftAvcEnc::onInit() {
 }
 
 c2_status_t C2SoftAvcEnc::onStop() {
+    // the work of held back frames is discarded with the other pending work
+    mLookAheadFrames.clear();
+    mLookAheadLuma.clear();
     return C2_OK;
 }
 
 void C2SoftAvcEnc::onReset() {
     // TODO: use IVE_CMD_CTL_RESET?
+    mLookAheadFrames.clear();
     releaseEncoder();
     initEncParams();
 }
 
 void C2SoftAvcEnc::onRelease() {
+    mLookAheadFrames.clear();
     releaseEncoder();
 }
 
 c2_status_t C2SoftAvcEnc::onFlush_sm() {
     // TODO: use IVE_CMD_CTL_FLUSH?
+    // the work of held back frames is returned as flushed work
+    mLookAheadFrames.clear();
+    mLookAheadLuma.clear();
     return C2_OK;
 }
 
@@ -418,7 +583,7 @@ void  C2SoftAvcEnc::initEncParams() {
     mMemRecords = NULL;
     mNumMemRecords = DEFAULT_MEM_REC_CNT;
     mHeaderGenerated = 0;
-    mNumCores = GetCPUCoreCount();
+    mNumCores = 1;
     mArch = DEFAULT_ARCH;
     mSliceMode = DEFAULT_SLICE_MODE;
     mSliceParam = DEFAULT_SLICE_PARAM;
@@ -435,6 +600,10 @@ void  C2SoftAvcEnc::initEncParams() {
     mReconEnable = DEFAULT_RECON_ENABLE;
     mEntropyMode = DEFAULT_ENTROPY_MODE;
     mBframes = DEFAULT_B_FRAMES;
+    mQpMax = DEFAULT_QP_MAX;
+    mLookAhead = 0;
+    mLookAheadLuma.clear();
+    mFramesSinceSceneCut = 0;
 
     gettimeofday(&mTimeStart, NULL);
     gettimeofday(&mTimeEnd, NULL);
@@ -598,15 +767,15 @@ c2_status_t C2SoftAvcEnc::setQp() {
     s_qp_ip.e_sub_cmd = IVE_CMD_CTL_SET_QP;
 
     s_qp_ip.u4_i_qp = DEFAULT_I_QP;
-    s_qp_ip.u4_i_qp_max = DEFAULT_QP_MAX;
+    s_qp_ip.u4_i_qp_max = mQpMax;
     s_qp_ip.u4_i_qp_min = DEFAULT_QP_MIN;
 
     s_qp_ip.u4_p_qp = DEFAULT_P_QP;
-    s_qp_ip.u4_p_qp_max = DEFAULT_QP_MAX;
+    s_qp_ip.u4_p_qp_max = mQpMax;
     s_qp_ip.u4_p_qp_min = DEFAULT_QP_MIN;
 
     s_qp_ip.u4_b_qp = DEFAULT_P_QP;
-    s_qp_ip.u4_b_qp_max = DEFAULT_QP_MAX;
+    s_qp_ip.u4_b_qp_max = mQpMax;
     s_qp_ip.u4_b_qp_min = DEFAULT_QP_MIN;
 
     s_qp_ip.u4_timestamp_high = -1;
@@ -850,15 +1019,18 @@ c2_status_t C2SoftAvcEnc::initEncoder() {
         mAVCEncLevel = mIntf->getLevel_l();
         mIInterval = mIntf->getSyncFramePeriod_l();
         mIDRInterval = mIntf->getSyncFramePeriod_l();
+        mOperatingRate = mIntf->getOperatingRate_l();
+        mRealTimePriority = mIntf->getRealTimePriority_l();
+        mLookAhead = mIntf->getLookAhead_l();
+        mColorAspects = mIntf->getColorAspects_l();
     }
+    mEncSpeed = GetEncSpeed(
+            mOperatingRate->value, mFrameRate->value, mRealTimePriority->value);
     uint32_t width = mSize->width;
     uint32_t height = mSize->height;
 
     mStride = width;
 
-    // TODO
-    mIvVideoColorFormat = IV_YUV_420P;
-
     ALOGD("Params width %d height %d level %d colorFormat %d", width,
             height, mAVCEncLevel, mIvVideoColorFormat);
 
@@ -1013,6 +1185,7 @@ c2_status_t C2SoftAvcEnc::initEncoder() {
     logVersion();
 
     /* set processor details */
+    mNumCores = getCoreShare();
     setNumCores();
 
     /* Video control Set Frame dimensions */
@@ -1099,10 +1272,81 @@ c2_status_t C2SoftAvcEnc::releaseEncoder() {
     return C2_OK;
 }
 
+c2_status_t C2SoftAvcEnc::copyInput(const C2GraphicView &input, MemoryBlock *block) {
+    uint32_t width = mSize->width;
+    uint32_t height = mSize->height;
+    size_t yPlaneSize = width * height;
+
+    const C2PlanarLayout &layout = input.layout();
+    switch (layout.type) {
+        case C2PlanarLayout::TYPE_RGB:
+            // fall-through
+        case C2PlanarLayout::TYPE_RGBA: {
+            ALOGV("yPlaneSize = %zu", yPlaneSize);
+            // semi-planar formats are interleaved from planar chroma, which takes another
+            // yPlaneSize / 2 bytes
+            bool semiPlanar = (mIvVideoColorFormat != IV_YUV_420P);
+            *block = mConversionBuffers.fetch(semiPlanar ? yPlaneSize * 2 : yPlaneSize * 3 / 2);
+            uint8_t *yPlane = block->data();
+            status_t err = ConvertRGBToPlanarYUV(
+                    yPlane, width, height, block->size(), input,
+                    mColorAspects->matrix, mColorAspects->range);
+            if (err != OK) {
+                ALOGE("RGB to YUV conversion failed: %d", err);
+                return C2_CORRUPTED;
+            }
+            if (semiPlanar) {
+                const uint8_t *uPlane = yPlane + yPlaneSize;
+                const uint8_t *vPlane = uPlane + yPlaneSize / 4;
+                const uint8_t *first = (mIvVideoColorFormat == IV_YUV_420SP_UV) ? uPlane : vPlane;
+                const uint8_t *second = (mIvVideoColorFormat == IV_YUV_420SP_UV) ? vPlane : uPlane;
+                uint8_t *uvPlane = yPlane + yPlaneSize * 3 / 2;
+                for (size_t i = 0; i < yPlaneSize / 4; ++i) {
+                    uvPlane[2 * i] = first[i];
+                    uvPlane[2 * i + 1] = second[i];
+                }
+                memcpy(yPlane + yPlaneSize, uvPlane, yPlaneSize / 2);
+            }
+            return C2_OK;
+        }
+        case C2PlanarLayout::TYPE_YUV: {
+            if (!IsYUV420(input)) {
+                ALOGE("input is not YUV420");
+                return C2_BAD_VALUE;
+            }
+            *block = mConversionBuffers.fetch(yPlaneSize * 3 / 2);
+            MediaImage2 img;
+            if (mIvVideoColorFormat == IV_YUV_420P) {
+                img = CreateYUV420PlanarMediaImage2(width, height, width, height);
+            } else {
+                img = CreateYUV420SemiPlanarMediaImage2(width, height, width, height);
+                if (mIvVideoColorFormat == IV_YUV_420SP_VU) {
+                    std::swap(img.mPlane[img.U].mOffset, img.mPlane[img.V].mOffset);
+                }
+            }
+            status_t err = ImageCopy(block->data(), &img, input);
+            if (err != OK) {
+                ALOGE("Buffer conversion failed: %d", err);
+                return C2_BAD_VALUE;
+            }
+            return C2_OK;
+        }
+
+        case C2PlanarLayout::TYPE_YUVA:
+            ALOGE("YUVA plane type is not supported");
+            return C2_BAD_VALUE;
+
+        default:
+            ALOGE("Unrecognized plane type: %d", layout.type);
+            return C2_BAD_VALUE;
+    }
+}
+
 c2_status_t C2SoftAvcEnc::setEncodeArgs(
         ive_video_encode_ip_t *ps_encode_ip,
         ive_video_encode_op_t *ps_encode_op,
         const C2GraphicView *const input,
+        const MemoryBlock *const inputCopy,
         uint8_t *base,
         uint32_t capacity,
         uint64_t timestamp) {
@@ -1130,29 +1374,6 @@ c2_status_t C2SoftAvcEnc::setEncodeArgs(
     memset(ps_inp_raw_buf, 0, sizeof(iv_raw_buf_t));
     ps_inp_raw_buf->u4_size = sizeof(iv_raw_buf_t);
     ps_inp_raw_buf->e_color_fmt = mIvVideoColorFormat;
-    if (input == nullptr) {
-        if (mSawInputEOS){
-            ps_encode_ip->u4_is_last = 1;
-        }
-        return C2_OK;
-    }
-
-    if (input->width() < mSize->width ||
-        input->height() < mSize->height) {
-        /* Expect width height to be configured */
-        ALOGW("unexpected Capacity Aspect %d(%d) x %d(%d)", input->width(),
-              mSize->width, input->height(), mSize->height);
-        return C2_BAD_VALUE;
-    }
-    ALOGV("width = %d, height = %d", input->width(), input->height());
-    const C2PlanarLayout &layout = input->layout();
-    uint8_t *yPlane = const_cast<uint8_t *>(input->data()[C2PlanarLayout::PLANE_Y]);
-    uint8_t *uPlane = const_cast<uint8_t *>(input->data()[C2PlanarLayout::PLANE_U]);
-    uint8_t *vPlane = const_cast<uint8_t *>(input->data()[C2PlanarLayout::PLANE_V]);
-    int32_t yStride = layout.planes[C2PlanarLayout::PLANE_Y].rowInc;
-    int32_t uStride = layout.planes[C2PlanarLayout::PLANE_U].rowInc;
-    int32_t vStride = layout.planes[C2PlanarLayout::PLANE_V].rowInc;
-
     uint32_t width = mSize->width;
     uint32_t height = mSize->height;
     // width and height are always even (as block size is 16x16)
@@ -1160,61 +1381,86 @@ c2_status_t C2SoftAvcEnc::setEncodeArgs(
     CHECK_EQ((height & 1u), 0u);
     size_t yPlaneSize = width * height;
 
-    switch (layout.type) {
-        case C2PlanarLayout::TYPE_RGB:
-            // fall-through
-        case C2PlanarLayout::TYPE_RGBA: {
-            ALOGV("yPlaneSize = %zu", yPlaneSize);
-            MemoryBlock conversionBuffer = mConversionBuffers.fetch(yPlaneSize * 3 / 2);
-            mConversionBuffersInUse.emplace(conversionBuffer.data(), conversionBuffer);
-            yPlane = conversionBuffer.data();
-            uPlane = yPlane + yPlaneSize;
-            vPlane = uPlane + yPlaneSize / 4;
-            yStride = width;
-            uStride = vStride = yStride / 2;
-            ConvertRGBToPlanarYUV(yPlane, yStride, height, conversionBuffer.size(), *input);
-            break;
+    uint8_t *yPlane = nullptr;
+    uint8_t *uPlane = nullptr;
+    uint8_t *vPlane = nullptr;
+    int32_t yStride = 0;
+    int32_t uStride = 0;
+    int32_t vStride = 0;
+    uint32_t frameWidth = width;
+    uint32_t frameHeight = height;
+    MemoryBlock conversionBuffer;
+    if (inputCopy != nullptr && inputCopy->size() != 0) {
+        conversionBuffer = *inputCopy;
+    } else if (input == nullptr) {
+        if (mSawInputEOS){
+            ps_encode_ip->u4_is_last = 1;
         }
-        case C2PlanarLayout::TYPE_YUV: {
-            if (!IsYUV420(*input)) {
-                ALOGE("input is not YUV420");
-                return C2_BAD_VALUE;
-            }
-
-            if (layout.planes[layout.PLANE_Y].colInc == 1
+        return C2_OK;
+    } else {
+        if (input->width() < mSize->width ||
+            input->height() < mSize->height) {
+            /* Expect width height to be configured */
+            ALOGW("unexpected Capacity Aspect %d(%d) x %d(%d)", input->width(),
+                  mSize->width, input->height(), mSize->height);
+            return C2_BAD_VALUE;
+        }
+        ALOGV("width = %d, height = %d", input->width(), input->height());
+        frameWidth = input->width();
+        frameHeight = input->height();
+        const C2PlanarLayout &layout = input->layout();
+        yPlane = const_cast<uint8_t *>(input->data()[C2PlanarLayout::PLANE_Y]);
+        uPlane = const_cast<uint8_t *>(input->data()[C2PlanarLayout::PLANE_U]);
+        vPlane = const_cast<uint8_t *>(input->data()[C2PlanarLayout::PLANE_V]);
+        yStride = layout.planes[C2PlanarLayout::PLANE_Y].rowInc;
+        uStride = layout.planes[C2PlanarLayout::PLANE_U].rowInc;
+        vStride = layout.planes[C2PlanarLayout::PLANE_V].rowInc;
+
+        bool direct = false;
+        if (layout.type == C2PlanarLayout::TYPE_YUV && IsYUV420(*input)) {
+            if (mIvVideoColorFormat == IV_YUV_420P
+                    && layout.planes[layout.PLANE_Y].colInc == 1
                     && layout.planes[layout.PLANE_U].colInc == 1
                     && layout.planes[layout.PLANE_V].colInc == 1
                     && uStride == vStride
                     && yStride == 2 * vStride) {
                 // I420 compatible - already set up above
-                break;
+                direct = true;
+            } else if (mIvVideoColorFormat == IV_YUV_420SP_UV
+                    && layout.planes[layout.PLANE_Y].colInc == 1
+                    && IsNV12(*input)) {
+                // NV12 - interleaved chroma starts at U
+                direct = true;
+            } else if (mIvVideoColorFormat == IV_YUV_420SP_VU
+                    && layout.planes[layout.PLANE_Y].colInc == 1
+                    && IsNV21(*input)) {
+                // NV21 - interleaved chroma starts at V
+                uPlane = vPlane;
+                uStride = vStride;
+                direct = true;
             }
-
-            // copy to I420
-            yStride = width;
-            uStride = vStride = yStride / 2;
-            MemoryBlock conversionBuffer = mConversionBuffers.fetch(yPlaneSize * 3 / 2);
-            mConversionBuffersInUse.emplace(conversionBuffer.data(), conversionBuffer);
-            MediaImage2 img = CreateYUV420PlanarMediaImage2(width, height, yStride, height);
-            status_t err = ImageCopy(conversionBuffer.data(), &img, *input);
-            if (err != OK) {
-                ALOGE("Buffer conversion failed: %d", err);
-                return C2_BAD_VALUE;
+        }
+        if (!direct) {
+            c2_status_t err = copyInput(*input, &conversionBuffer);
+            if (err != C2_OK) {
+                return err;
             }
-            yPlane = conversionBuffer.data();
-            uPlane = yPlane + yPlaneSize;
-            vPlane = uPlane + yPlaneSize / 4;
-            break;
-
         }
+    }
 
-        case C2PlanarLayout::TYPE_YUVA:
-            ALOGE("YUVA plane type is not supported");
-            return C2_BAD_VALUE;
-
-        default:
-            ALOGE("Unrecognized plane type: %d", layout.type);
-            return C2_BAD_VALUE;
+    if (conversionBuffer.size() != 0) {
+        // packed planes in the input format of the encoder (see copyInput())
+        mConversionBuffersInUse.emplace(conversionBuffer.data(), conversionBuffer);
+        yPlane = conversionBuffer.data();
+        uPlane = yPlane + yPlaneSize;
+        yStride = width;
+        if (mIvVideoColorFormat == IV_YUV_420P) {
+            vPlane = uPlane + yPlaneSize / 4;
+            uStride = vStride = yStride / 2;
+        } else {
+            vPlane = uPlane;
+            uStride = vStride = yStride;
+        }
     }
 
     switch (mIvVideoColorFormat) {
@@ -1225,13 +1471,13 @@ c2_status_t C2SoftAvcEnc::setEncodeArgs(
             ps_inp_raw_buf->apv_bufs[1] = uPlane;
             ps_inp_raw_buf->apv_bufs[2] = vPlane;
 
-            ps_inp_raw_buf->au4_wd[0] = input->width();
-            ps_inp_raw_buf->au4_wd[1] = input->width() / 2;
-            ps_inp_raw_buf->au4_wd[2] = input->width() / 2;
+            ps_inp_raw_buf->au4_wd[0] = frameWidth;
+            ps_inp_raw_buf->au4_wd[1] = frameWidth / 2;
+            ps_inp_raw_buf->au4_wd[2] = frameWidth / 2;
 
-            ps_inp_raw_buf->au4_ht[0] = input->height();
-            ps_inp_raw_buf->au4_ht[1] = input->height() / 2;
-            ps_inp_raw_buf->au4_ht[2] = input->height() / 2;
+            ps_inp_raw_buf->au4_ht[0] = frameHeight;
+            ps_inp_raw_buf->au4_ht[1] = frameHeight / 2;
+            ps_inp_raw_buf->au4_ht[2] = frameHeight / 2;
 
             ps_inp_raw_buf->au4_strd[0] = yStride;
             ps_inp_raw_buf->au4_strd[1] = uStride;
@@ -1256,11 +1502,11 @@ c2_status_t C2SoftAvcEnc::setEncodeArgs(
             ps_inp_raw_buf->apv_bufs[0] = yPlane;
             ps_inp_raw_buf->apv_bufs[1] = uPlane;
 
-            ps_inp_raw_buf->au4_wd[0] = input->width();
-            ps_inp_raw_buf->au4_wd[1] = input->width();
+            ps_inp_raw_buf->au4_wd[0] = frameWidth;
+            ps_inp_raw_buf->au4_wd[1] = frameWidth;
 
-            ps_inp_raw_buf->au4_ht[0] = input->height();
-            ps_inp_raw_buf->au4_ht[1] = input->height() / 2;
+            ps_inp_raw_buf->au4_ht[0] = frameHeight;
+            ps_inp_raw_buf->au4_ht[1] = frameHeight / 2;
 
             ps_inp_raw_buf->au4_strd[0] = yStride;
             ps_inp_raw_buf->au4_strd[1] = uStride;
@@ -1277,11 +1523,33 @@ void C2SoftAvcEnc::process(
     work->workletsProcessed = 0u;
 
     IV_STATUS_T status;
-    WORD32 timeDelay, timeTaken;
     uint64_t timestamp = work->input.ordinal.timestamp.peekull();
 
+    std::shared_ptr<const C2GraphicView> view;
+    std::shared_ptr<C2Buffer> inputBuffer;
+    if (!work->input.buffers.empty()) {
+        inputBuffer = work->input.buffers[0];
+        view = std::make_shared<const C2GraphicView>(
+                inputBuffer->data().graphicBlocks().front().map().get());
+        if (view->error() != C2_OK) {
+            ALOGE("graphic view map err = %d", view->error());
+            return;
+        }
+    }
+
     // Initialize encoder if not already initialized
     if (mCodecCtx == NULL) {
+        // Encode semi-planar input natively if the first frame is semi-planar,
+        // so that camera and surface frames are not repacked to I420.
+        mIvVideoColorFormat = IV_YUV_420P;
+        if (view && view->layout().type == C2PlanarLayout::TYPE_YUV
+                && view->layout().planes[C2PlanarLayout::PLANE_Y].colInc == 1) {
+            if (IsNV12(*view)) {
+                mIvVideoColorFormat = IV_YUV_420SP_UV;
+            } else if (IsNV21(*view)) {
+                mIvVideoColorFormat = IV_YUV_420SP_VU;
+            }
+        }
         if (C2_OK != initEncoder()) {
             ALOGE("Failed to initialize encoder");
             work->workletsProcessed = 1u;
@@ -1293,6 +1561,14 @@ void C2SoftAvcEnc::process(
         return;
     }
 
+    // pick up rebalancing of the process-wide core budget between frames
+    bool coresChanged = false;
+    size_t numCores = getCoreShare(&coresChanged);
+    if (coresChanged && numCores != mNumCores) {
+        mNumCores = numCores;
+        (void)setNumCores();
+    }
+
     // while (!mSawOutputEOS && !outQueue.empty()) {
     c2_status_t error;
     ive_video_encode_ip_t s_encode_ip;
@@ -1302,7 +1578,7 @@ void C2SoftAvcEnc::process(
         constexpr uint32_t kHeaderLength = MIN_STREAM_SIZE;
         uint8_t header[kHeaderLength];
         error = setEncodeArgs(
-                &s_encode_ip, &s_encode_op, NULL, header, kHeaderLength, timestamp);
+                &s_encode_ip, &s_encode_op, NULL, NULL, header, kHeaderLength, timestamp);
         if (error != C2_OK) {
             ALOGE("setEncodeArgs failed: %d", error);
             mSignalledError = true;
@@ -1333,35 +1609,47 @@ void C2SoftAvcEnc::process(
     }
 
     // handle dynamic config parameters
+    std::shared_ptr<C2StreamBitrateInfo::output> frameBitrate;
+    std::shared_ptr<C2StreamIntraRefreshTuning::output> frameIntraRefresh;
+    bool frameRequestSync = false;
     {
         IntfImpl::Lock lock = mIntf->lock();
         std::shared_ptr<C2StreamIntraRefreshTuning::output> intraRefresh = mIntf->getIntraRefresh_l();
         std::shared_ptr<C2StreamBitrateInfo::output> bitrate = mIntf->getBitrate_l();
         std::shared_ptr<C2StreamRequestSyncFrameTuning::output> requestSync = mIntf->getRequestSync_l();
+        std::shared_ptr<C2OperatingRateTuning> operatingRate = mIntf->getOperatingRate_l();
+        std::shared_ptr<C2RealTimePriorityTuning> priority = mIntf->getRealTimePriority_l();
         lock.unlock();
 
-        if (bitrate != mBitrate) {
-            mBitrate = bitrate;
-            setBitRate();
-        }
-
-        if (intraRefresh != mIntraRefresh) {
-            mIntraRefresh = intraRefresh;
-            setAirParams();
+        if (operatingRate != mOperatingRate || priority != mRealTimePriority) {
+            mOperatingRate = operatingRate;
+            mRealTimePriority = priority;
+            IVE_SPEED_CONFIG encSpeed = GetEncSpeed(
+                    mOperatingRate->value, mFrameRate->value, mRealTimePriority->value);
+            if (encSpeed != mEncSpeed) {
+                mEncSpeed = encSpeed;
+                setIpeParams();
+            }
         }
 
+        bool syncRequested = false;
         if (requestSync != mRequestSync) {
-            // we can handle IDR immediately
             if (requestSync->value) {
                 // unset request
                 C2StreamRequestSyncFrameTuning::output clearSync(0u, C2_FALSE);
                 std::vector<std::unique_ptr<C2SettingResult>> failures;
                 mIntf->config({ &clearSync }, C2_MAY_BLOCK, &failures);
                 ALOGV("Got sync request");
-                setFrameType(IV_IDR_FRAME);
+                syncRequested = true;
             }
             mRequestSync = requestSync;
         }
+
+        // Bitrate, intra refresh and sync frame requests apply from this frame on, so they
+        // wait for it to leave the look-ahead window.
+        frameBitrate = bitrate;
+        frameIntraRefresh = intraRefresh;
+        frameRequestSync = syncRequested;
     }
 
     if (work->input.flags & C2FrameData::FLAG_END_OF_STREAM) {
@@ -1378,17 +1666,117 @@ void C2SoftAvcEnc::process(
     //         }
     //     }
     // }
-    std::shared_ptr<const C2GraphicView> view;
-    std::shared_ptr<C2Buffer> inputBuffer;
-    if (!work->input.buffers.empty()) {
-        inputBuffer = work->input.buffers[0];
-        view = std::make_shared<const C2GraphicView>(
-                inputBuffer->data().graphicBlocks().front().map().get());
-        if (view->error() != C2_OK) {
-            ALOGE("graphic view map err = %d", view->error());
+
+    if (mLookAhead == 0) {
+        applyFrameSettings(frameBitrate, frameIntraRefresh, frameRequestSync);
+        encodeFrame(work, view, inputBuffer, MemoryBlock(), timestamp, pool);
+        return;
+    }
+
+    // Hold the frame back until the look-ahead window is full. The end of stream flushes the
+    // window, as there are no further frames to wait for.
+    // The frame is copied, so that the input buffer returns to the client right away. The
+    // client has fewer input buffers than the look-ahead window may hold.
+    LookAheadFrame frame;
+    frame.index = work->input.ordinal.frameIndex.peeku();
+    frame.timestamp = timestamp;
+    frame.intraCost = 0;
+    frame.cost = 0;
+    frame.bitrate = frameBitrate;
+    frame.intraRefresh = frameIntraRefresh;
+    frame.requestSync = frameRequestSync;
+    if (view) {
+        AnalyzeFrame(*view, mSize->width, mSize->height,
+                     &mLookAheadLuma, &mAnalysisLuma, &frame.intraCost, &frame.cost);
+        c2_status_t err = copyInput(*view, &frame.copy);
+        if (err != C2_OK) {
+            mSignalledError = true;
+            work->workletsProcessed = 1u;
+            work->result = err;
             return;
         }
     }
+    mLookAheadFrames.push_back(std::move(frame));
+    bool eos = (work->input.flags & C2FrameData::FLAG_END_OF_STREAM) != 0;
+    while (!mSignalledError && !mLookAheadFrames.empty()
+            && (mLookAheadFrames.size() > mLookAhead || eos)) {
+        encodeLookAheadFrame(work, pool);
+    }
+}
+
+void C2SoftAvcEnc::applyFrameSettings(
+        const std::shared_ptr<C2StreamBitrateInfo::output> &bitrate,
+        const std::shared_ptr<C2StreamIntraRefreshTuning::output> &intraRefresh,
+        bool requestSync) {
+    if (bitrate != mBitrate) {
+        mBitrate = bitrate;
+        setBitRate();
+    }
+
+    if (intraRefresh != mIntraRefresh) {
+        mIntraRefresh = intraRefresh;
+        setAirParams();
+    }
+
+    if (requestSync) {
+        setFrameType(IV_IDR_FRAME);
+        mFramesSinceSceneCut = 0;
+    }
+}
+
+void C2SoftAvcEnc::encodeLookAheadFrame(
+        const std::unique_ptr<C2Work> &work,
+        const std::shared_ptr<C2BlockPool> &pool) {
+    LookAheadFrame frame = std::move(mLookAheadFrames.front());
+    mLookAheadFrames.pop_front();
+    applyFrameSettings(frame.bitrate, frame.intraRefresh, frame.requestSync);
+
+    // Start a new GOP at scene changes, unless one was started recently.
+    if (IsSceneCut(frame.intraCost, frame.cost)
+            && mFramesSinceSceneCut >= kMinSceneCutInterval) {
+        ALOGV("scene change at frame #%llu", (unsigned long long)frame.index);
+        setFrameType(IV_IDR_FRAME);
+        mFramesSinceSceneCut = 0;
+    }
+    ++mFramesSinceSceneCut;
+
+    // Frames that the rest of the window (up to the next scene change) predicts well from are
+    // references to many frames, so cap their QP lower. Rate control makes up for the bits.
+    float predicted = 0.f;
+    for (const LookAheadFrame &next : mLookAheadFrames) {
+        if (next.intraCost == 0 || IsSceneCut(next.intraCost, next.cost)) {
+            break;
+        }
+        predicted += 1.f - float(next.cost) / next.intraCost;
+    }
+    UWORD32 qpMax = DEFAULT_QP_MAX - UWORD32(kMaxQpReduction * predicted / mLookAhead + 0.5f);
+    if (qpMax != mQpMax) {
+        mQpMax = qpMax;
+        (void)setQp();
+    }
+
+    auto fillWork = [this, &frame, &pool](const std::unique_ptr<C2Work> &work) {
+        encodeFrame(work, nullptr, nullptr, frame.copy, frame.timestamp, pool);
+    };
+    if (work && c2_cntr64_t(frame.index) == work->input.ordinal.frameIndex) {
+        fillWork(work);
+    } else {
+        finish(frame.index, fillWork);
+    }
+}
+
+void C2SoftAvcEnc::encodeFrame(
+        const std::unique_ptr<C2Work> &work,
+        const std::shared_ptr<const C2GraphicView> &view,
+        const std::shared_ptr<C2Buffer> &inputBuffer,
+        const MemoryBlock &inputCopy,
+        uint64_t timestamp,
+        const std::shared_ptr<C2BlockPool> &pool) {
+    IV_STATUS_T status;
+    WORD32 timeDelay, timeTaken;
+    c2_status_t error;
+    ive_video_encode_ip_t s_encode_ip;
+    ive_video_encode_op_t s_encode_op;
 
     std::shared_ptr<C2LinearBlock> block;
 
@@ -1411,7 +1799,8 @@ void C2SoftAvcEnc::process(
         }
 
         error = setEncodeArgs(
-                &s_encode_ip, &s_encode_op, view.get(), wView.base(), wView.capacity(), timestamp);
+                &s_encode_ip, &s_encode_op, view.get(), &inputCopy,
+                wView.base(), wView.capacity(), timestamp);
         if (error != C2_OK) {
             mSignalledError = true;
             ALOGE("setEncodeArgs failed : %d", error);
@@ -1460,7 +1849,7 @@ void C2SoftAvcEnc::process(
     void *freed = s_encode_op.s_inp_buf.apv_bufs[0];
     /* If encoder frees up an input buffer, mark it as free */
     if (freed != NULL) {
-        if (mBuffers.count(freed) == 0u) {
+        if (mBuffers.count(freed) == 0u && mConversionBuffersInUse.count(freed) == 0u) {
             ALOGD("buffer not tracked");
         } else {
             // Release input buffer reference
@@ -1499,8 +1888,13 @@ c2_status_t C2SoftAvcEnc::drain(
         uint32_t drainMode,
         const std::shared_ptr<C2BlockPool> &pool) {
     // TODO: use IVE_CMD_CTL_FLUSH?
-    (void)drainMode;
-    (void)pool;
+    if (drainMode == NO_DRAIN) {
+        return C2_OK;
+    }
+    // encode the frames held back for look-ahead
+    while (!mSignalledError && !mLookAheadFrames.empty()) {
+        encodeLookAheadFrame(nullptr, pool);
+    }
     return C2_OK;
 }
 
@@ -17,7 +17,9 @@
 #ifndef ANDROID_C2_SOFT_AVC_ENC_H__
 #define ANDROID_C2_SOFT_AVC_ENC_H__
 
+#include <list>
 #include <map>
+#include <vector>
 
 #include <utils/Vector.h>
 
@@ -98,6 +100,7 @@ namespace android {
 #define DEFAULT_INTRA4x4            0
 #define STRLENGTH                   500
 #define DEFAULT_CONSTRAINED_INTRA   0
+#define MAX_LOOK_AHEAD_FRAMES       16
 
 #define MIN(a, b) ((a) < (b))? (a) : (b)
 #define MAX(a, b) ((a) > (b))? (a) : (b)
@@ -190,6 +193,9 @@ private:
     std::shared_ptr<C2StreamFrameRateInfo::output> mFrameRate;
     std::shared_ptr<C2StreamBitrateInfo::output> mBitrate;
     std::shared_ptr<C2StreamRequestSyncFrameTuning::output> mRequestSync;
+    std::shared_ptr<C2OperatingRateTuning> mOperatingRate;
+    std::shared_ptr<C2RealTimePriorityTuning> mRealTimePriority;
+    std::shared_ptr<C2StreamColorAspectsInfo::input> mColorAspects;
 
     uint32_t mOutBufferSize;
     UWORD32 mHeaderGenerated;
@@ -204,6 +210,25 @@ private:
     std::map<const void *, std::shared_ptr<C2Buffer>> mBuffers;
     MemoryBlockPool mConversionBuffers;
     std::map<const void *, MemoryBlock> mConversionBuffersInUse;
+    UWORD32 mQpMax;
+
+    // Input frame held back for look-ahead (C2LookAheadTuning), with its first pass estimates.
+    struct LookAheadFrame {
+        uint64_t index;         // frame index of the work
+        uint64_t timestamp;
+        MemoryBlock copy;       // copy of the frame (see copyInput()), empty at end of stream
+        uint64_t intraCost;     // estimated cost of intra coding
+        uint64_t cost;          // estimated cost, predicting from the previous frame if cheaper
+        // settings in effect when the frame was queued; applied when it is encoded
+        std::shared_ptr<C2StreamBitrateInfo::output> bitrate;
+        std::shared_ptr<C2StreamIntraRefreshTuning::output> intraRefresh;
+        bool requestSync;
+    };
+    uint32_t mLookAhead;        // number of frames held back, 0 if look-ahead is disabled
+    std::list<LookAheadFrame> mLookAheadFrames;
+    std::vector<uint8_t> mLookAheadLuma; // subsampled luma of the last analyzed frame
+    std::vector<uint8_t> mAnalysisLuma;  // scratch buffer of the look-ahead analysis
+    uint32_t mFramesSinceSceneCut;
 
     void initEncParams();
     c2_status_t initEncoder();
@@ -224,10 +249,33 @@ private:
     c2_status_t setDeblockParams();
     c2_status_t setVbvParams();
     void logVersion();
+    // Applies the settings that take effect from the next encoded frame.
+    void applyFrameSettings(
+            const std::shared_ptr<C2StreamBitrateInfo::output> &bitrate,
+            const std::shared_ptr<C2StreamIntraRefreshTuning::output> &intraRefresh,
+            bool requestSync);
+    // Encodes the oldest look-ahead frame, and finishes its work.
+    void encodeLookAheadFrame(
+            const std::unique_ptr<C2Work> &work,
+            const std::shared_ptr<C2BlockPool> &pool);
+    // Encodes a frame (or flushes the encoder at the end of stream if both |view| and
+    // |inputCopy| are empty) into the output of |work|. |inputCopy| is a frame copied by
+    // copyInput(), and is used if |view| is null.
+    void encodeFrame(
+            const std::unique_ptr<C2Work> &work,
+            const std::shared_ptr<const C2GraphicView> &view,
+            const std::shared_ptr<C2Buffer> &inputBuffer,
+            const MemoryBlock &inputCopy,
+            uint64_t timestamp,
+            const std::shared_ptr<C2BlockPool> &pool);
+    // Copies |input| into a block from mConversionBuffers, in the input format of the encoder
+    // with packed planes.
+    c2_status_t copyInput(const C2GraphicView &input, MemoryBlock *block);
     c2_status_t setEncodeArgs(
             ive_video_encode_ip_t *ps_encode_ip,
             ive_video_encode_op_t *ps_encode_op,
             const C2GraphicView *const input,
+            const MemoryBlock *const inputCopy,
             uint8_t *base,
             uint32_t capacity,
             uint64_t timestamp);
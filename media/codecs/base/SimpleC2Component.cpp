@@ -21,15 +21,93 @@
 #include <cutils/properties.h>
 #include <media/stagefright/foundation/AMessage.h>
 
+#include <errno.h>
 #include <inttypes.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include <C2Config.h>
 #include <C2Debug.h>
 #include <C2PlatformSupport.h>
 #include <SimpleC2Component.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <mutex>
+
 namespace android {
 
+namespace {
+
+/**
+ * Process-wide budget of the CPU cores used by the codec libraries of running components.
+ *
+ * Each running component that uses worker threads gets a share of the online CPUs in
+ * proportion to its weight, so that concurrent sessions do not oversubscribe the CPUs with
+ * worker threads. Every change of the set bumps the generation, which lets components pick up
+ * their new share cheaply.
+ */
+class CoreBudget {
+public:
+    static CoreBudget &Get() {
+        // leaked so that components released during process exit can still leave the budget
+        static CoreBudget *sInstance = new CoreBudget;
+        return *sInstance;
+    }
+
+    void join(const void *component, float weight) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mWeights[component] = weight;
+        ++mGeneration;
+    }
+
+    void leave(const void *component) {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mWeights.erase(component) > 0) {
+            ++mGeneration;
+        }
+    }
+
+    /**
+     * Returns the share of |component|, at most |maxCores| and at least 1. Components that are
+     * not running are not limited by the budget.
+     */
+    size_t share(const void *component, size_t maxCores) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mWeights.find(component);
+        if (it == mWeights.end()) {
+            return std::max(maxCores, (size_t)1);
+        }
+        float totalWeight = 0.f;
+        for (const std::pair<const void * const, float> &entry : mWeights) {
+            totalWeight += entry.second;
+        }
+        size_t share = (size_t)std::lround(mNumCpus * it->second / totalWeight);
+        return std::max(std::min(share, maxCores), (size_t)1);
+    }
+
+    uint32_t generation() const {
+        return mGeneration.load(std::memory_order_relaxed);
+    }
+
+private:
+    CoreBudget() : mNumCpus(1), mGeneration(0) {
+        long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (numCpus > 1) {
+            mNumCpus = (size_t)numCpus;
+        }
+    }
+
+    size_t mNumCpus;
+    std::mutex mLock;
+    std::map<const void *, float> mWeights;
+    std::atomic<uint32_t> mGeneration;
+};
+
+}  // namespace
+
 std::unique_ptr<C2Work> SimpleC2Component::WorkQueue::pop_front() {
     std::unique_ptr<C2Work> work = std::move(mQueue.front().work);
     mQueue.pop_front();
@@ -100,27 +178,36 @@ void SimpleC2Component::WorkHandler::onMessageReceived(const sp<AMessage> &msg)
             break;
         }
         case kWhatInit: {
+            thiz->applyCpuAffinity();
+            thiz->leaveCoreBudget();
             int32_t err = thiz->onInit();
             Reply(msg, &err);
             // fall-through
         }
         case kWhatStart: {
+            if (msg->what() == kWhatStart) {
+                thiz->applyCpuAffinity();
+                thiz->leaveCoreBudget();
+            }
             mRunning = true;
             break;
         }
         case kWhatStop: {
             int32_t err = thiz->onStop();
+            thiz->leaveCoreBudget();
             Reply(msg, &err);
             break;
         }
         case kWhatReset: {
             thiz->onReset();
+            thiz->leaveCoreBudget();
             mRunning = false;
             Reply(msg);
             break;
         }
         case kWhatRelease: {
             thiz->onRelease();
+            thiz->leaveCoreBudget();
             mRunning = false;
             Reply(msg);
             break;
@@ -147,7 +234,13 @@ SimpleC2Component::SimpleC2Component(
     : mDummyReadView(DummyReadView()),
       mIntf(intf),
       mLooper(new ALooper),
-      mHandler(new WorkHandler) {
+      mHandler(new WorkHandler),
+      mCpuAffinitySet(false),
+      mCoreBudgetGeneration(0),
+      mCoreShare(0),
+      mSingleCore(false),
+      mInCoreBudget(false) {
+    CPU_ZERO(&mDefaultCpuSet);
     mLooper->setName(intf->getName().c_str());
     (void)mLooper->registerHandler(mHandler);
     mLooper->start(false, false, ANDROID_PRIORITY_VIDEO);
@@ -156,6 +249,7 @@ SimpleC2Component::SimpleC2Component(
 SimpleC2Component::~SimpleC2Component() {
     mLooper->unregisterHandler(mHandler->id());
     (void)mLooper->stop();
+    CoreBudget::Get().leave(this);
 }
 
 c2_status_t SimpleC2Component::setListener_vb(
@@ -515,14 +609,143 @@ bool SimpleC2Component::processQueue() {
     return hasQueuedWork;
 }
 
+void SimpleC2Component::applyCpuAffinity() {
+    std::vector<std::unique_ptr<C2Param>> params;
+    c2_status_t err = mIntf->query_vb(
+            {}, { C2CpuAffinityTuning::PARAM_TYPE }, C2_DONT_BLOCK, &params);
+    if (err != C2_OK || params.size() != 1u || !params[0]) {
+        return;
+    }
+    C2CpuAffinityTuning *affinity = C2CpuAffinityTuning::From(params[0].get());
+    if (!affinity) {
+        return;
+    }
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (size_t i = 0; i < affinity->flexCount(); ++i) {
+        if (affinity->m.values[i] < CPU_SETSIZE) {
+            CPU_SET(affinity->m.values[i], &cpuSet);
+        }
+    }
+    if (!mCpuAffinitySet) {
+        if (CPU_COUNT(&cpuSet) == 0) {
+            return;
+        }
+        // remember the original placement in case affinity is cleared later
+        if (sched_getaffinity(0, sizeof(mDefaultCpuSet), &mDefaultCpuSet) != 0) {
+            ALOGD("sched_getaffinity failed: %d", errno);
+            return;
+        }
+    }
+    if (CPU_COUNT(&cpuSet) == 0) {
+        cpuSet = mDefaultCpuSet;
+    } else {
+        CPU_AND(&cpuSet, &cpuSet, &mDefaultCpuSet);
+        if (CPU_COUNT(&cpuSet) == 0) {
+            ALOGW("none of the requested CPUs are available; ignoring CPU affinity");
+            cpuSet = mDefaultCpuSet;
+        }
+    }
+    if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+        ALOGD("sched_setaffinity failed: %d", errno);
+        return;
+    }
+    mCpuAffinitySet = true;
+    ALOGV("running on %d CPU(s)", CPU_COUNT(&cpuSet));
+}
+
+size_t SimpleC2Component::getCpuCoreCount() const {
+    cpu_set_t cpuSet;
+    if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0 && CPU_COUNT(&cpuSet) > 0) {
+        return (size_t)CPU_COUNT(&cpuSet);
+    }
+    long cpuCoreCount = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpuCoreCount >= 1 ? (size_t)cpuCoreCount : 1u;
+}
+
+void SimpleC2Component::joinCoreBudget() {
+    // Components that must keep up with their operating rate weigh more than those running
+    // at a lower operating point, and components with a higher operating rate more than
+    // those with a lower one.
+    float weight = 1.f;
+    mSingleCore = false;
+    std::vector<std::unique_ptr<C2Param>> params;
+    // Only some video decoders declare C2KeyFrameOnlyDecodingTuning; parameters that the
+    // component does not declare are not returned (C2_BAD_INDEX), so the result is ignored.
+    (void)mIntf->query_vb(
+            {}, { C2RealTimePriorityTuning::PARAM_TYPE, C2OperatingRateTuning::PARAM_TYPE,
+                  C2KeyFrameOnlyDecodingTuning::PARAM_TYPE },
+            C2_DONT_BLOCK, &params);
+    for (const std::unique_ptr<C2Param> &param : params) {
+        if (!param) {
+            continue;
+        }
+        if (C2KeyFrameOnlyDecodingTuning *keyFrameOnly =
+                C2KeyFrameOnlyDecodingTuning::From(param.get())) {
+            mSingleCore = (keyFrameOnly->value == C2_TRUE);
+        } else if (C2RealTimePriorityTuning *priority =
+                C2RealTimePriorityTuning::From(param.get())) {
+            if (priority->value < 0) {
+                weight /= 1.f - priority->value;
+            }
+        } else if (C2OperatingRateTuning *rate = C2OperatingRateTuning::From(param.get())) {
+            if (rate->value > 0.f) {
+                weight *= c2_clamp(0.5f, rate->value / 30.f, 4.f);
+            }
+        }
+    }
+    if (mSingleCore) {
+        // key frame only decoding runs single threaded; leave the cores to the others
+        CoreBudget::Get().leave(this);
+        return;
+    }
+    CoreBudget::Get().join(this, weight);
+}
+
+void SimpleC2Component::leaveCoreBudget() {
+    CoreBudget::Get().leave(this);
+    mInCoreBudget = false;
+}
+
+size_t SimpleC2Component::getCoreShare(bool *changed) {
+    // Components join the budget only once they ask for their share, so that those that do
+    // not use worker threads (e.g. audio codecs) do not take cores from those that do.
+    if (!mInCoreBudget) {
+        mInCoreBudget = true;
+        joinCoreBudget();
+    }
+    if (mSingleCore) {
+        if (changed) {
+            *changed = false;
+        }
+        return 1u;
+    }
+    uint32_t generation = CoreBudget::Get().generation();
+    if (mCoreShare == 0 || generation != mCoreBudgetGeneration) {
+        mCoreBudgetGeneration = generation;
+        size_t share = CoreBudget::Get().share(this, getCpuCoreCount());
+        if (changed) {
+            *changed = (share != mCoreShare);
+        }
+        ALOGV("core share %zu -> %zu", mCoreShare, share);
+        mCoreShare = share;
+    } else if (changed) {
+        *changed = false;
+    }
+    return mCoreShare;
+}
+
 std::shared_ptr<C2Buffer> SimpleC2Component::createLinearBuffer(
         const std::shared_ptr<C2LinearBlock> &block) {
-    return createLinearBuffer(block, block->offset(), block->size());
+    return createLinearBuffer(block, 0, block->size());
 }
 
 std::shared_ptr<C2Buffer> SimpleC2Component::createLinearBuffer(
         const std::shared_ptr<C2LinearBlock> &block, size_t offset, size_t size) {
-    return C2Buffer::CreateLinearBuffer(block->share(offset, size, ::C2Fence()));
+    // |offset| is relative to the block, which may not start at the beginning of its allocation
+    return C2Buffer::CreateLinearBuffer(
+            block->share(block->offset() + offset, size, ::C2Fence()));
 }
 
 std::shared_ptr<C2Buffer> SimpleC2Component::createGraphicBuffer(
@@ -176,6 +176,35 @@ SimpleInterface<void>::BaseParams::BaseParams(
             .withSetter(Setter<C2SubscribedParamIndicesTuning>::NonStrictValuesWithNoDeps)
             .build());
 
+    addParameter(
+            DefineParam(mCpuAffinity, C2_PARAMKEY_CPU_AFFINITY)
+            .withDefault(C2CpuAffinityTuning::AllocShared(0u))
+            .withFields({ C2F(mCpuAffinity, m.values[0]).any(),
+                          C2F(mCpuAffinity, m.values).any() })
+            .withSetter(Setter<C2CpuAffinityTuning>::NonStrictValuesWithNoDeps)
+            .build());
+
+    addParameter(
+            DefineParam(mLowLatencyMode, C2_PARAMKEY_LOW_LATENCY_MODE)
+            .withDefault(new C2LowLatencyModeTuning(C2_FALSE))
+            .withFields({ C2F(mLowLatencyMode, value).oneOf({ C2_FALSE, C2_TRUE }) })
+            .withSetter(Setter<decltype(*mLowLatencyMode)>::NonStrictValueWithNoDeps)
+            .build());
+
+    addParameter(
+            DefineParam(mOperatingRate, C2_PARAMKEY_OPERATING_RATE)
+            .withDefault(new C2OperatingRateTuning(0.))
+            .withFields({ C2F(mOperatingRate, value).any() })
+            .withSetter(Setter<decltype(*mOperatingRate)>::NonStrictValueWithNoDeps)
+            .build());
+
+    addParameter(
+            DefineParam(mRealTimePriority, C2_PARAMKEY_PRIORITY)
+            .withDefault(new C2RealTimePriorityTuning(0))
+            .withFields({ C2F(mRealTimePriority, value).any() })
+            .withSetter(Setter<decltype(*mRealTimePriority)>::NonStrictValueWithNoDeps)
+            .build());
+
     /* TODO
 
     addParameter(
@@ -17,6 +17,8 @@
 #ifndef SIMPLE_C2_COMPONENT_H_
 #define SIMPLE_C2_COMPONENT_H_
 
+#include <sched.h>
+
 #include <list>
 #include <unordered_map>
 
@@ -134,11 +136,50 @@ protected:
             const std::shared_ptr<C2GraphicBlock> &block,
             const C2Rect &crop);
 
+    /**
+     * Returns the number of CPUs the calling thread may run on. When called from onInit() or
+     * process(), this honors the CPU affinity requested via C2CpuAffinityTuning, and is the
+     * number of threads codec libraries should use.
+     */
+    size_t getCpuCoreCount() const;
+
+    /**
+     * Returns the number of threads the codec library should use: the share of this component
+     * of the CPU cores budgeted to all running components in the process, within
+     * getCpuCoreCount(). Shares are rebalanced as components start and stop, and are weighted
+     * by C2RealTimePriorityTuning and C2OperatingRateTuning. A component joins the budget on
+     * its first call after it is started, so components that never call this do not take a
+     * share. Video decoders in key frame only mode (C2KeyFrameOnlyDecodingTuning) do not take
+     * part in the budget and always get 1.
+     *
+     * Call this from onInit(), and from process() to pick up rebalancing.
+     *
+     * \param[out] changed   if not null, set to whether the share changed since the last call.
+     */
+    size_t getCoreShare(bool *changed = nullptr);
+
     static constexpr uint32_t NO_DRAIN = ~0u;
 
     C2ReadView mDummyReadView;
 
 private:
+    /**
+     * Pins the calling (work handler) thread to the CPUs requested via C2CpuAffinityTuning.
+     * Threads subsequently created by the codec library inherit this affinity.
+     */
+    void applyCpuAffinity();
+
+    /**
+     * Adds this component to the process-wide core budget (or updates its weight).
+     */
+    void joinCoreBudget();
+
+    /**
+     * Removes this component from the process-wide core budget. It joins again on its next
+     * getCoreShare() call, with its weight at that time.
+     */
+    void leaveCoreBudget();
+
     const std::shared_ptr<C2ComponentInterface> mIntf;
 
     class WorkHandler : public AHandler {
@@ -218,6 +259,14 @@ private:
 
     std::shared_ptr<C2BlockPool> mOutputBlockPool;
 
+    // accessed only on the work handler thread
+    bool mCpuAffinitySet;
+    cpu_set_t mDefaultCpuSet;
+    uint32_t mCoreBudgetGeneration;
+    size_t mCoreShare;
+    bool mSingleCore;
+    bool mInCoreBudget;
+
     SimpleC2Component() = delete;
 };
 
@@ -159,6 +159,10 @@ public:
         std::shared_ptr<C2PortStreamCountTuning::output> mOutputStreamCount;
 
         std::shared_ptr<C2SubscribedParamIndicesTuning> mSubscribedParamIndices;
+        std::shared_ptr<C2CpuAffinityTuning> mCpuAffinity;
+        std::shared_ptr<C2LowLatencyModeTuning> mLowLatencyMode;
+        std::shared_ptr<C2OperatingRateTuning> mOperatingRate;
+        std::shared_ptr<C2RealTimePriorityTuning> mRealTimePriority;
         std::shared_ptr<C2PortSuggestedBufferCountTuning::input> mSuggestedInputBufferCount;
         std::shared_ptr<C2PortSuggestedBufferCountTuning::output> mSuggestedOutputBufferCount;
 
@@ -22,6 +22,7 @@
 
 #include <C2Debug.h>
 #include <C2PlatformSupport.h>
+#include <Codec2BufferUtils.h>
 #include <Codec2Mapper.h>
 #include <SimpleC2Interface.h>
 
@@ -179,6 +180,24 @@ public:
                 .withSetter(ColorAspectsSetter, mDefaultColorAspects, mCodedColorAspects)
                 .build());
 
+        // 0x0 (default) outputs pictures at their decoded size
+        addParameter(
+                DefineParam(mScaledSize, C2_PARAMKEY_SCALED_PICTURE_SIZE)
+                .withDefault(new C2StreamScaledPictureSizeTuning::output(0u, 0, 0))
+                .withFields({
+                    C2F(mScaledSize, width).inRange(0, 4096, 2),
+                    C2F(mScaledSize, height).inRange(0, 4096, 2),
+                })
+                .withSetter(ScaledSizeSetter)
+                .build());
+
+        addParameter(
+                DefineParam(mKeyFrameOnly, C2_PARAMKEY_KEY_FRAME_ONLY_DECODING)
+                .withDefault(new C2KeyFrameOnlyDecodingTuning(C2_FALSE))
+                .withFields({ C2F(mKeyFrameOnly, value).oneOf({ C2_FALSE, C2_TRUE }) })
+                .withSetter(Setter<decltype(*mKeyFrameOnly)>::NonStrictValueWithNoDeps)
+                .build());
+
         // TODO: support more formats?
         addParameter(
                 DefineParam(mPixelFormat, C2_PARAMKEY_PIXEL_FORMAT)
@@ -275,10 +294,25 @@ public:
         return C2R::Ok();
     }
 
+    static C2R ScaledSizeSetter(
+            bool mayBlock, C2P<C2StreamScaledPictureSizeTuning::output> &me) {
+        (void)mayBlock;
+        // round down to even sizes for 4:2:0 chroma
+        me.set().width = c2_min(me.v.width, 4096u) & ~1u;
+        me.set().height = c2_min(me.v.height, 4096u) & ~1u;
+        return C2R::Ok();
+    }
+
     std::shared_ptr<C2StreamColorAspectsInfo::output> getColorAspects_l() {
         return mColorAspects;
     }
 
+    std::shared_ptr<C2StreamScaledPictureSizeTuning::output> getScaledSize_l() {
+        return mScaledSize;
+    }
+
+    bool getKeyFrameOnly_l() const { return mKeyFrameOnly->value == C2_TRUE; }
+
 private:
     std::shared_ptr<C2StreamProfileLevelInfo::input> mProfileLevel;
     std::shared_ptr<C2StreamPictureSizeInfo::output> mSize;
@@ -289,21 +323,10 @@ private:
     std::shared_ptr<C2StreamColorAspectsTuning::output> mDefaultColorAspects;
     std::shared_ptr<C2StreamColorAspectsInfo::output> mColorAspects;
     std::shared_ptr<C2StreamPixelFormatInfo::output> mPixelFormat;
+    std::shared_ptr<C2StreamScaledPictureSizeTuning::output> mScaledSize;
+    std::shared_ptr<C2KeyFrameOnlyDecodingTuning> mKeyFrameOnly;
 };
 
-static size_t getCpuCoreCount() {
-    long cpuCoreCount = 1;
-#if defined(_SC_NPROCESSORS_ONLN)
-    cpuCoreCount = sysconf(_SC_NPROCESSORS_ONLN);
-#else
-    // _SC_NPROC_ONLN must be defined...
-    cpuCoreCount = sysconf(_SC_NPROC_ONLN);
-#endif
-    CHECK(cpuCoreCount >= 1);
-    ALOGV("Number of CPU cores: %ld", cpuCoreCount);
-    return (size_t)cpuCoreCount;
-}
-
 static void *ivd_aligned_malloc(void *ctxt, WORD32 alignment, WORD32 size) {
     (void) ctxt;
     return memalign(alignment, size);
@@ -322,9 +345,16 @@ C2SoftHevcDec::C2SoftHevcDec(
         mIntf(intfImpl),
         mDecHandle(nullptr),
         mOutBufferFlush(nullptr),
+        mOutBufferScale(nullptr),
+        mOutBufferScaleSize(0),
+        mScaledWidth(0),
+        mScaledHeight(0),
+        mOutputWidth(320),
+        mOutputHeight(240),
         mIvColorformat(IV_YUV_420P),
         mWidth(320),
-        mHeight(240) {
+        mHeight(240),
+        mDegrade(false) {
 }
 
 C2SoftHevcDec::~C2SoftHevcDec() {
@@ -352,6 +382,11 @@ void C2SoftHevcDec::onRelease() {
         ivd_aligned_free(nullptr, mOutBufferFlush);
         mOutBufferFlush = nullptr;
     }
+    if (mOutBufferScale) {
+        ivd_aligned_free(nullptr, mOutBufferScale);
+        mOutBufferScale = nullptr;
+        mOutBufferScaleSize = 0;
+    }
     if (mOutBlock) {
         mOutBlock.reset();
     }
@@ -393,6 +428,9 @@ status_t C2SoftHevcDec::createDecoder() {
 
     s_create_ip.s_ivd_create_ip_t.u4_size = sizeof(ivdext_create_ip_t);
     s_create_ip.s_ivd_create_ip_t.e_cmd = IVD_CMD_CREATE;
+    // Display buffers are not shared with the decoder: the library only shares 420SP buffers
+    // with its own padded stride, and decoded pictures stay references after they are output,
+    // which blocks from a surface-backed output pool cannot be.
     s_create_ip.s_ivd_create_ip_t.u4_share_disp_buf = 0;
     s_create_ip.s_ivd_create_ip_t.e_output_format = mIvColorformat;
     s_create_ip.s_ivd_create_ip_t.pf_aligned_alloc = ivd_aligned_malloc;
@@ -437,13 +475,23 @@ status_t C2SoftHevcDec::setNumCores() {
 status_t C2SoftHevcDec::setParams(size_t stride) {
     ivd_ctl_set_config_ip_t s_set_dyn_params_ip;
     ivd_ctl_set_config_op_t s_set_dyn_params_op;
+    bool lowLatency;
+    bool keyFrameOnly;
+    {
+        IntfImpl::Lock lock = mIntf->lock();
+        lowLatency = (mIntf->mLowLatencyMode->value == C2_TRUE);
+        keyFrameOnly = mIntf->getKeyFrameOnly_l();
+    }
 
     s_set_dyn_params_ip.u4_size = sizeof(ivd_ctl_set_config_ip_t);
     s_set_dyn_params_ip.e_cmd = IVD_CMD_VIDEO_CTL;
     s_set_dyn_params_ip.e_sub_cmd = IVD_CMD_CTL_SETPARAMS;
     s_set_dyn_params_ip.u4_disp_wd = (UWORD32) stride;
-    s_set_dyn_params_ip.e_frm_skip_mode = IVD_SKIP_NONE;
-    s_set_dyn_params_ip.e_frm_out_mode = IVD_DISPLAY_FRAME_OUT;
+    // in key frame only mode, skip P and B frames so that only I frames are decoded
+    s_set_dyn_params_ip.e_frm_skip_mode = keyFrameOnly ? IVD_SKIP_PB : IVD_SKIP_NONE;
+    // in low latency and key frame only modes, output each frame as soon as it is decoded
+    s_set_dyn_params_ip.e_frm_out_mode =
+        (lowLatency || keyFrameOnly) ? IVD_DECODE_FRAME_OUT : IVD_DISPLAY_FRAME_OUT;
     s_set_dyn_params_ip.e_vid_dec_mode = IVD_DECODE_FRAME;
     s_set_dyn_params_op.u4_size = sizeof(ivd_ctl_set_config_op_t);
     IV_API_CALL_STATUS_T status = ivdec_api_function(mDecHandle,
@@ -482,13 +530,54 @@ status_t C2SoftHevcDec::getVersion() {
     return OK;
 }
 
+bool C2SoftHevcDec::shouldDegrade() {
+    // Decoding in the background (e.g. for thumbnails) is best effort, so trade some quality
+    // for speed and power there.
+    IntfImpl::Lock lock = mIntf->lock();
+    return mIntf->mRealTimePriority->value < 0;
+}
+
+status_t C2SoftHevcDec::setDegrade() {
+    ihevcd_cxa_ctl_degrade_ip_t s_degrade_ip;
+    ihevcd_cxa_ctl_degrade_op_t s_degrade_op;
+
+    s_degrade_ip.u4_size = sizeof(ihevcd_cxa_ctl_degrade_ip_t);
+    s_degrade_ip.e_cmd = IVD_CMD_VIDEO_CTL;
+    s_degrade_ip.e_sub_cmd = (IVD_CONTROL_API_COMMAND_TYPE_T) IHEVCD_CXA_CMD_CTL_DEGRADE;
+    // Skip SAO and deblocking, but only on non-reference pictures, so that errors do not
+    // propagate to other pictures.
+    s_degrade_ip.i4_degrade_type = mDegrade ? (DEGRADE_TYPE_SAO | DEGRADE_TYPE_DEBLOCKING) : 0;
+    s_degrade_ip.i4_nondegrade_interval = 0;
+    s_degrade_ip.i4_degrade_pics = mDegrade ? DEGRADE_PICS_NON_REF : 0;
+    s_degrade_op.u4_size = sizeof(ihevcd_cxa_ctl_degrade_op_t);
+    IV_API_CALL_STATUS_T status = ivdec_api_function(mDecHandle,
+                                                     &s_degrade_ip,
+                                                     &s_degrade_op);
+    if (IV_SUCCESS != status) {
+        ALOGD("error in %s: 0x%x", __func__, s_degrade_op.u4_error_code);
+        return UNKNOWN_ERROR;
+    }
+
+    return OK;
+}
+
 status_t C2SoftHevcDec::initDecoder() {
     if (OK != createDecoder()) return UNKNOWN_ERROR;
-    mNumCores = MIN(getCpuCoreCount(), MAX_NUM_CORES);
+    mNumCores = MIN(getCoreShare(), MAX_NUM_CORES);
     mStride = ALIGN64(mWidth);
     mSignalledError = false;
+    {
+        IntfImpl::Lock lock = mIntf->lock();
+        mScaledWidth = mIntf->getScaledSize_l()->width;
+        mScaledHeight = mIntf->getScaledSize_l()->height;
+    }
+    // the decoded size is reported until scaled pictures are output
+    mOutputWidth = mWidth;
+    mOutputHeight = mHeight;
     resetPlugin();
     (void) setNumCores();
+    mDegrade = shouldDegrade();
+    (void) setDegrade();
     if (OK != setParams(mStride)) return UNKNOWN_ERROR;
     (void) getVersion();
 
@@ -531,9 +620,11 @@ bool C2SoftHevcDec::setDecodeArgs(ivd_video_decode_ip_t *ps_decode_ip,
         ps_decode_ip->s_out_buffer.pu1_bufs[1] = outBuffer->data()[C2PlanarLayout::PLANE_U];
         ps_decode_ip->s_out_buffer.pu1_bufs[2] = outBuffer->data()[C2PlanarLayout::PLANE_V];
     } else {
-        ps_decode_ip->s_out_buffer.pu1_bufs[0] = mOutBufferFlush;
-        ps_decode_ip->s_out_buffer.pu1_bufs[1] = mOutBufferFlush + lumaSize;
-        ps_decode_ip->s_out_buffer.pu1_bufs[2] = mOutBufferFlush + lumaSize + chromaSize;
+        // decode into an internal buffer when flushing, or when the output is scaled
+        uint8_t *base = mOutBufferFlush ? mOutBufferFlush : mOutBufferScale;
+        ps_decode_ip->s_out_buffer.pu1_bufs[0] = base;
+        ps_decode_ip->s_out_buffer.pu1_bufs[1] = base + lumaSize;
+        ps_decode_ip->s_out_buffer.pu1_bufs[2] = base + lumaSize + chromaSize;
     }
     ps_decode_ip->s_out_buffer.u4_num_bufs = 3;
     ps_decode_op->u4_size = sizeof(ivd_video_decode_op_t);
@@ -627,6 +718,7 @@ status_t C2SoftHevcDec::resetDecoder() {
     }
     mStride = 0;
     (void) setNumCores();
+    (void) setDegrade();
     mSignalledError = false;
 
     return OK;
@@ -673,15 +765,39 @@ void fillEmptyWork(const std::unique_ptr<C2Work> &work) {
 }
 
 void C2SoftHevcDec::finishWork(uint64_t index, const std::unique_ptr<C2Work> &work) {
+    uint32_t width = mWidth;
+    uint32_t height = mHeight;
+    if (mOutBufferScale) {
+        // the output block is sized to the scaled picture
+        width = mOutBlock->width();
+        height = mOutBlock->height();
+        C2GraphicView wView = mOutBlock->map().get();
+        size_t lumaSize = mStride * mHeight;
+        if (wView.error() || OK != ImageScale(
+                wView, width, height,
+                mOutBufferScale, mOutBufferScale + lumaSize, mOutBufferScale + lumaSize * 5 / 4,
+                mStride, mStride / 2, mStride / 2, mWidth, mHeight)) {
+            ALOGE("failed to scale output picture to %ux%u", width, height);
+        }
+    }
     std::shared_ptr<C2Buffer> buffer = createGraphicBuffer(std::move(mOutBlock),
-                                                           C2Rect(mWidth, mHeight));
+                                                           C2Rect(width, height));
     mOutBlock = nullptr;
     {
         IntfImpl::Lock lock = mIntf->lock();
         buffer->setInfo(mIntf->getColorAspects_l());
     }
 
-    auto fillWork = [buffer, index](const std::unique_ptr<C2Work> &work) {
+    // The output format takes its size from C2StreamPictureSizeInfo, which holds the decoded
+    // size; report the size of scaled pictures with the first buffer that has it.
+    std::shared_ptr<C2StreamPictureSizeInfo::output> outputSize;
+    if (width != mOutputWidth || height != mOutputHeight) {
+        mOutputWidth = width;
+        mOutputHeight = height;
+        outputSize = std::make_shared<C2StreamPictureSizeInfo::output>(0u, width, height);
+    }
+
+    auto fillWork = [buffer, index, outputSize](const std::unique_ptr<C2Work> &work) {
         uint32_t flags = 0;
         if ((work->input.flags & C2FrameData::FLAG_END_OF_STREAM) &&
                 (c2_cntr64_t(index) == work->input.ordinal.frameIndex)) {
@@ -691,6 +807,9 @@ void C2SoftHevcDec::finishWork(uint64_t index, const std::unique_ptr<C2Work> &wo
         work->worklets.front()->output.flags = (C2FrameData::flags_t)flags;
         work->worklets.front()->output.buffers.clear();
         work->worklets.front()->output.buffers.push_back(buffer);
+        if (outputSize) {
+            work->worklets.front()->output.configUpdate.push_back(C2Param::Copy(*outputSize));
+        }
         work->worklets.front()->output.ordinal = work->input.ordinal;
         work->workletsProcessed = 1u;
     };
@@ -710,20 +829,45 @@ c2_status_t C2SoftHevcDec::ensureDecoderState(const std::shared_ptr<C2BlockPool>
         mStride = ALIGN64(mWidth);
         if (OK != setParams(mStride)) return C2_CORRUPTED;
     }
+    uint32_t blockWidth = mStride;
+    uint32_t blockHeight = mHeight;
+    if (mScaledWidth && mScaledHeight && (mScaledWidth < mWidth || mScaledHeight < mHeight)) {
+        // decode into an internal buffer and scale from it into smaller output blocks
+        size_t bufferSize = mStride * mHeight * 3 / 2;
+        if (mOutBufferScaleSize != bufferSize) {
+            if (mOutBufferScale) {
+                ivd_aligned_free(nullptr, mOutBufferScale);
+            }
+            mOutBufferScale = (uint8_t *)ivd_aligned_malloc(nullptr, 128, bufferSize);
+            if (!mOutBufferScale) {
+                ALOGE("could not allocate scaling buffer of size %zu", bufferSize);
+                mOutBufferScaleSize = 0;
+                return C2_NO_MEMORY;
+            }
+            mOutBufferScaleSize = bufferSize;
+        }
+        blockWidth = c2_min(mScaledWidth, mWidth);
+        blockHeight = c2_min(mScaledHeight, mHeight);
+    } else if (mOutBufferScale) {
+        ivd_aligned_free(nullptr, mOutBufferScale);
+        mOutBufferScale = nullptr;
+        mOutBufferScaleSize = 0;
+    }
     if (mOutBlock &&
-            (mOutBlock->width() != mStride || mOutBlock->height() != mHeight)) {
+            (mOutBlock->width() != blockWidth || mOutBlock->height() != blockHeight)) {
         mOutBlock.reset();
     }
     if (!mOutBlock) {
         uint32_t format = HAL_PIXEL_FORMAT_YV12;
         C2MemoryUsage usage = { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE };
-        c2_status_t err = pool->fetchGraphicBlock(mStride, mHeight, format, usage, &mOutBlock);
+        c2_status_t err = pool->fetchGraphicBlock(
+                blockWidth, blockHeight, format, usage, &mOutBlock);
         if (err != C2_OK) {
             ALOGE("fetchGraphicBlock for Output failed with status %d", err);
             return err;
         }
         ALOGV("provided (%dx%d) required (%dx%d)",
-              mOutBlock->width(), mOutBlock->height(), mStride, mHeight);
+              mOutBlock->width(), mOutBlock->height(), blockWidth, blockHeight);
     }
 
     return C2_OK;
@@ -746,6 +890,19 @@ void C2SoftHevcDec::process(
         return;
     }
 
+    // pick up rebalancing of the process-wide core budget between frames
+    bool coresChanged = false;
+    size_t numCores = MIN(getCoreShare(&coresChanged), MAX_NUM_CORES);
+    if (coresChanged && numCores != mNumCores && mDecHandle) {
+        mNumCores = numCores;
+        (void) setNumCores();
+    }
+    bool degrade = shouldDegrade();
+    if (degrade != mDegrade && mDecHandle) {
+        mDegrade = degrade;
+        (void) setDegrade();
+    }
+
     size_t inOffset = 0u;
     size_t inSize = 0u;
     uint32_t workIndex = work->input.ordinal.frameIndex.peeku() & 0xFFFFFFFF;
@@ -780,7 +937,8 @@ void C2SoftHevcDec::process(
         }
         ivd_video_decode_ip_t s_decode_ip;
         ivd_video_decode_op_t s_decode_op;
-        if (!setDecodeArgs(&s_decode_ip, &s_decode_op, &rView, &wView,
+        if (!setDecodeArgs(&s_decode_ip, &s_decode_op, &rView,
+                           mOutBufferScale ? nullptr : &wView,
                            inOffset + inPos, inSize - inPos, workIndex)) {
             mSignalledError = true;
             work->result = C2_CORRUPTED;
@@ -825,6 +983,8 @@ void C2SoftHevcDec::process(
                 if (err == OK) {
                     work->worklets.front()->output.configUpdate.push_back(
                         C2Param::Copy(size));
+                    mOutputWidth = mWidth;
+                    mOutputHeight = mHeight;
                 } else {
                     ALOGE("Cannot set width and height");
                     mSignalledError = true;
@@ -881,7 +1041,8 @@ c2_status_t C2SoftHevcDec::drainInternal(
         }
         ivd_video_decode_ip_t s_decode_ip;
         ivd_video_decode_op_t s_decode_op;
-        if (!setDecodeArgs(&s_decode_ip, &s_decode_op, nullptr, &wView, 0, 0, 0)) {
+        if (!setDecodeArgs(&s_decode_ip, &s_decode_op, nullptr,
+                           mOutBufferScale ? nullptr : &wView, 0, 0, 0)) {
             mSignalledError = true;
             return C2_CORRUPTED;
         }
@@ -41,6 +41,10 @@ namespace android {
 #define IVDEXT_CMD_CTL_SET_NUM_CORES    \
         (IVD_CONTROL_API_COMMAND_TYPE_T)IHEVCD_CXA_CMD_CTL_SET_NUM_CORES
 #define MIN(a, b)                       (((a) < (b)) ? (a) : (b))
+// see ihevcd_cxa_ctl_degrade_ip_t
+#define DEGRADE_TYPE_SAO                1
+#define DEGRADE_TYPE_DEBLOCKING         2
+#define DEGRADE_PICS_NON_REF            1
 #define GETTIME(a, b)                   gettimeofday(a, b);
 #define TIME_DIFF(start, end, diff)     \
     diff = (((end).tv_sec - (start).tv_sec) * 1000000) + \
@@ -69,6 +73,8 @@ struct C2SoftHevcDec : public SimpleC2Component {
  private:
     status_t createDecoder();
     status_t setNumCores();
+    bool shouldDegrade();
+    status_t setDegrade();
     status_t setParams(size_t stride);
     status_t getVersion();
     status_t initDecoder();
@@ -111,6 +117,14 @@ struct C2SoftHevcDec : public SimpleC2Component {
     iv_obj_t *mDecHandle;
     std::shared_ptr<C2GraphicBlock> mOutBlock;
     uint8_t *mOutBufferFlush;
+    // decoded pictures when output is scaled (see C2StreamScaledPictureSizeTuning)
+    uint8_t *mOutBufferScale;
+    size_t mOutBufferScaleSize;
+    uint32_t mScaledWidth;
+    uint32_t mScaledHeight;
+    // size of the output pictures last reported to the client (C2StreamPictureSizeInfo)
+    uint32_t mOutputWidth;
+    uint32_t mOutputHeight;
 
     size_t mNumCores;
     IV_COLOR_FORMAT_T mIvColorformat;
@@ -120,6 +134,8 @@ struct C2SoftHevcDec : public SimpleC2Component {
     uint32_t mStride;
     bool mSignalledOutputEos;
     bool mSignalledError;
+    // whether decoding quality is degraded for speed (see C2RealTimePriorityTuning)
+    bool mDegrade;
 
     // Color aspects. These are ISO values and are meant to detect changes in aspects to avoid
     // converting them to C2 values for each frame
@@ -283,19 +283,6 @@ private:
     std::shared_ptr<C2StreamPixelFormatInfo::output> mPixelFormat;
 };
 
-static size_t getCpuCoreCount() {
-    long cpuCoreCount = 1;
-#if defined(_SC_NPROCESSORS_ONLN)
-    cpuCoreCount = sysconf(_SC_NPROCESSORS_ONLN);
-#else
-    // _SC_NPROC_ONLN must be defined...
-    cpuCoreCount = sysconf(_SC_NPROC_ONLN);
-#endif
-    CHECK(cpuCoreCount >= 1);
-    ALOGV("Number of CPU cores: %ld", cpuCoreCount);
-    return (size_t)cpuCoreCount;
-}
-
 static void *ivd_aligned_malloc(WORD32 alignment, WORD32 size) {
     return memalign(alignment, size);
 }
@@ -421,6 +408,9 @@ status_t C2SoftMpeg2Dec::fillMemRecords() {
     ivdext_fill_mem_rec_op_t s_fill_mem_op;
 
     s_fill_mem_ip.s_ivd_fill_mem_rec_ip_t.u4_size = sizeof(ivdext_fill_mem_rec_ip_t);
+    // Display buffers are not shared with the decoder: deinterlaced pictures are written to the
+    // output buffer, and decoded pictures stay references after they are output, which blocks
+    // from a surface-backed output pool cannot be.
     s_fill_mem_ip.u4_share_disp_buf = 0;
     s_fill_mem_ip.e_output_format = mIvColorformat;
     s_fill_mem_ip.u4_deinterlace = 1;
@@ -560,7 +550,7 @@ status_t C2SoftMpeg2Dec::initDecoder() {
 
     if (OK != createDecoder()) return UNKNOWN_ERROR;
 
-    mNumCores = MIN(getCpuCoreCount(), MAX_NUM_CORES);
+    mNumCores = MIN(getCoreShare(), MAX_NUM_CORES);
     mStride = ALIGN64(mWidth);
     mSignalledError = false;
     resetPlugin();
@@ -852,6 +842,14 @@ void C2SoftMpeg2Dec::process(
         return;
     }
 
+    // pick up rebalancing of the process-wide core budget between frames
+    bool coresChanged = false;
+    size_t numCores = MIN(getCoreShare(&coresChanged), MAX_NUM_CORES);
+    if (coresChanged && numCores != mNumCores && mDecHandle) {
+        mNumCores = numCores;
+        (void) setNumCores();
+    }
+
     size_t inOffset = 0u;
     size_t inSize = 0u;
     uint32_t workIndex = work->input.ordinal.frameIndex.peeku() & 0xFFFFFFFF;
@@ -246,6 +246,7 @@ C2SoftMpeg4Dec::C2SoftMpeg4Dec(
       mIntf(intfImpl),
       mDecHandle(nullptr),
       mOutputBuffer{},
+      mLowLatency(false),
       mInitialized(false) {
 }
 
@@ -259,6 +260,7 @@ c2_status_t C2SoftMpeg4Dec::onInit() {
 }
 
 c2_status_t C2SoftMpeg4Dec::onStop() {
+    cancelOutputCopy();
     if (mInitialized) {
         if (mDecHandle) {
             PVCleanUpVideoDecoder(mDecHandle);
@@ -285,6 +287,15 @@ void C2SoftMpeg4Dec::onReset() {
 }
 
 void C2SoftMpeg4Dec::onRelease() {
+    cancelOutputCopy();
+    {
+        Mutexed<OutputCopy>::Locked copy(mOutputCopy);
+        copy->stopped = true;
+        copy->cond.broadcast();
+    }
+    if (mCopyThread.joinable()) {
+        mCopyThread.join();
+    }
     if (mInitialized) {
         if (mDecHandle) {
             PVCleanUpVideoDecoder(mDecHandle);
@@ -305,6 +316,7 @@ void C2SoftMpeg4Dec::onRelease() {
 }
 
 c2_status_t C2SoftMpeg4Dec::onFlush_sm() {
+    cancelOutputCopy();
     if (mInitialized) {
         if (PV_TRUE != PVResetVideoDecoder(mDecHandle)) {
             return C2_CORRUPTED;
@@ -339,6 +351,10 @@ status_t C2SoftMpeg4Dec::initDecoder() {
     mFramesConfigured = false;
     mSignalledOutputEos = false;
     mSignalledError = false;
+    {
+        IntfImpl::Lock lock = mIntf->lock();
+        mLowLatency = (mIntf->mLowLatencyMode->value == C2_TRUE);
+    }
 
     return OK;
 }
@@ -355,10 +371,9 @@ void fillEmptyWork(const std::unique_ptr<C2Work> &work) {
     work->workletsProcessed = 1u;
 }
 
-void C2SoftMpeg4Dec::finishWork(uint64_t index, const std::unique_ptr<C2Work> &work) {
-    std::shared_ptr<C2Buffer> buffer = createGraphicBuffer(std::move(mOutBlock),
-                                                           C2Rect(mWidth, mHeight));
-    mOutBlock = nullptr;
+void C2SoftMpeg4Dec::finishWork(uint64_t index, const std::unique_ptr<C2Work> &work,
+                                const std::shared_ptr<C2GraphicBlock> &block, const C2Rect &crop) {
+    std::shared_ptr<C2Buffer> buffer = createGraphicBuffer(block, crop);
     auto fillWork = [buffer, index](const std::unique_ptr<C2Work> &work) {
         uint32_t flags = 0;
         if ((work->input.flags & C2FrameData::FLAG_END_OF_STREAM) &&
@@ -427,6 +442,8 @@ bool C2SoftMpeg4Dec::handleResChange(const std::unique_ptr<C2Work> &work) {
 
     bool resChanged = false;
     if (disp_width != mWidth || disp_height != mHeight) {
+        // the pending output copy reads from the buffers freed below
+        finishOutputCopy(work);
         mWidth = disp_width;
         mHeight = disp_height;
         resChanged = true;
@@ -488,9 +505,106 @@ static void copyOutputBufferToYV12Frame(uint8_t *dst, uint8_t *src, size_t dstYS
     }
 }
 
+void C2SoftMpeg4Dec::queueOutputCopy(uint64_t index) {
+    Mutexed<OutputCopy>::Locked copy(mOutputCopy);
+    CHECK(!copy->queued);
+    if (!mCopyThread.joinable()) {
+        mCopyThread = std::thread(&C2SoftMpeg4Dec::copyLoop, this);
+    }
+    copy->queued = true;
+    copy->copied = false;
+    copy->index = index;
+    copy->src = mOutputBuffer[mNumSamplesOutput & 1];
+    copy->width = mWidth;
+    copy->height = mHeight;
+    copy->block = std::move(mOutBlock);
+    copy->err = C2_OK;
+    mOutBlock = nullptr;
+    copy->cond.broadcast();
+}
+
+void C2SoftMpeg4Dec::finishOutputCopy(const std::unique_ptr<C2Work> &work) {
+    Mutexed<OutputCopy>::Locked copy(mOutputCopy);
+    if (!copy->queued) {
+        return;
+    }
+    while (!copy->copied) {
+        copy.waitForCondition(copy->cond);
+    }
+    copy->queued = false;
+    uint64_t index = copy->index;
+    std::shared_ptr<C2GraphicBlock> block = std::move(copy->block);
+    C2Rect crop(copy->width, copy->height);
+    c2_status_t err = copy->err;
+    copy.unlock();
+
+    if (err != C2_OK) {
+        mSignalledError = true;
+        finish(index, [err](const std::unique_ptr<C2Work> &work) {
+            work->result = err;
+            work->workletsProcessed = 1u;
+        });
+        return;
+    }
+    finishWork(index, work, block, crop);
+}
+
+void C2SoftMpeg4Dec::cancelOutputCopy() {
+    Mutexed<OutputCopy>::Locked copy(mOutputCopy);
+    while (copy->queued && !copy->copied) {
+        copy.waitForCondition(copy->cond);
+    }
+    copy->queued = false;
+    copy->block.reset();
+}
+
+void C2SoftMpeg4Dec::copyLoop() {
+    Mutexed<OutputCopy>::Locked copy(mOutputCopy);
+    while (!copy->stopped) {
+        if (!copy->queued || copy->copied) {
+            copy.waitForCondition(copy->cond);
+            continue;
+        }
+        std::shared_ptr<C2GraphicBlock> block = copy->block;
+        uint8_t *src = copy->src;
+        uint32_t width = copy->width;
+        uint32_t height = copy->height;
+        copy.unlock();
+
+        c2_status_t err = C2_OK;
+        {
+            C2GraphicView wView = block->map().get();
+            if (wView.error()) {
+                ALOGE("graphic view map failed %d", wView.error());
+                err = C2_CORRUPTED;
+            } else {
+                copyOutputBufferToYV12Frame(wView.data()[C2PlanarLayout::PLANE_Y], src,
+                                            wView.width(), align(width, 16), width, height);
+            }
+        }
+        block.reset();
+
+        copy.lock();
+        copy->err = err;
+        copy->copied = true;
+        copy->cond.broadcast();
+    }
+}
+
 void C2SoftMpeg4Dec::process(
         const std::unique_ptr<C2Work> &work,
         const std::shared_ptr<C2BlockPool> &pool) {
+    decode(work, pool);
+    if (work->result != C2_OK) {
+        // The previous frame may still be queued for copying; do not leave its work pending
+        // until the next flush or stop.
+        finishOutputCopy(work);
+    }
+}
+
+void C2SoftMpeg4Dec::decode(
+        const std::unique_ptr<C2Work> &work,
+        const std::shared_ptr<C2BlockPool> &pool) {
     work->result = C2_OK;
     work->workletsProcessed = 0u;
     work->worklets.front()->output.configUpdate.clear();
@@ -519,6 +633,7 @@ void C2SoftMpeg4Dec::process(
 
     bool eos = ((work->input.flags & C2FrameData::FLAG_END_OF_STREAM) != 0);
     if (inSize == 0) {
+        finishOutputCopy(work);
         fillEmptyWork(work);
         if (eos) {
             mSignalledOutputEos = true;
@@ -586,6 +701,11 @@ void C2SoftMpeg4Dec::process(
         }
     }
 
+    // Copy the output of this frame while the next frame is decoded, unless there is no next
+    // frame to wait for, the client waits for each frame (low latency mode), or there is no
+    // core to spare.
+    bool pipelined = !eos && !mLowLatency && getCoreShare() > 1;
+
     size_t inPos = 0;
     while (inPos < inSize) {
         c2_status_t err = ensureDecoderState(pool);
@@ -595,13 +715,6 @@ void C2SoftMpeg4Dec::process(
             work->workletsProcessed = 1u;
             return;
         }
-        C2GraphicView wView = mOutBlock->map().get();
-        if (wView.error()) {
-            ALOGE("graphic view map failed %d", wView.error());
-            work->result = C2_CORRUPTED;
-            work->workletsProcessed = 1u;
-            return;
-        }
 
         uint32_t yFrameSize = sizeof(uint8) * mDecHandle->size;
         if (mOutputBufferSize < yFrameSize * 3 / 2){
@@ -673,12 +786,26 @@ void C2SoftMpeg4Dec::process(
             return;
         }
 
-        uint8_t *outputBufferY = wView.data()[C2PlanarLayout::PLANE_Y];
-        (void)copyOutputBufferToYV12Frame(outputBufferY, mOutputBuffer[mNumSamplesOutput & 1],
-                                          wView.width(), align(mWidth, 16), mWidth, mHeight);
+        // the previous frame has been copied while this frame was decoded
+        finishOutputCopy(work);
 
         inPos += inSize - (size_t)tmpInSize;
-        finishWork(workIndex, work);
+        if (pipelined) {
+            queueOutputCopy(workIndex);
+        } else {
+            C2GraphicView wView = mOutBlock->map().get();
+            if (wView.error()) {
+                ALOGE("graphic view map failed %d", wView.error());
+                work->result = C2_CORRUPTED;
+                work->workletsProcessed = 1u;
+                return;
+            }
+            uint8_t *outputBufferY = wView.data()[C2PlanarLayout::PLANE_Y];
+            (void)copyOutputBufferToYV12Frame(outputBufferY, mOutputBuffer[mNumSamplesOutput & 1],
+                                              wView.width(), align(mWidth, 16), mWidth, mHeight);
+            finishWork(workIndex, work, mOutBlock, C2Rect(mWidth, mHeight));
+            mOutBlock.reset();
+        }
         ++mNumSamplesOutput;
         if (inSize - inPos != 0) {
             ALOGD("decoded frame, ignoring further trailing bytes %d",
@@ -700,6 +827,7 @@ c2_status_t C2SoftMpeg4Dec::drain(
         ALOGW("DRAIN_CHAIN not supported");
         return C2_OMITTED;
     }
+    finishOutputCopy(nullptr);
     return C2_OK;
 }
 
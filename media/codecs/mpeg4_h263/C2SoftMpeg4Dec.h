@@ -17,6 +17,8 @@
 #ifndef C2_SOFT_MPEG4_DEC_H_
 #define C2_SOFT_MPEG4_DEC_H_
 
+#include <thread>
+
 #include <SimpleC2Component.h>
 
 
@@ -50,8 +52,23 @@ struct C2SoftMpeg4Dec : public SimpleC2Component {
 
     status_t initDecoder();
     c2_status_t ensureDecoderState(const std::shared_ptr<C2BlockPool> &pool);
-    void finishWork(uint64_t index, const std::unique_ptr<C2Work> &work);
+    void finishWork(uint64_t index, const std::unique_ptr<C2Work> &work,
+                    const std::shared_ptr<C2GraphicBlock> &block, const C2Rect &crop);
     bool handleResChange(const std::unique_ptr<C2Work> &work);
+    // Decodes the input of |work|; process() finishes a queued output copy if this fails.
+    void decode(
+            const std::unique_ptr<C2Work> &work,
+            const std::shared_ptr<C2BlockPool> &pool);
+
+    // Hands the frame just decoded into |mOutputBuffer[mNumSamplesOutput & 1]| over to the copy
+    // thread, which copies it to |mOutBlock| while the next frame is decoded.
+    void queueOutputCopy(uint64_t index);
+    // Waits for the queued output copy, if any, and finishes its work.
+    void finishOutputCopy(const std::unique_ptr<C2Work> &work);
+    // Waits for the queued output copy, if any, and drops it, e.g. on flush.
+    void cancelOutputCopy();
+    // Main function of the copy thread.
+    void copyLoop();
 
     std::shared_ptr<IntfImpl> mIntf;
     tagvideoDecControls *mDecHandle;
@@ -64,11 +81,32 @@ struct C2SoftMpeg4Dec : public SimpleC2Component {
     uint32_t mNumSamplesOutput;
 
     bool mIsMpeg4;
+    bool mLowLatency;
     bool mInitialized;
     bool mFramesConfigured;
     bool mSignalledOutputEos;
     bool mSignalledError;
 
+    // Output copy pending on the copy thread. The library decodes into |mOutputBuffer| (the
+    // frame being decoded and its reference), so a copy of the decoded frame may overlap with
+    // decoding the next frame, which only reads it as the reference.
+    struct OutputCopy {
+        OutputCopy() : queued(false), copied(false), stopped(false) {}
+        bool queued;    // a frame was handed to the copy thread and its work is not finished
+        bool copied;    // the copy thread is done with the frame
+        bool stopped;
+        uint64_t index;
+        uint8_t *src;
+        uint32_t width;
+        uint32_t height;
+        std::shared_ptr<C2GraphicBlock> block;
+        c2_status_t err;
+        Condition cond;
+    };
+    Mutexed<OutputCopy> mOutputCopy;
+    // Started on the first queueOutputCopy() call.
+    std::thread mCopyThread;
+
     C2_DO_NOT_COPY(C2SoftMpeg4Dec);
 };
 
@@ -123,6 +123,24 @@ class C2SoftMpeg4Enc::IntfImpl : public C2InterfaceHelper {
                 .withSetter(Setter<decltype(*mSyncFramePeriod)>::StrictValueWithNoDeps)
                 .build());
 
+        addParameter(
+                DefineParam(mColorAspects, C2_PARAMKEY_COLOR_ASPECTS)
+                .withDefault(new C2StreamColorAspectsInfo::input(
+                        0u, C2Color::RANGE_UNSPECIFIED, C2Color::PRIMARIES_UNSPECIFIED,
+                        C2Color::TRANSFER_UNSPECIFIED, C2Color::MATRIX_UNSPECIFIED))
+                .withFields({
+                    C2F(mColorAspects, range).inRange(
+                                C2Color::RANGE_UNSPECIFIED,     C2Color::RANGE_OTHER),
+                    C2F(mColorAspects, primaries).inRange(
+                                C2Color::PRIMARIES_UNSPECIFIED, C2Color::PRIMARIES_OTHER),
+                    C2F(mColorAspects, transfer).inRange(
+                                C2Color::TRANSFER_UNSPECIFIED,  C2Color::TRANSFER_OTHER),
+                    C2F(mColorAspects, matrix).inRange(
+                                C2Color::MATRIX_UNSPECIFIED,    C2Color::MATRIX_OTHER)
+                })
+                .withSetter(ColorAspectsSetter)
+                .build());
+
 #ifdef MPEG4
         addParameter(
                 DefineParam(mProfileLevel, C2_PARAMKEY_PROFILE_LEVEL)
@@ -204,10 +222,30 @@ class C2SoftMpeg4Enc::IntfImpl : public C2InterfaceHelper {
         return C2R::Ok();
     }
 
+    static C2R ColorAspectsSetter(bool mayBlock, C2P<C2StreamColorAspectsInfo::input> &me) {
+        (void)mayBlock;
+        if (me.v.range > C2Color::RANGE_OTHER) {
+                me.set().range = C2Color::RANGE_OTHER;
+        }
+        if (me.v.primaries > C2Color::PRIMARIES_OTHER) {
+                me.set().primaries = C2Color::PRIMARIES_OTHER;
+        }
+        if (me.v.transfer > C2Color::TRANSFER_OTHER) {
+                me.set().transfer = C2Color::TRANSFER_OTHER;
+        }
+        if (me.v.matrix > C2Color::MATRIX_OTHER) {
+                me.set().matrix = C2Color::MATRIX_OTHER;
+        }
+        return C2R::Ok();
+    }
+
     // unsafe getters
     std::shared_ptr<C2StreamPictureSizeInfo::input> getSize_l() const { return mSize; }
     std::shared_ptr<C2StreamFrameRateInfo::output> getFrameRate_l() const { return mFrameRate; }
     std::shared_ptr<C2StreamBitrateInfo::output> getBitrate_l() const { return mBitrate; }
+    std::shared_ptr<C2StreamColorAspectsInfo::input> getColorAspects_l() const {
+        return mColorAspects;
+    }
     uint32_t getSyncFramePeriod() const {
         if (mSyncFramePeriod->value < 0 || mSyncFramePeriod->value == INT64_MAX) {
             return 0;
@@ -227,6 +265,7 @@ class C2SoftMpeg4Enc::IntfImpl : public C2InterfaceHelper {
     std::shared_ptr<C2BitrateTuning::output> mBitrate;
     std::shared_ptr<C2StreamProfileLevelInfo::output> mProfileLevel;
     std::shared_ptr<C2StreamSyncFrameIntervalTuning::output> mSyncFramePeriod;
+    std::shared_ptr<C2StreamColorAspectsInfo::input> mColorAspects;
 };
 
 C2SoftMpeg4Enc::C2SoftMpeg4Enc(const char* name, c2_node_id_t id,
@@ -373,6 +412,7 @@ c2_status_t C2SoftMpeg4Enc::initEncoder() {
         mSize = mIntf->getSize_l();
         mBitrate = mIntf->getBitrate_l();
         mFrameRate = mIntf->getFrameRate_l();
+        mColorAspects = mIntf->getColorAspects_l();
     }
     c2_status_t err = initEncParams();
     if (C2_OK != err) {
@@ -491,6 +531,8 @@ void C2SoftMpeg4Enc::process(
     CHECK_EQ((width & 1u), 0u);
     CHECK_EQ((height & 1u), 0u);
     size_t yPlaneSize = width * height;
+    // chroma planes deinterleaved from semi-planar input, until the frame is encoded
+    MemoryBlock chromaBuffer;
     switch (layout.type) {
         case C2PlanarLayout::TYPE_RGB:
         // fall-through
@@ -502,7 +544,8 @@ void C2SoftMpeg4Enc::process(
             vPlane = uPlane + yPlaneSize / 4;
             yStride = width;
             uStride = vStride = width / 2;
-            ConvertRGBToPlanarYUV(yPlane, yStride, height, conversionBuffer.size(), *rView.get());
+            ConvertRGBToPlanarYUV(yPlane, yStride, height, conversionBuffer.size(), *rView.get(),
+                                  mColorAspects->matrix, mColorAspects->range);
             break;
         }
         case C2PlanarLayout::TYPE_YUV: {
@@ -521,6 +564,34 @@ void C2SoftMpeg4Enc::process(
                 break;
             }
 
+            if (layout.planes[layout.PLANE_Y].colInc == 1
+                    && (IsNV12(*rView) || IsNV21(*rView))
+                    && uStride == vStride
+                    && yStride == uStride
+                    && yStride == (int32_t)align(width, 16)) {
+                // The encoder only takes planar input (with the frame width as
+                // pitch), but luma can still be used in place. Only
+                // deinterleave the chroma planes.
+                uStride = vStride = yStride / 2;
+                size_t chromaPlaneSize = uStride * (height / 2);
+                chromaBuffer = mConversionBuffers.fetch(chromaPlaneSize * 2);
+                uint8_t *dstU = chromaBuffer.data();
+                uint8_t *dstV = dstU + chromaPlaneSize;
+                for (uint32_t row = 0; row < height / 2; ++row) {
+                    const uint8_t *srcU = uPlane + row * yStride;
+                    const uint8_t *srcV = vPlane + row * yStride;
+                    for (uint32_t col = 0; col < width / 2; ++col) {
+                        dstU[col] = srcU[2 * col];
+                        dstV[col] = srcV[2 * col];
+                    }
+                    dstU += uStride;
+                    dstV += vStride;
+                }
+                uPlane = chromaBuffer.data();
+                vPlane = uPlane + chromaPlaneSize;
+                break;
+            }
+
             // copy to I420
             MemoryBlock conversionBuffer = mConversionBuffers.fetch(yPlaneSize * 3 / 2);
             mConversionBuffersInUse.emplace(conversionBuffer.data(), conversionBuffer);
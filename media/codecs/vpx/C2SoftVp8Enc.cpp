@@ -62,6 +62,14 @@ vpx_codec_err_t C2SoftVp8Enc::setCodecSpecificControls() {
                                                      mDCTPartitions);
     if (codec_return != VPX_CODEC_OK) {
         ALOGE("Error setting dct partitions for vpx encoder.");
+        return codec_return;
+    }
+    if (mFastEncoding) {
+        // fastest static speed setting for realtime encoding
+        codec_return = vpx_codec_control(mCodecContext, VP8E_SET_CPUUSED, -16);
+        if (codec_return != VPX_CODEC_OK) {
+            ALOGE("Error setting VP8E_SET_CPUUSED to -16.");
+        }
     }
     return codec_return;
 }
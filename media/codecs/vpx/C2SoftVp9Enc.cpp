@@ -59,6 +59,16 @@ void C2SoftVp9Enc::setCodecSpecificConfiguration() {
         default:
             mCodecConfiguration->g_profile = 0;
     }
+
+    // Tile columns are set as a power of two, and libvpx does not split frames
+    // into tiles narrower than 256 pixels. Unless requested otherwise, use one
+    // tile column per thread.
+    uint32_t tileColumns = mNumTileColumns ? mNumTileColumns : mNumThreads;
+    mTileColumns = 0;
+    while ((2u << mTileColumns) <= tileColumns
+            && (mCodecConfiguration->g_w >> (mTileColumns + 1)) >= 256) {
+        ++mTileColumns;
+    }
 }
 
 vpx_codec_err_t C2SoftVp9Enc::setCodecSpecificControls() {
@@ -78,19 +88,20 @@ vpx_codec_err_t C2SoftVp9Enc::setCodecSpecificControls() {
               codecReturn);
         return codecReturn;
     }
-    codecReturn = vpx_codec_control(mCodecContext, VP9E_SET_ROW_MT, 1);
+    codecReturn = vpx_codec_control(mCodecContext, VP9E_SET_ROW_MT, mRowMt);
     if (codecReturn != VPX_CODEC_OK) {
-        ALOGE("Error setting VP9E_SET_ROW_MT to 1. vpx_codec_control() "
-              "returned %d", codecReturn);
+        ALOGE("Error setting VP9E_SET_ROW_MT to %d. vpx_codec_control() "
+              "returned %d", mRowMt, codecReturn);
         return codecReturn;
     }
 
-    // For VP9, we always set CPU_USED to 8 (because the realtime default is 0
-    // which is too slow).
-    codecReturn = vpx_codec_control(mCodecContext, VP8E_SET_CPUUSED, 8);
+    // For realtime VP9 encoding, we set CPU_USED to 8 (because the default is
+    // 0 which is too slow). Good quality encoding uses a slower speed setting.
+    int cpuUsed = mDeadline == VPX_DL_REALTIME ? 8 : 4;
+    codecReturn = vpx_codec_control(mCodecContext, VP8E_SET_CPUUSED, cpuUsed);
     if (codecReturn != VPX_CODEC_OK) {
-        ALOGE("Error setting VP8E_SET_CPUUSED to 8. vpx_codec_control() "
-              "returned %d", codecReturn);
+        ALOGE("Error setting VP8E_SET_CPUUSED to %d. vpx_codec_control() "
+              "returned %d", cpuUsed, codecReturn);
         return codecReturn;
     }
     return codecReturn;
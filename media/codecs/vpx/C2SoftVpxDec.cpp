@@ -18,11 +18,14 @@
 #define LOG_TAG "C2SoftVpxDec"
 #include <log/log.h>
 
+#include <algorithm>
+
 #include <media/stagefright/foundation/AUtils.h>
 #include <media/stagefright/foundation/MediaDefs.h>
 
 #include <C2Debug.h>
 #include <C2PlatformSupport.h>
+#include <Codec2BufferUtils.h>
 #include <SimpleC2Interface.h>
 
 #include "C2SoftVpxDec.h"
@@ -174,6 +177,40 @@ public:
                 .withConstValue(new C2StreamPixelFormatInfo::output(
                                      0u, HAL_PIXEL_FORMAT_YCBCR_420_888))
                 .build());
+
+        addParameter(
+                DefineParam(mThreadCount, C2_PARAMKEY_THREAD_COUNT)
+                .withDefault(new C2ThreadCountTuning(0u))
+                .withFields({ C2F(mThreadCount, value).any() })
+                .withSetter(Setter<decltype(*mThreadCount)>::NonStrictValueWithNoDeps)
+                .build());
+
+        // 0x0 (default) outputs pictures at their decoded size
+        addParameter(
+                DefineParam(mScaledSize, C2_PARAMKEY_SCALED_PICTURE_SIZE)
+                .withDefault(new C2StreamScaledPictureSizeTuning::output(0u, 0, 0))
+                .withFields({
+                    C2F(mScaledSize, width).inRange(0, 2048, 2),
+                    C2F(mScaledSize, height).inRange(0, 2048, 2),
+                })
+                .withSetter(ScaledSizeSetter)
+                .build());
+
+        addParameter(
+                DefineParam(mKeyFrameOnly, C2_PARAMKEY_KEY_FRAME_ONLY_DECODING)
+                .withDefault(new C2KeyFrameOnlyDecodingTuning(C2_FALSE))
+                .withFields({ C2F(mKeyFrameOnly, value).oneOf({ C2_FALSE, C2_TRUE }) })
+                .withSetter(Setter<decltype(*mKeyFrameOnly)>::NonStrictValueWithNoDeps)
+                .build());
+
+#ifdef VP9
+        addParameter(
+                DefineParam(mRowMt, C2_PARAMKEY_ROW_MULTI_THREADING)
+                .withDefault(new C2RowMultiThreadingTuning(C2_TRUE))
+                .withFields({ C2F(mRowMt, value).oneOf({ C2_FALSE, C2_TRUE }) })
+                .withSetter(Setter<decltype(*mRowMt)>::NonStrictValueWithNoDeps)
+                .build());
+#endif
     }
 
     static C2R SizeSetter(bool mayBlock, const C2P<C2StreamPictureSizeInfo::output> &oldMe,
@@ -217,6 +254,26 @@ public:
         return C2R::Ok();
     }
 
+    static C2R ScaledSizeSetter(
+            bool mayBlock, C2P<C2StreamScaledPictureSizeTuning::output> &me) {
+        (void)mayBlock;
+        // round down to even sizes for 4:2:0 chroma
+        me.set().width = c2_min(me.v.width, 2048u) & ~1u;
+        me.set().height = c2_min(me.v.height, 2048u) & ~1u;
+        return C2R::Ok();
+    }
+
+    uint32_t getThreadCount_l() const { return mThreadCount->value; }
+    bool getKeyFrameOnly_l() const { return mKeyFrameOnly->value == C2_TRUE; }
+    C2PictureSizeStruct getScaledSize_l() const {
+        return C2PictureSizeStruct(mScaledSize->width, mScaledSize->height);
+    }
+#ifdef VP9
+    bool getRowMt_l() const { return mRowMt->value == C2_TRUE; }
+#else
+    bool getRowMt_l() const { return false; }
+#endif
+
 private:
     std::shared_ptr<C2StreamProfileLevelInfo::input> mProfileLevel;
     std::shared_ptr<C2StreamPictureSizeInfo::output> mSize;
@@ -224,7 +281,11 @@ private:
     std::shared_ptr<C2StreamMaxBufferSizeInfo::input> mMaxInputSize;
     std::shared_ptr<C2StreamColorInfo::output> mColorInfo;
     std::shared_ptr<C2StreamPixelFormatInfo::output> mPixelFormat;
+    std::shared_ptr<C2ThreadCountTuning> mThreadCount;
+    std::shared_ptr<C2StreamScaledPictureSizeTuning::output> mScaledSize;
+    std::shared_ptr<C2KeyFrameOnlyDecodingTuning> mKeyFrameOnly;
 #ifdef VP9
+    std::shared_ptr<C2RowMultiThreadingTuning> mRowMt;
 #if 0
     std::shared_ptr<C2StreamHdrStaticInfo::output> mHdrStaticInfo;
 #endif
@@ -237,7 +298,12 @@ C2SoftVpxDec::C2SoftVpxDec(
         const std::shared_ptr<IntfImpl> &intfImpl)
     : SimpleC2Component(std::make_shared<SimpleInterface<IntfImpl>>(name, id, intfImpl)),
       mIntf(intfImpl),
-      mCodecCtx(nullptr) {
+      mCodecCtx(nullptr),
+      mKeyFrameOnly(false),
+      mScaledWidth(0),
+      mScaledHeight(0),
+      mOutputWidth(0),
+      mOutputHeight(0) {
 }
 
 C2SoftVpxDec::~C2SoftVpxDec() {
@@ -291,19 +357,6 @@ c2_status_t C2SoftVpxDec::onFlush_sm() {
     return C2_OK;
 }
 
-static int GetCPUCoreCount() {
-    int cpuCoreCount = 1;
-#if defined(_SC_NPROCESSORS_ONLN)
-    cpuCoreCount = sysconf(_SC_NPROCESSORS_ONLN);
-#else
-    // _SC_NPROC_ONLN must be defined...
-    cpuCoreCount = sysconf(_SC_NPROC_ONLN);
-#endif
-    CHECK(cpuCoreCount >= 1);
-    ALOGV("Number of CPU cores: %d", cpuCoreCount);
-    return cpuCoreCount;
-}
-
 status_t C2SoftVpxDec::initDecoder() {
 #ifdef VP9
     mMode = MODE_VP9;
@@ -321,9 +374,34 @@ status_t C2SoftVpxDec::initDecoder() {
         mCodecCtx = new vpx_codec_ctx_t;
     }
 
+    uint32_t threadCount;
+    bool rowMt;
+    {
+        IntfImpl::Lock lock = mIntf->lock();
+        threadCount = mIntf->getThreadCount_l();
+        rowMt = mIntf->getRowMt_l();
+        mKeyFrameOnly = mIntf->getKeyFrameOnly_l();
+        C2PictureSizeStruct scaledSize = mIntf->getScaledSize_l();
+        mScaledWidth = scaledSize.width;
+        mScaledHeight = scaledSize.height;
+    }
+    // the decoded size is reported until scaled pictures are output
+    mOutputWidth = mWidth;
+    mOutputHeight = mHeight;
+    uint32_t numCores = getCpuCoreCount();
+    if (mKeyFrameOnly) {
+        // key frames are decoded one at a time, and seldom have many tiles
+        threadCount = 1;
+    } else if (threadCount == 0) {
+        threadCount = getCoreShare();
+    } else if (threadCount > numCores) {
+        threadCount = numCores;
+    }
+
     vpx_codec_dec_cfg_t cfg;
     memset(&cfg, 0, sizeof(vpx_codec_dec_cfg_t));
-    cfg.threads = GetCPUCoreCount();
+    // VP9 decodes tiles in parallel, VP8 token partitions
+    cfg.threads = threadCount;
 
     vpx_codec_flags_t flags;
     memset(&flags, 0, sizeof(vpx_codec_flags_t));
@@ -337,9 +415,32 @@ status_t C2SoftVpxDec::initDecoder() {
         return UNKNOWN_ERROR;
     }
 
+#ifdef VPX_CTRL_VP9D_SET_ROW_MT
+    if (mMode == MODE_VP9 && rowMt && threadCount > 1) {
+        vpx_err = vpx_codec_control(mCodecCtx, VP9D_SET_ROW_MT, 1);
+        if (vpx_err != VPX_CODEC_OK) {
+            ALOGD("failed to enable row based multi-threading. (%d)", vpx_err);
+        }
+    }
+#else
+    (void)rowMt;
+#endif
+    ALOGV("decoding with %u thread(s)", threadCount);
+
     return OK;
 }
 
+bool C2SoftVpxDec::isKeyFrame(const uint8_t *data, size_t size) const {
+    vpx_codec_stream_info_t si;
+    memset(&si, 0, sizeof(si));
+    si.sz = sizeof(si);
+    vpx_codec_err_t err = vpx_codec_peek_stream_info(
+            mMode == MODE_VP8 ? &vpx_codec_vp8_dx_algo : &vpx_codec_vp9_dx_algo,
+            data, size, &si);
+    // let the decoder deal with frames that cannot be parsed
+    return err != VPX_CODEC_OK || si.is_kf;
+}
+
 status_t C2SoftVpxDec::destroyDecoder() {
     if  (mCodecCtx) {
         vpx_codec_destroy(mCodecCtx);
@@ -363,10 +464,19 @@ void fillEmptyWork(const std::unique_ptr<C2Work> &work) {
 }
 
 void C2SoftVpxDec::finishWork(uint64_t index, const std::unique_ptr<C2Work> &work,
-                           const std::shared_ptr<C2GraphicBlock> &block) {
-    std::shared_ptr<C2Buffer> buffer = createGraphicBuffer(block,
-                                                           C2Rect(mWidth, mHeight));
-    auto fillWork = [buffer, index](const std::unique_ptr<C2Work> &work) {
+                           const std::shared_ptr<C2GraphicBlock> &block, const C2Rect &crop) {
+    std::shared_ptr<C2Buffer> buffer = createGraphicBuffer(block, crop);
+
+    // The output format takes its size from C2StreamPictureSizeInfo, which holds the decoded
+    // size; report the size of scaled pictures with the first buffer that has it.
+    std::shared_ptr<C2StreamPictureSizeInfo::output> outputSize;
+    if (crop.width != mOutputWidth || crop.height != mOutputHeight) {
+        mOutputWidth = crop.width;
+        mOutputHeight = crop.height;
+        outputSize = std::make_shared<C2StreamPictureSizeInfo::output>(
+                0u, crop.width, crop.height);
+    }
+    auto fillWork = [buffer, index, outputSize](const std::unique_ptr<C2Work> &work) {
         uint32_t flags = 0;
         if ((work->input.flags & C2FrameData::FLAG_END_OF_STREAM) &&
                 (c2_cntr64_t(index) == work->input.ordinal.frameIndex)) {
@@ -376,6 +486,9 @@ void C2SoftVpxDec::finishWork(uint64_t index, const std::unique_ptr<C2Work> &wor
         work->worklets.front()->output.flags = (C2FrameData::flags_t)flags;
         work->worklets.front()->output.buffers.clear();
         work->worklets.front()->output.buffers.push_back(buffer);
+        if (outputSize) {
+            work->worklets.front()->output.configUpdate.push_back(C2Param::Copy(*outputSize));
+        }
         work->worklets.front()->output.ordinal = work->input.ordinal;
         work->workletsProcessed = 1u;
     };
@@ -434,6 +547,13 @@ void C2SoftVpxDec::process(
 
     int64_t frameIndex = work->input.ordinal.frameIndex.peekll();
 
+    // key frames do not reference other frames, so in key frame only mode all other frames
+    // are dropped without decoding them
+    if (inSize && mKeyFrameOnly && !isKeyFrame(rView.data() + inOffset, inSize)) {
+        ALOGV("skipping non-key frame %lld", (long long)frameIndex);
+        inSize = 0;
+    }
+
     if (inSize) {
         uint8_t *bitstream = const_cast<uint8_t *>(rView.data() + inOffset);
         vpx_codec_err_t err = vpx_codec_decode(
@@ -507,6 +627,8 @@ bool C2SoftVpxDec::outputBuffer(
         if (err == C2_OK) {
             work->worklets.front()->output.configUpdate.push_back(
                 C2Param::Copy(size));
+            mOutputWidth = mWidth;
+            mOutputHeight = mHeight;
         } else {
             ALOGE("Config update size failed");
             mSignalledError = true;
@@ -522,10 +644,22 @@ bool C2SoftVpxDec::outputBuffer(
         bpp = 2;
     }
 
+    // Scale down in place of the output copy if a smaller picture was requested. High bit depth
+    // frames are always output at the decoded size.
+    uint32_t outWidth = mWidth;
+    uint32_t outHeight = mHeight;
+    if (bpp == 1 && mScaledWidth != 0 && mScaledHeight != 0
+            && (mScaledWidth < mWidth || mScaledHeight < mHeight)) {
+        outWidth = std::min(mScaledWidth, mWidth);
+        outHeight = std::min(mScaledHeight, mHeight);
+    }
+    bool scale = (outWidth != mWidth || outHeight != mHeight);
+
     std::shared_ptr<C2GraphicBlock> block;
     uint32_t format = HAL_PIXEL_FORMAT_YV12;
     C2MemoryUsage usage = { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE };
-    c2_status_t err = pool->fetchGraphicBlock(align(mWidth, 16) * bpp, mHeight, format, usage, &block);
+    c2_status_t err = pool->fetchGraphicBlock(
+            align(outWidth, 16) * bpp, outHeight, format, usage, &block);
     if (err != C2_OK) {
         ALOGE("fetchGraphicBlock for Output failed with status %d", err);
         work->result = err;
@@ -540,7 +674,7 @@ bool C2SoftVpxDec::outputBuffer(
     }
 
     ALOGV("provided (%dx%d) required (%dx%d), out frameindex %d",
-           block->width(), block->height(), mWidth, mHeight, (int)*(int64_t *)img->user_priv);
+           block->width(), block->height(), outWidth, outHeight, (int)*(int64_t *)img->user_priv);
 
     uint8_t *dst = const_cast<uint8_t *>(wView.data()[C2PlanarLayout::PLANE_Y]);
     size_t srcYStride = img->stride[VPX_PLANE_Y];
@@ -549,10 +683,20 @@ bool C2SoftVpxDec::outputBuffer(
     const uint8_t *srcY = (const uint8_t *)img->planes[VPX_PLANE_Y];
     const uint8_t *srcU = (const uint8_t *)img->planes[VPX_PLANE_U];
     const uint8_t *srcV = (const uint8_t *)img->planes[VPX_PLANE_V];
-    copyOutputBufferToYV12Frame(dst, srcY, srcU, srcV,
-                                srcYStride, srcUStride, srcVStride, mWidth, mHeight, bpp);
+    if (scale) {
+        if (ImageScale(wView, outWidth, outHeight, srcY, srcU, srcV,
+                       srcYStride, srcUStride, srcVStride, mWidth, mHeight) != OK) {
+            ALOGE("scaling %ux%u to %ux%u failed", mWidth, mHeight, outWidth, outHeight);
+            work->result = C2_CORRUPTED;
+            return false;
+        }
+    } else {
+        copyOutputBufferToYV12Frame(dst, srcY, srcU, srcV,
+                                    srcYStride, srcUStride, srcVStride, mWidth, mHeight, bpp);
+    }
 
-    finishWork(*(int64_t *)img->user_priv, work, std::move(block));
+    finishWork(*(int64_t *)img->user_priv, work, std::move(block),
+               C2Rect(outWidth, outHeight));
     return true;
 }
 
@@ -53,6 +53,11 @@ struct C2SoftVpxDec : public SimpleC2Component {
     std::shared_ptr<IntfImpl> mIntf;
     vpx_codec_ctx_t *mCodecCtx;
     bool mFrameParallelMode;  // Frame parallel is only supported by VP9 decoder.
+    bool mKeyFrameOnly;  // decode only key frames, e.g. for thumbnails
+    uint32_t mScaledWidth;  // requested output size, or 0 to output the decoded size
+    uint32_t mScaledHeight;
+    uint32_t mOutputWidth;  // output size last reported to the client (C2StreamPictureSizeInfo)
+    uint32_t mOutputHeight;
 
     uint32_t mWidth;
     uint32_t mHeight;
@@ -61,8 +66,9 @@ struct C2SoftVpxDec : public SimpleC2Component {
 
     status_t initDecoder();
     status_t destroyDecoder();
+    bool isKeyFrame(const uint8_t *data, size_t size) const;
     void finishWork(uint64_t index, const std::unique_ptr<C2Work> &work,
-                    const std::shared_ptr<C2GraphicBlock> &block);
+                    const std::shared_ptr<C2GraphicBlock> &block, const C2Rect &crop);
     bool outputBuffer(
             const std::shared_ptr<C2BlockPool> &pool,
             const std::unique_ptr<C2Work> &work);
@@ -31,21 +31,6 @@
 
 namespace android {
 
-#if 0
-static size_t getCpuCoreCount() {
-    long cpuCoreCount = 1;
-#if defined(_SC_NPROCESSORS_ONLN)
-    cpuCoreCount = sysconf(_SC_NPROCESSORS_ONLN);
-#else
-    // _SC_NPROC_ONLN must be defined...
-    cpuCoreCount = sysconf(_SC_NPROC_ONLN);
-#endif
-    CHECK(cpuCoreCount >= 1);
-    ALOGV("Number of CPU cores: %ld", cpuCoreCount);
-    return (size_t)cpuCoreCount;
-}
-#endif
-
 C2SoftVpxEnc::C2SoftVpxEnc(const char* name, c2_node_id_t id,
                            const std::shared_ptr<IntfImpl>& intfImpl)
     : SimpleC2Component(
@@ -66,7 +51,12 @@ C2SoftVpxEnc::C2SoftVpxEnc(const char* name, c2_node_id_t id,
       mTemporalPatternIdx(0),
       mLastTimestamp(0x7FFFFFFFFFFFFFFFull),
       mSignalledOutputEos(false),
-      mSignalledError(false) {
+      mSignalledError(false),
+      mNumThreads(1),
+      mNumTileColumns(0),
+      mRowMt(false),
+      mDeadline(VPX_DL_REALTIME),
+      mFastEncoding(false) {
     memset(mTemporalLayerBitrateRatio, 0, sizeof(mTemporalLayerBitrateRatio));
     mTemporalLayerBitrateRatio[0] = 100;
 }
@@ -123,8 +113,36 @@ status_t C2SoftVpxEnc::initEncoder() {
         mFrameRate = mIntf->getFrameRate_l();
         mIntraRefresh = mIntf->getIntraRefresh_l();
         mRequestSync = mIntf->getRequestSync_l();
+        mColorAspects = mIntf->getColorAspects_l();
         mTemporalLayers = mIntf->getTemporalLayers_l()->m.layerCount;
+        mNumThreads = mIntf->getThreadCount_l();
+        mNumTileColumns = mIntf->getTileColumns_l();
+        mRowMt = mIntf->getRowMt_l();
+        mDeadline = mIntf->getDeadline_l() == C2Config::DEADLINE_GOOD_QUALITY
+                ? VPX_DL_GOOD_QUALITY : VPX_DL_REALTIME;
+        mFastEncoding = mIntf->getRealTimePriority_l() < 0
+                || mIntf->getOperatingRate_l() > mFrameRate->value;
+    }
+    if (mFastEncoding) {
+        mDeadline = VPX_DL_REALTIME;
+    }
+
+    if (mNumThreads == 0) {
+        // Smaller frames do not have enough rows (or tiles) to keep many
+        // threads busy, so only use more threads for larger frames.
+        uint64_t pixels = (uint64_t)mSize->width * mSize->height;
+        if (pixels >= 1920 * 1080) {
+            mNumThreads = 8;
+        } else if (pixels >= 1280 * 720) {
+            mNumThreads = 4;
+        } else if (pixels >= 640 * 360) {
+            mNumThreads = 2;
+        } else {
+            mNumThreads = 1;
+        }
+        mNumThreads = c2_min(mNumThreads, (uint32_t)getCoreShare());
     }
+    mNumThreads = c2_min(mNumThreads, (uint32_t)getCpuCoreCount());
 
     switch (mBitrateMode->value) {
         case C2Config::BITRATE_VARIABLE:
@@ -140,9 +158,9 @@ status_t C2SoftVpxEnc::initEncoder() {
     setCodecSpecificInterface();
     if (!mCodecInterface) goto CleanUp;
 
-    ALOGD("VPx: initEncoder. BRMode: %u. TSLayers: %zu. KF: %u. QP: %u - %u",
+    ALOGD("VPx: initEncoder. BRMode: %u. TSLayers: %zu. KF: %u. QP: %u - %u. Threads: %u",
           (uint32_t)mBitrateControlMode, mTemporalLayers, mIntf->getSyncFramePeriod(),
-          mMinQuantizer, mMaxQuantizer);
+          mMinQuantizer, mMaxQuantizer, mNumThreads);
 
     mCodecConfiguration = new vpx_codec_enc_cfg_t;
     if (!mCodecConfiguration) goto CleanUp;
@@ -156,8 +174,7 @@ status_t C2SoftVpxEnc::initEncoder() {
 
     mCodecConfiguration->g_w = mSize->width;
     mCodecConfiguration->g_h = mSize->height;
-    //mCodecConfiguration->g_threads = getCpuCoreCount();
-    mCodecConfiguration->g_threads = 0;
+    mCodecConfiguration->g_threads = mNumThreads;
     mCodecConfiguration->g_error_resilient = mErrorResilience;
 
     // timebase unit is microsecond
@@ -476,7 +493,8 @@ void C2SoftVpxEnc::process(
         case C2PlanarLayout::TYPE_RGB:
         case C2PlanarLayout::TYPE_RGBA: {
             ConvertRGBToPlanarYUV(mConversionBuffer.data(), stride, vstride,
-                                  mConversionBuffer.size(), *rView.get());
+                                  mConversionBuffer.size(), *rView.get(),
+                                  mColorAspects->matrix, mColorAspects->range);
             vpx_img_wrap(&raw_frame, VPX_IMG_FMT_I420, width, height,
                          mStrideAlign, mConversionBuffer.data());
             break;
@@ -499,6 +517,32 @@ void C2SoftVpxEnc::process(
                 raw_frame.stride[0] = layout.planes[layout.PLANE_Y].rowInc;
                 raw_frame.stride[1] = layout.planes[layout.PLANE_U].rowInc;
                 raw_frame.stride[2] = layout.planes[layout.PLANE_V].rowInc;
+            } else if (layout.planes[layout.PLANE_Y].colInc == 1
+                    && (IsNV12(*rView) || IsNV21(*rView))
+                    && mConversionBuffer.size() >= stride * vstride * 3 / 2) {
+                // semi-planar - use luma in place and only deinterleave chroma,
+                // as libvpx takes planar input
+                uint8_t *dstU = mConversionBuffer.data() + stride * vstride;
+                uint8_t *dstV = dstU + (stride / 2) * (vstride / 2);
+                vpx_img_wrap(&raw_frame, VPX_IMG_FMT_I420, width, height,
+                             mStrideAlign, (uint8_t*)rView->data()[0]);
+                raw_frame.planes[1] = dstU;
+                raw_frame.planes[2] = dstV;
+                raw_frame.stride[0] = layout.planes[layout.PLANE_Y].rowInc;
+                raw_frame.stride[1] = raw_frame.stride[2] = stride / 2;
+                const uint8_t *srcU = rView->data()[1];
+                const uint8_t *srcV = rView->data()[2];
+                int32_t srcStride = layout.planes[layout.PLANE_U].rowInc;
+                for (uint32_t row = 0; row < (height + 1) / 2; ++row) {
+                    for (uint32_t col = 0; col < (width + 1) / 2; ++col) {
+                        dstU[col] = srcU[2 * col];
+                        dstV[col] = srcV[2 * col];
+                    }
+                    srcU += srcStride;
+                    srcV += srcStride;
+                    dstU += stride / 2;
+                    dstV += stride / 2;
+                }
             } else {
                 // copy to I420
                 MediaImage2 img = CreateYUV420PlanarMediaImage2(width, height, stride, vstride);
@@ -510,7 +554,7 @@ void C2SoftVpxEnc::process(
                         return;
                     }
                     vpx_img_wrap(&raw_frame, VPX_IMG_FMT_I420, stride, vstride,
-                                 mStrideAlign, (uint8_t*)rView->data()[0]);
+                                 mStrideAlign, mConversionBuffer.data());
                     vpx_img_set_rect(&raw_frame, 0, 0, width, height);
                 } else {
                     ALOGE("Conversion buffer is too small: %u x %u for %zu",
@@ -586,7 +630,7 @@ void C2SoftVpxEnc::process(
     vpx_codec_err_t codec_return = vpx_codec_encode(mCodecContext, &raw_frame,
                                                     inputTimeStamp,
                                                     frameDuration, flags,
-                                                    VPX_DL_REALTIME);
+                                                    mDeadline);
     if (codec_return != VPX_CODEC_OK) {
         ALOGE("vpx encoder failed to encode frame");
         work->result = C2_CORRUPTED;
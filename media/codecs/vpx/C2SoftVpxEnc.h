@@ -55,15 +55,17 @@ typedef enum TemporalPatternType {
 //    - frame rate
 //    - error resilience
 //    - reconstruction & loop filters (g_profile)
+//    - encoding deadline (realtime / good quality)
+//    - operating rate & priority (background or faster than realtime
+// encoding uses the fastest settings)
+//    - thread count (by default based on the frame size, limited to the
+// cpu's available to the component)
 //
 // Only following color formats are recognized
 //    - C2PlanarLayout::TYPE_RGB
 //    - C2PlanarLayout::TYPE_RGBA
 //
 // Following settings are not configurable by the client
-//    - encoding deadline is realtime
-//    - multithreaded encoding utilizes a number of threads equal
-// to online cpu's available
 //    - the algorithm interface for encoder is decided by the sub-class in use
 //    - fractional bits of frame rate is discarded
 //    - timestamps are in microseconds, therefore encoder timebase is fixed
@@ -210,6 +212,24 @@ struct C2SoftVpxEnc : public SimpleC2Component {
      // Signalled Error
      bool mSignalledError;
 
+     // Number of threads used by the encoder
+     uint32_t mNumThreads;
+
+     // Requested number of tile columns, 0 if chosen by the sub-class
+     uint32_t mNumTileColumns;
+
+     // Parameter that denotes whether row based multi-threading
+     // is enabled in encoder
+     bool mRowMt;
+
+     // Encoding deadline passed to vpx_codec_encode()
+     unsigned long mDeadline;
+
+     // Parameter that denotes whether the encoder should use its fastest
+     // (and cheapest) settings, for background encoding or for encoding
+     // faster than real time
+     bool mFastEncoding;
+
     // configurations used by component in process
     // (TODO: keep this in intf but make them internal only)
     std::shared_ptr<C2StreamPictureSizeInfo::input> mSize;
@@ -218,6 +238,7 @@ struct C2SoftVpxEnc : public SimpleC2Component {
     std::shared_ptr<C2StreamBitrateInfo::output> mBitrate;
     std::shared_ptr<C2StreamBitrateModeTuning::output> mBitrateMode;
     std::shared_ptr<C2StreamRequestSyncFrameTuning::output> mRequestSync;
+    std::shared_ptr<C2StreamColorAspectsInfo::input> mColorAspects;
 
      C2_DO_NOT_COPY(C2SoftVpxEnc);
 };
@@ -344,6 +365,77 @@ class C2SoftVpxEnc::IntfImpl : public C2InterfaceHelper {
                 .withFields({C2F(mRequestSync, value).oneOf({ C2_FALSE, C2_TRUE }) })
                 .withSetter(Setter<decltype(*mRequestSync)>::NonStrictValueWithNoDeps)
                 .build());
+
+        addParameter(
+                DefineParam(mThreadCount, C2_PARAMKEY_THREAD_COUNT)
+                .withDefault(new C2ThreadCountTuning(0u))
+                .withFields({C2F(mThreadCount, value).any()})
+                .withSetter(Setter<decltype(*mThreadCount)>::NonStrictValueWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mDeadline, C2_PARAMKEY_ENCODING_DEADLINE)
+                .withDefault(new C2EncodingDeadlineTuning(C2Config::DEADLINE_REALTIME))
+                .withFields({C2F(mDeadline, value).oneOf({
+                        C2Config::DEADLINE_REALTIME, C2Config::DEADLINE_GOOD_QUALITY })})
+                .withSetter(Setter<decltype(*mDeadline)>::NonStrictValueWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mOperatingRate, C2_PARAMKEY_OPERATING_RATE)
+                .withDefault(new C2OperatingRateTuning(0.))
+                .withFields({C2F(mOperatingRate, value).any()})
+                .withSetter(Setter<decltype(*mOperatingRate)>::NonStrictValueWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mRealTimePriority, C2_PARAMKEY_PRIORITY)
+                .withDefault(new C2RealTimePriorityTuning(0))
+                .withFields({C2F(mRealTimePriority, value).any()})
+                .withSetter(Setter<decltype(*mRealTimePriority)>::NonStrictValueWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mCpuAffinity, C2_PARAMKEY_CPU_AFFINITY)
+                .withDefault(C2CpuAffinityTuning::AllocShared(0u))
+                .withFields({ C2F(mCpuAffinity, m.values[0]).any(),
+                              C2F(mCpuAffinity, m.values).any() })
+                .withSetter(Setter<C2CpuAffinityTuning>::NonStrictValuesWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mColorAspects, C2_PARAMKEY_COLOR_ASPECTS)
+                .withDefault(new C2StreamColorAspectsInfo::input(
+                        0u, C2Color::RANGE_UNSPECIFIED, C2Color::PRIMARIES_UNSPECIFIED,
+                        C2Color::TRANSFER_UNSPECIFIED, C2Color::MATRIX_UNSPECIFIED))
+                .withFields({
+                    C2F(mColorAspects, range).inRange(
+                                C2Color::RANGE_UNSPECIFIED,     C2Color::RANGE_OTHER),
+                    C2F(mColorAspects, primaries).inRange(
+                                C2Color::PRIMARIES_UNSPECIFIED, C2Color::PRIMARIES_OTHER),
+                    C2F(mColorAspects, transfer).inRange(
+                                C2Color::TRANSFER_UNSPECIFIED,  C2Color::TRANSFER_OTHER),
+                    C2F(mColorAspects, matrix).inRange(
+                                C2Color::MATRIX_UNSPECIFIED,    C2Color::MATRIX_OTHER)
+                })
+                .withSetter(ColorAspectsSetter)
+                .build());
+
+#ifdef VP9
+        addParameter(
+                DefineParam(mTileColumns, C2_PARAMKEY_TILE_COLUMNS)
+                .withDefault(new C2TileColumnsTuning(0u))
+                .withFields({C2F(mTileColumns, value).inRange(0, 64)})
+                .withSetter(Setter<decltype(*mTileColumns)>::NonStrictValueWithNoDeps)
+                .build());
+
+        addParameter(
+                DefineParam(mRowMt, C2_PARAMKEY_ROW_MULTI_THREADING)
+                .withDefault(new C2RowMultiThreadingTuning(C2_TRUE))
+                .withFields({C2F(mRowMt, value).oneOf({ C2_FALSE, C2_TRUE })})
+                .withSetter(Setter<decltype(*mRowMt)>::NonStrictValueWithNoDeps)
+                .build());
+#endif
     }
 
     static C2R BitrateSetter(bool mayBlock, C2P<C2StreamBitrateInfo::output> &me) {
@@ -399,6 +491,23 @@ class C2SoftVpxEnc::IntfImpl : public C2InterfaceHelper {
         return res;
     }
 
+    static C2R ColorAspectsSetter(bool mayBlock, C2P<C2StreamColorAspectsInfo::input> &me) {
+        (void)mayBlock;
+        if (me.v.range > C2Color::RANGE_OTHER) {
+                me.set().range = C2Color::RANGE_OTHER;
+        }
+        if (me.v.primaries > C2Color::PRIMARIES_OTHER) {
+                me.set().primaries = C2Color::PRIMARIES_OTHER;
+        }
+        if (me.v.transfer > C2Color::TRANSFER_OTHER) {
+                me.set().transfer = C2Color::TRANSFER_OTHER;
+        }
+        if (me.v.matrix > C2Color::MATRIX_OTHER) {
+                me.set().matrix = C2Color::MATRIX_OTHER;
+        }
+        return C2R::Ok();
+    }
+
     // unsafe getters
     std::shared_ptr<C2StreamPictureSizeInfo::input> getSize_l() const { return mSize; }
     std::shared_ptr<C2StreamIntraRefreshTuning::output> getIntraRefresh_l() const { return mIntraRefresh; }
@@ -407,6 +516,18 @@ class C2SoftVpxEnc::IntfImpl : public C2InterfaceHelper {
     std::shared_ptr<C2StreamBitrateModeTuning::output> getBitrateMode_l() const { return mBitrateMode; }
     std::shared_ptr<C2StreamRequestSyncFrameTuning::output> getRequestSync_l() const { return mRequestSync; }
     std::shared_ptr<C2StreamTemporalLayeringTuning::output> getTemporalLayers_l() const { return mLayering; }
+    uint32_t getThreadCount_l() const { return mThreadCount->value; }
+    C2Config::encoding_deadline_t getDeadline_l() const { return mDeadline->value; }
+    float getOperatingRate_l() const { return mOperatingRate->value; }
+    int32_t getRealTimePriority_l() const { return mRealTimePriority->value; }
+    std::shared_ptr<C2StreamColorAspectsInfo::input> getColorAspects_l() const { return mColorAspects; }
+#ifdef VP9
+    uint32_t getTileColumns_l() const { return mTileColumns->value; }
+    bool getRowMt_l() const { return mRowMt->value == C2_TRUE; }
+#else
+    uint32_t getTileColumns_l() const { return 0; }
+    bool getRowMt_l() const { return false; }
+#endif
     uint32_t getSyncFramePeriod() const {
         if (mSyncFramePeriod->value < 0 || mSyncFramePeriod->value == INT64_MAX) {
             return 0;
@@ -430,6 +551,16 @@ class C2SoftVpxEnc::IntfImpl : public C2InterfaceHelper {
     std::shared_ptr<C2BitrateTuning::output> mBitrate;
     std::shared_ptr<C2StreamBitrateModeTuning::output> mBitrateMode;
     std::shared_ptr<C2StreamProfileLevelInfo::output> mProfileLevel;
+    std::shared_ptr<C2ThreadCountTuning> mThreadCount;
+    std::shared_ptr<C2EncodingDeadlineTuning> mDeadline;
+    std::shared_ptr<C2OperatingRateTuning> mOperatingRate;
+    std::shared_ptr<C2RealTimePriorityTuning> mRealTimePriority;
+    std::shared_ptr<C2CpuAffinityTuning> mCpuAffinity;
+    std::shared_ptr<C2StreamColorAspectsInfo::input> mColorAspects;
+#ifdef VP9
+    std::shared_ptr<C2TileColumnsTuning> mTileColumns;
+    std::shared_ptr<C2RowMultiThreadingTuning> mRowMt;
+#endif
 };
 
 }  // namespace android
@@ -17,7 +17,11 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "CCodecBufferChannel"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 
+#include <algorithm>
+#include <array>
+#include <deque>
 #include <numeric>
 
 #include <C2AllocatorGralloc.h>
@@ -33,6 +37,7 @@
 #include <media/openmax/OMX_Core.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ALookup.h>
+#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/AUtils.h>
 #include <media/stagefright/foundation/hexdump.h>
@@ -43,6 +48,7 @@
 
 #include "CCodecBufferChannel.h"
 #include "Codec2Buffer.h"
+#include "Codec2Mapper.h"
 #include "SkipCutBuffer.h"
 
 namespace android {
@@ -163,7 +169,9 @@ private:
 class CCodecBufferChannel::OutputBuffers : public CCodecBufferChannel::Buffers {
 public:
     OutputBuffers(const char *componentName, const char *name = "Output")
-        : Buffers(componentName, name) { }
+        : Buffers(componentName, name),
+          mEncoding(C2Config::PCM_16),
+          mMaxBufferSize(0u) { }
     virtual ~OutputBuffers() = default;
 
     /**
@@ -207,19 +215,37 @@ public:
     virtual std::unique_ptr<OutputBuffers> toArrayMode(size_t size) = 0;
 
     /**
-     * Initialize SkipCutBuffer object.
+     * Initialize SkipCutBuffer object. |maxBufferSize| is the maximum size of
+     * output buffers from the component, or 0 if unknown.
      */
     void initSkipCutBuffer(
-            int32_t delay, int32_t padding, int32_t sampleRate, int32_t channelCount) {
+            int32_t delay, int32_t padding, int32_t sampleRate, int32_t channelCount,
+            C2Config::pcm_encoding_t encoding, size_t maxBufferSize) {
         CHECK(mSkipCutBuffer == nullptr);
         mDelay = delay;
         mPadding = padding;
         mSampleRate = sampleRate;
+        mEncoding = encoding;
+        mMaxBufferSize = maxBufferSize;
         setSkipCutBuffer(delay, padding, channelCount);
     }
 
     /**
      * Update the SkipCutBuffer object. No-op if it's never initialized.
+     * |pcmEncoding| is the SDK PCM encoding of the output; the previous
+     * encoding is kept if it is not recognized.
+     */
+    void updateSkipCutBuffer(int32_t sampleRate, int32_t channelCount, int32_t pcmEncoding) {
+        C2Config::pcm_encoding_t encoding;
+        if (mSkipCutBuffer != nullptr && C2Mapper::map(pcmEncoding, &encoding)) {
+            mEncoding = encoding;
+        }
+        updateSkipCutBuffer(sampleRate, channelCount);
+    }
+
+    /**
+     * Update the SkipCutBuffer object, keeping the PCM encoding. No-op if it's
+     * never initialized.
      */
     void updateSkipCutBuffer(int32_t sampleRate, int32_t channelCount) {
         if (mSkipCutBuffer == nullptr) {
@@ -257,6 +283,19 @@ private:
     int32_t mDelay;
     int32_t mPadding;
     int32_t mSampleRate;
+    C2Config::pcm_encoding_t mEncoding;
+    size_t mMaxBufferSize;
+
+    static size_t GetSampleSize(C2Config::pcm_encoding_t encoding) {
+        switch (encoding) {
+            case C2Config::PCM_8:       return 1;
+            case C2Config::PCM_24:      return 3;
+            case C2Config::PCM_32:
+            case C2Config::PCM_FLOAT:   return 4;
+            case C2Config::PCM_16:
+            default:                    return 2;
+        }
+    }
 
     void setSkipCutBuffer(int32_t skip, int32_t cut, int32_t channelCount) {
         if (mSkipCutBuffer != nullptr) {
@@ -265,7 +304,13 @@ private:
                 ALOGD("[%s] Replacing SkipCutBuffer holding %zu bytes", mName, prevSize);
             }
         }
-        mSkipCutBuffer = new SkipCutBuffer(skip, cut, channelCount);
+        if (channelCount <= 0) {
+            ALOGD("[%s] Invalid channel count %d; not skipping/cutting", mName, channelCount);
+            mSkipCutBuffer = nullptr;
+            return;
+        }
+        mSkipCutBuffer = new SkipCutBuffer(
+                skip, cut, channelCount * GetSampleSize(mEncoding), mMaxBufferSize);
     }
 
     DISALLOW_EVIL_CONSTRUCTORS(OutputBuffers);
@@ -276,15 +321,24 @@ namespace {
 // TODO: get this info from component
 const static size_t kMinInputBufferArraySize = 8;
 const static size_t kMaxPipelineCapacity = 18;
+// lower bound of the adaptive component capacity
+const static size_t kMinPipelineCapacity = 4;
 const static size_t kChannelOutputDelay = 0;
 const static size_t kMinOutputBufferArraySize = kMaxPipelineCapacity +
                                                 kChannelOutputDelay;
 const static size_t kLinearBufferSize = 1048576;
 // This can fit 4K RGBA frame, and most likely client won't need more than this.
 const static size_t kMaxLinearBufferSize = 3840 * 2160 * 4;
+// Render timestamps more than this far in the past are not render times (e.g. media times).
+const static nsecs_t kMaxRenderLatenessNs = 1000000000ll;
 
 /**
- * Simple local buffer pool backed by std::vector.
+ * Simple local buffer pool backed by heap memory.
+ *
+ * Buffers are rounded up to size classes, four per power of two, and freed buffers are kept in
+ * per-class free lists. Lookup is constant time: a request is served by the most recently freed
+ * buffer of the smallest non-empty class that is at least as large as the request and at most
+ * twice as large. Buffer contents are not initialized.
  */
 class LocalBufferPool : public std::enable_shared_from_this<LocalBufferPool> {
 public:
@@ -308,85 +362,183 @@ public:
      */
     sp<ABuffer> newBuffer(size_t capacity) {
         Mutex::Autolock lock(mMutex);
-        auto it = std::find_if(
-                mPool.begin(), mPool.end(),
-                [capacity](const std::vector<uint8_t> &vec) {
-                    return vec.capacity() >= capacity;
-                });
-        if (it != mPool.end()) {
-            sp<ABuffer> buffer = new VectorBuffer(std::move(*it), shared_from_this());
-            mPool.erase(it);
-            return buffer;
+        size_t sizeClass = ClassOf(capacity);
+        if (sizeClass < kNumClasses) {
+            // smallest non-empty class within [sizeClass, sizeClass + kClassesPerOctave)
+            uint64_t candidates = (mNonEmptyClasses >> sizeClass)
+                    & ((1ull << kClassesPerOctave) - 1);
+            if (candidates) {
+                size_t found = sizeClass + __builtin_ctzll(candidates);
+                std::deque<std::unique_ptr<uint8_t[]>> &freeList = mFreeLists[found];
+                std::unique_ptr<uint8_t[]> data = std::move(freeList.back());
+                freeList.pop_back();
+                if (freeList.empty()) {
+                    mNonEmptyClasses &= ~(1ull << found);
+                }
+                mLastUsed[found] = ++mTick;
+                return new HeapBuffer(std::move(data), found, shared_from_this());
+            }
+            capacity = SizeOf(sizeClass);
         }
         if (mUsedSize + capacity > mPoolCapacity) {
-            while (!mPool.empty()) {
-                mUsedSize -= mPool.back().capacity();
-                mPool.pop_back();
-            }
+            evict(mUsedSize + capacity - mPoolCapacity);
             if (mUsedSize + capacity > mPoolCapacity) {
                 ALOGD("mUsedSize = %zu, capacity = %zu, mPoolCapacity = %zu",
                         mUsedSize, capacity, mPoolCapacity);
                 return nullptr;
             }
         }
-        std::vector<uint8_t> vec(capacity);
-        mUsedSize += vec.capacity();
-        return new VectorBuffer(std::move(vec), shared_from_this());
+        // NOTE: intentionally not value-initialized
+        std::unique_ptr<uint8_t[]> data(new (std::nothrow) uint8_t[capacity]);
+        if (!data) {
+            ALOGD("failed to allocate %zu bytes", capacity);
+            return nullptr;
+        }
+        mUsedSize += capacity;
+        if (sizeClass < kNumClasses) {
+            mLastUsed[sizeClass] = ++mTick;
+        }
+        return new HeapBuffer(std::move(data), capacity, sizeClass, shared_from_this());
     }
 
 private:
+    enum : size_t {
+        kMinClassSizeLog2 = 12,   ///< smallest class is 4KB
+        kClassesPerOctave = 4,
+        kNumClasses = 64,         ///< largest class is 224MB; larger buffers are not recycled
+    };
+
     /**
-     * ABuffer backed by std::vector.
+     * Returns the smallest size class that fits |capacity| bytes, or kNumClasses if |capacity|
+     * is larger than the largest class.
      */
-    class VectorBuffer : public ::android::ABuffer {
+    static size_t ClassOf(size_t capacity) {
+        if (capacity <= (1u << kMinClassSizeLog2)) {
+            return 0;
+        }
+        // 2^octave < capacity <= 2^(octave + 1)
+        size_t octave = 63 - __builtin_clzll(capacity - 1);
+        size_t step = size_t(1) << (octave - 2);
+        size_t sub = (capacity - (size_t(1) << octave) + step - 1) / step;
+        size_t sizeClass = (octave - kMinClassSizeLog2) * kClassesPerOctave + sub;
+        return std::min(sizeClass, size_t(kNumClasses));
+    }
+
+    /**
+     * Returns the size of buffers in |sizeClass|.
+     */
+    static size_t SizeOf(size_t sizeClass) {
+        if (sizeClass == 0) {
+            return 1u << kMinClassSizeLog2;
+        }
+        size_t octave = kMinClassSizeLog2 + (sizeClass - 1) / kClassesPerOctave;
+        size_t sub = (sizeClass - 1) % kClassesPerOctave + 1;
+        return (size_t(1) << octave) + sub * (size_t(1) << (octave - 2));
+    }
+
+    /**
+     * ABuffer backed by memory owned by a LocalBufferPool.
+     */
+    class HeapBuffer : public ::android::ABuffer {
     public:
         /**
-         * Construct a VectorBuffer by taking the ownership of supplied vector.
+         * Construct a HeapBuffer by taking the ownership of supplied memory.
          *
-         * \param vec   backing vector of the buffer. this object takes
-         *              ownership at construction.
-         * \param pool  a LocalBufferPool object to return the vector at
-         *              destruction.
+         * \param data      backing memory of the buffer. this object takes
+         *                  ownership at construction.
+         * \param capacity  size of |data|.
+         * \param sizeClass size class of |data|, or kNumClasses if it is not
+         *                  to be recycled.
+         * \param pool      a LocalBufferPool object to return the memory at
+         *                  destruction.
          */
-        VectorBuffer(std::vector<uint8_t> &&vec, const std::shared_ptr<LocalBufferPool> &pool)
-            : ABuffer(vec.data(), vec.capacity()),
-              mVec(std::move(vec)),
+        HeapBuffer(
+                std::unique_ptr<uint8_t[]> &&data, size_t capacity, size_t sizeClass,
+                const std::shared_ptr<LocalBufferPool> &pool)
+            : ABuffer(data.get(), capacity),
+              mData(std::move(data)),
+              mCapacity(capacity),
+              mSizeClass(sizeClass),
               mPool(pool) {
         }
 
-        ~VectorBuffer() override {
+        HeapBuffer(
+                std::unique_ptr<uint8_t[]> &&data, size_t sizeClass,
+                const std::shared_ptr<LocalBufferPool> &pool)
+            : HeapBuffer(std::move(data), SizeOf(sizeClass), sizeClass, pool) {
+        }
+
+        ~HeapBuffer() override {
             std::shared_ptr<LocalBufferPool> pool = mPool.lock();
             if (pool) {
-                // If pool is alive, return the vector back to the pool so that
+                // If pool is alive, return the memory back to the pool so that
                 // it can be recycled.
-                pool->returnVector(std::move(mVec));
+                pool->returnMemory(std::move(mData), mCapacity, mSizeClass);
             }
         }
 
     private:
-        std::vector<uint8_t> mVec;
+        std::unique_ptr<uint8_t[]> mData;
+        size_t mCapacity;
+        size_t mSizeClass;
         std::weak_ptr<LocalBufferPool> mPool;
     };
 
     Mutex mMutex;
     size_t mPoolCapacity;
     size_t mUsedSize;
-    std::list<std::vector<uint8_t>> mPool;
+    std::array<std::deque<std::unique_ptr<uint8_t[]>>, kNumClasses> mFreeLists;
+    std::array<uint64_t, kNumClasses> mLastUsed; ///< last time a buffer of a class was used
+    uint64_t mNonEmptyClasses; ///< bit mask of classes with free buffers
+    uint64_t mTick;
 
     /**
      * Private constructor to prevent constructing non-managed LocalBufferPool.
      */
     explicit LocalBufferPool(size_t poolCapacity)
-        : mPoolCapacity(poolCapacity), mUsedSize(0) {
+        : mPoolCapacity(poolCapacity), mUsedSize(0), mNonEmptyClasses(0), mTick(0) {
+        mLastUsed.fill(0);
     }
 
     /**
-     * Take back the ownership of vec from the destructed VectorBuffer and put
-     * it in front of the pool.
+     * Free at least |size| bytes of unused buffers, starting with the oldest buffers of the
+     * least recently used classes. Must be called with mMutex held.
      */
-    void returnVector(std::vector<uint8_t> &&vec) {
+    void evict(size_t size) {
+        size_t freed = 0;
+        while (freed < size && mNonEmptyClasses) {
+            size_t lru = kNumClasses;
+            for (uint64_t mask = mNonEmptyClasses; mask; mask &= mask - 1) {
+                size_t sizeClass = __builtin_ctzll(mask);
+                if (lru == kNumClasses || mLastUsed[sizeClass] < mLastUsed[lru]) {
+                    lru = sizeClass;
+                }
+            }
+            std::deque<std::unique_ptr<uint8_t[]>> &freeList = mFreeLists[lru];
+            while (freed < size && !freeList.empty()) {
+                freeList.pop_front();
+                freed += SizeOf(lru);
+            }
+            if (freeList.empty()) {
+                mNonEmptyClasses &= ~(1ull << lru);
+            }
+        }
+        mUsedSize -= std::min(freed, mUsedSize);
+    }
+
+    /**
+     * Take back the ownership of memory from the destructed HeapBuffer and put
+     * it on the free list of its class.
+     */
+    void returnMemory(std::unique_ptr<uint8_t[]> &&data, size_t capacity, size_t sizeClass) {
         Mutex::Autolock lock(mMutex);
-        mPool.push_front(std::move(vec));
+        if (sizeClass >= kNumClasses) {
+            data.reset();
+            mUsedSize -= std::min(capacity, mUsedSize);
+            return;
+        }
+        mFreeLists[sizeClass].push_back(std::move(data));
+        mNonEmptyClasses |= 1ull << sizeClass;
     }
 
     DISALLOW_EVIL_CONSTRUCTORS(LocalBufferPool);
@@ -420,6 +572,127 @@ sp<GraphicBlockBuffer> AllocateGraphicBuffer(
             });
 }
 
+/**
+ * Index from lookup keys (buffer pointers) to buffer slots. It is an open addressing hash table
+ * with linear probing over a flat array, so lookups take constant time, and nothing is
+ * allocated once the table has grown to the number of slots. Null keys are never indexed.
+ */
+template<typename T>
+class SlotIndex {
+public:
+    SlotIndex() : mCount(0) { }
+
+    /**
+     * Returns the slot of |key|, or |notFound| if |key| is null or not indexed.
+     */
+    size_t find(const T *key, size_t notFound) const {
+        if (key == nullptr || mEntries.empty()) {
+            return notFound;
+        }
+        for (size_t i = bucket(key); mEntries[i].key != nullptr; i = next(i)) {
+            if (mEntries[i].key == key) {
+                return mEntries[i].slot;
+            }
+        }
+        return notFound;
+    }
+
+    /**
+     * Maps |key| to |slot|, replacing its previous slot. Null keys are ignored.
+     */
+    void insert(const T *key, size_t slot) {
+        if (key == nullptr) {
+            return;
+        }
+        if ((mCount + 1) * 2 > mEntries.size()) {
+            grow();
+        }
+        size_t i = bucket(key);
+        for (; mEntries[i].key != nullptr; i = next(i)) {
+            if (mEntries[i].key == key) {
+                mEntries[i].slot = slot;
+                return;
+            }
+        }
+        mEntries[i] = { key, slot };
+        ++mCount;
+    }
+
+    /**
+     * Removes |key| if it maps to |slot|. The key may have been reused by a newer buffer in
+     * another slot, in which case it is kept.
+     */
+    void erase(const T *key, size_t slot) {
+        if (key == nullptr || mEntries.empty()) {
+            return;
+        }
+        size_t hole = bucket(key);
+        for (; mEntries[hole].key != key; hole = next(hole)) {
+            if (mEntries[hole].key == nullptr) {
+                return;
+            }
+        }
+        if (mEntries[hole].slot != slot) {
+            return;
+        }
+        // Move back the entries after the hole that cannot be found past it anymore.
+        for (size_t i = next(hole); mEntries[i].key != nullptr; i = next(i)) {
+            size_t home = bucket(mEntries[i].key);
+            bool reachable = (hole <= i) ? (hole < home && home <= i) : (hole < home || home <= i);
+            if (!reachable) {
+                mEntries[hole] = mEntries[i];
+                hole = i;
+            }
+        }
+        mEntries[hole] = { nullptr, 0 };
+        --mCount;
+    }
+
+    void clear() {
+        std::fill(mEntries.begin(), mEntries.end(), Entry{ nullptr, 0 });
+        mCount = 0;
+    }
+
+private:
+    struct Entry {
+        const T *key;
+        size_t slot;
+    };
+
+    size_t bucket(const T *key) const {
+        // Fibonacci hashing of the address; its low bits are alignment.
+        uint64_t hash = uint64_t(reinterpret_cast<uintptr_t>(key)) * 0x9E3779B97F4A7C15ull;
+        return size_t(hash >> 32) & (mEntries.size() - 1);
+    }
+
+    size_t next(size_t i) const {
+        return (i + 1) & (mEntries.size() - 1);
+    }
+
+    void grow() {
+        std::vector<Entry> entries(std::max(mEntries.size() * 2, size_t(16)), Entry{ nullptr, 0 });
+        entries.swap(mEntries);
+        mCount = 0;
+        for (const Entry &entry : entries) {
+            if (entry.key != nullptr) {
+                insert(entry.key, entry.slot);
+            }
+        }
+    }
+
+    std::vector<Entry> mEntries; ///< size is a power of 2, and at least twice mCount
+    size_t mCount;
+};
+
+/**
+ * Removes the |i|-th entry from the list of free slots in constant time. This does not keep
+ * the order of the list.
+ */
+void TakeFreeSlot(std::vector<size_t> *freeSlots, size_t i) {
+    (*freeSlots)[i] = freeSlots->back();
+    freeSlots->pop_back();
+}
+
 class BuffersArrayImpl;
 
 /**
@@ -439,15 +712,22 @@ public:
      * \return            index of the assigned slot.
      */
     size_t assignSlot(const sp<Codec2Buffer> &buffer) {
-        for (size_t i = 0; i < mBuffers.size(); ++i) {
-            if (mBuffers[i].clientBuffer == nullptr
-                    && mBuffers[i].compBuffer.expired()) {
-                mBuffers[i].clientBuffer = buffer;
-                return i;
+        size_t index = mBuffers.size();
+        for (size_t i = 0; i < mFreeSlots.size(); ++i) {
+            if (mBuffers[mFreeSlots[i]].compBuffer.expired()) {
+                index = mFreeSlots[i];
+                TakeFreeSlot(&mFreeSlots, i);
+                break;
             }
         }
-        mBuffers.push_back({ buffer, std::weak_ptr<C2Buffer>() });
-        return mBuffers.size() - 1;
+        if (index == mBuffers.size()) {
+            mBuffers.push_back({ buffer, std::weak_ptr<C2Buffer>() });
+            mCompKeys.push_back(nullptr);
+        } else {
+            mBuffers[index].clientBuffer = buffer;
+        }
+        mClientSlots.insert(buffer.get(), index);
+        return index;
     }
 
     /**
@@ -465,26 +745,21 @@ public:
             const sp<MediaCodecBuffer> &buffer,
             std::shared_ptr<C2Buffer> *c2buffer,
             bool release) {
-        sp<Codec2Buffer> clientBuffer;
-        size_t index = mBuffers.size();
-        for (size_t i = 0; i < mBuffers.size(); ++i) {
-            if (mBuffers[i].clientBuffer == buffer) {
-                clientBuffer = mBuffers[i].clientBuffer;
-                if (release) {
-                    mBuffers[i].clientBuffer.clear();
-                }
-                index = i;
-                break;
-            }
-        }
-        if (clientBuffer == nullptr) {
+        size_t index = mClientSlots.find(buffer.get(), mBuffers.size());
+        if (index == mBuffers.size()) {
             ALOGV("[%s] %s: No matching buffer found", mName, __func__);
             return false;
         }
+        sp<Codec2Buffer> clientBuffer = mBuffers[index].clientBuffer;
+        if (release) {
+            mBuffers[index].clientBuffer.clear();
+            mClientSlots.erase(buffer.get(), index);
+            mFreeSlots.push_back(index);
+        }
         std::shared_ptr<C2Buffer> result = mBuffers[index].compBuffer.lock();
         if (!result) {
             result = clientBuffer->asC2Buffer();
-            mBuffers[index].compBuffer = result;
+            setComponentBuffer(index, result);
         }
         if (c2buffer) {
             *c2buffer = result;
@@ -493,14 +768,10 @@ public:
     }
 
     bool expireComponentBuffer(const std::shared_ptr<C2Buffer> &c2buffer) {
-        for (size_t i = 0; i < mBuffers.size(); ++i) {
-            std::shared_ptr<C2Buffer> compBuffer =
-                    mBuffers[i].compBuffer.lock();
-            if (!compBuffer || compBuffer != c2buffer) {
-                continue;
-            }
-            mBuffers[i].compBuffer.reset();
-            ALOGV("[%s] codec released buffer #%zu", mName, i);
+        size_t index = findComponentSlot(c2buffer);
+        if (index < mBuffers.size()) {
+            setComponentBuffer(index, nullptr);
+            ALOGV("[%s] codec released buffer #%zu", mName, index);
             return true;
         }
         ALOGV("[%s] codec released an unknown buffer", mName);
@@ -510,11 +781,35 @@ public:
     void flush() {
         ALOGV("[%s] buffers are flushed %zu", mName, mBuffers.size());
         mBuffers.clear();
+        mFreeSlots.clear();
+        mClientSlots.clear();
+        mCompSlots.clear();
+        mCompKeys.clear();
     }
 
 private:
     friend class BuffersArrayImpl;
 
+    /**
+     * Returns the slot of |c2buffer|, or |mBuffers.size()| if it is not tracked. The key of a
+     * component buffer stays in place after the buffer expires, so it is verified against the
+     * weak reference of the slot.
+     */
+    size_t findComponentSlot(const std::shared_ptr<C2Buffer> &c2buffer) const {
+        size_t index = mCompSlots.find(c2buffer.get(), mBuffers.size());
+        if (index < mBuffers.size() && mBuffers[index].compBuffer.lock() == c2buffer) {
+            return index;
+        }
+        return mBuffers.size();
+    }
+
+    void setComponentBuffer(size_t index, const std::shared_ptr<C2Buffer> &compBuffer) {
+        mCompSlots.erase(mCompKeys[index], index);
+        mBuffers[index].compBuffer = compBuffer;
+        mCompKeys[index] = compBuffer.get();
+        mCompSlots.insert(compBuffer.get(), index);
+    }
+
     std::string mImplName; ///< name for debugging
     const char *mName; ///< C-string version of name
 
@@ -523,6 +818,10 @@ private:
         std::weak_ptr<C2Buffer> compBuffer;
     };
     std::vector<Entry> mBuffers;
+    std::vector<size_t> mFreeSlots; ///< slots released by the client
+    SlotIndex<MediaCodecBuffer> mClientSlots; ///< slot of each client buffer
+    SlotIndex<C2Buffer> mCompSlots; ///< slot of each (possibly expired) component buffer
+    std::vector<const C2Buffer *> mCompKeys; ///< (possibly expired) component buffer of each slot
 };
 
 /**
@@ -555,11 +854,21 @@ public:
             if (!ownedByClient) {
                 clientBuffer = allocate();
             }
-            mBuffers.push_back({ clientBuffer, impl.mBuffers[i].compBuffer, ownedByClient });
+            std::shared_ptr<C2Buffer> compBuffer = impl.mBuffers[i].compBuffer.lock();
+            mBuffers.push_back({ clientBuffer, compBuffer, ownedByClient });
+            mCompKeys.push_back(compBuffer.get());
         }
         ALOGV("[%s] converted %zu buffers to array mode of %zu", mName, mBuffers.size(), minSize);
         for (size_t i = impl.mBuffers.size(); i < minSize; ++i) {
             mBuffers.push_back({ allocate(), std::weak_ptr<C2Buffer>(), false });
+            mCompKeys.push_back(nullptr);
+        }
+        for (size_t i = 0; i < mBuffers.size(); ++i) {
+            mClientSlots.insert(mBuffers[i].clientBuffer.get(), i);
+            mCompSlots.insert(mCompKeys[i], i);
+            if (!mBuffers[i].ownedByClient) {
+                mFreeSlots.push_back(i);
+            }
         }
     }
 
@@ -578,9 +887,10 @@ public:
             sp<Codec2Buffer> *buffer,
             std::function<bool(const sp<Codec2Buffer> &)> match =
                 [](const sp<Codec2Buffer> &) { return true; }) {
-        for (size_t i = 0; i < mBuffers.size(); ++i) {
-            if (!mBuffers[i].ownedByClient && mBuffers[i].compBuffer.expired()
-                    && match(mBuffers[i].clientBuffer)) {
+        for (size_t j = 0; j < mFreeSlots.size(); ++j) {
+            size_t i = mFreeSlots[j];
+            if (mBuffers[i].compBuffer.expired() && match(mBuffers[i].clientBuffer)) {
+                TakeFreeSlot(&mFreeSlots, j);
                 mBuffers[i].ownedByClient = true;
                 *buffer = mBuffers[i].clientBuffer;
                 (*buffer)->meta()->clear();
@@ -607,30 +917,23 @@ public:
             const sp<MediaCodecBuffer> &buffer,
             std::shared_ptr<C2Buffer> *c2buffer,
             bool release) {
-        sp<Codec2Buffer> clientBuffer;
-        size_t index = mBuffers.size();
-        for (size_t i = 0; i < mBuffers.size(); ++i) {
-            if (mBuffers[i].clientBuffer == buffer) {
-                if (!mBuffers[i].ownedByClient) {
-                    ALOGD("[%s] Client returned a buffer it does not own according to our record: %zu", mName, i);
-                }
-                clientBuffer = mBuffers[i].clientBuffer;
-                if (release) {
-                    mBuffers[i].ownedByClient = false;
-                }
-                index = i;
-                break;
-            }
-        }
-        if (clientBuffer == nullptr) {
+        size_t index = mClientSlots.find(buffer.get(), mBuffers.size());
+        if (index == mBuffers.size()) {
             ALOGV("[%s] %s: No matching buffer found", mName, __func__);
             return false;
         }
+        Entry &entry = mBuffers[index];
+        if (!entry.ownedByClient) {
+            ALOGD("[%s] Client returned a buffer it does not own according to our record: %zu", mName, index);
+        } else if (release) {
+            entry.ownedByClient = false;
+            mFreeSlots.push_back(index);
+        }
         ALOGV("[%s] %s: matching buffer found (index=%zu)", mName, __func__, index);
-        std::shared_ptr<C2Buffer> result = mBuffers[index].compBuffer.lock();
+        std::shared_ptr<C2Buffer> result = entry.compBuffer.lock();
         if (!result) {
-            result = clientBuffer->asC2Buffer();
-            mBuffers[index].compBuffer = result;
+            result = entry.clientBuffer->asC2Buffer();
+            setComponentBuffer(index, result);
         }
         if (c2buffer) {
             *c2buffer = result;
@@ -639,22 +942,16 @@ public:
     }
 
     bool expireComponentBuffer(const std::shared_ptr<C2Buffer> &c2buffer) {
-        for (size_t i = 0; i < mBuffers.size(); ++i) {
-            std::shared_ptr<C2Buffer> compBuffer =
-                    mBuffers[i].compBuffer.lock();
-            if (!compBuffer) {
-                continue;
-            }
-            if (c2buffer == compBuffer) {
-                if (mBuffers[i].ownedByClient) {
-                    // This should not happen.
-                    ALOGD("[%s] codec released a buffer owned by client "
-                          "(index %zu)", mName, i);
-                }
-                mBuffers[i].compBuffer.reset();
-                ALOGV("[%s] codec released buffer #%zu(array mode)", mName, i);
-                return true;
+        size_t index = findComponentSlot(c2buffer);
+        if (index < mBuffers.size()) {
+            if (mBuffers[index].ownedByClient) {
+                // This should not happen.
+                ALOGD("[%s] codec released a buffer owned by client "
+                      "(index %zu)", mName, index);
             }
+            setComponentBuffer(index, nullptr);
+            ALOGV("[%s] codec released buffer #%zu(array mode)", mName, index);
+            return true;
         }
         ALOGV("[%s] codec released an unknown buffer (array mode)", mName);
         return false;
@@ -676,12 +973,34 @@ public:
      * The client abandoned all known buffers, so reclaim the ownership.
      */
     void flush() {
-        for (Entry &entry : mBuffers) {
-            entry.ownedByClient = false;
+        mFreeSlots.clear();
+        for (size_t i = 0; i < mBuffers.size(); ++i) {
+            mBuffers[i].ownedByClient = false;
+            mFreeSlots.push_back(i);
         }
     }
 
 private:
+    /**
+     * Returns the slot of |c2buffer|, or |mBuffers.size()| if it is not tracked. The key of a
+     * component buffer stays in place after the buffer expires, so it is verified against the
+     * weak reference of the slot.
+     */
+    size_t findComponentSlot(const std::shared_ptr<C2Buffer> &c2buffer) const {
+        size_t index = mCompSlots.find(c2buffer.get(), mBuffers.size());
+        if (index < mBuffers.size() && mBuffers[index].compBuffer.lock() == c2buffer) {
+            return index;
+        }
+        return mBuffers.size();
+    }
+
+    void setComponentBuffer(size_t index, const std::shared_ptr<C2Buffer> &compBuffer) {
+        mCompSlots.erase(mCompKeys[index], index);
+        mBuffers[index].compBuffer = compBuffer;
+        mCompKeys[index] = compBuffer.get();
+        mCompSlots.insert(compBuffer.get(), index);
+    }
+
     std::string mImplName; ///< name for debugging
     const char *mName; ///< C-string version of name
 
@@ -691,6 +1010,10 @@ private:
         bool ownedByClient;
     };
     std::vector<Entry> mBuffers;
+    std::vector<size_t> mFreeSlots; ///< slots not owned by the client
+    SlotIndex<MediaCodecBuffer> mClientSlots; ///< slot of each client buffer
+    SlotIndex<C2Buffer> mCompSlots; ///< slot of each (possibly expired) component buffer
+    std::vector<const C2Buffer *> mCompKeys; ///< (possibly expired) component buffer of each slot
 };
 
 class InputBuffersArray : public CCodecBufferChannel::InputBuffers {
@@ -1379,109 +1702,248 @@ void CCodecBufferChannel::QueueSync::stop() {
 
 // CCodecBufferChannel::PipelineCapacity
 
+namespace {
+
+// Output release intervals longer than this are pauses (e.g. the client paused
+// playback) and are not taken into account in the average interval.
+constexpr int64_t kMaxOutputIntervalUs = 1000000ll;
+
+// Update the exponentially weighted average |avg| with |value|.
+void UpdateAverage(std::atomic<int64_t> *avg, int64_t value) {
+    int64_t prev = avg->load(std::memory_order_relaxed);
+    avg->store(prev == 0 ? value : prev + (value - prev) / 8, std::memory_order_relaxed);
+}
+
+}  // namespace
+
 CCodecBufferChannel::PipelineCapacity::PipelineCapacity()
-      : input(0), component(0), output(0),
+      : mUsage(0u),
+        mInputLimit(0), mComponentLimit(0), mOutputLimit(0),
+        mComponentMin(0), mComponentMax(0),
+        mPeakHeldWork(0), mWindowPeakHeldWork(0), mWorksInWindow(0),
+        mLowLatency(false),
+        mLatencyUs(0), mOutputIntervalUs(0), mLastOutputUs(0),
         mName("<UNKNOWN COMPONENT>") {
+    for (QueueTime &queueTime : mQueueTimes) {
+        queueTime.frameIndex.store(UINT64_MAX, std::memory_order_relaxed);
+        queueTime.timeUs.store(0, std::memory_order_relaxed);
+    }
 }
 
 void CCodecBufferChannel::PipelineCapacity::initialize(
         int newInput,
-        int newComponent,
+        int newComponentMin,
+        int newComponentMax,
         int newOutput,
         const char* newName,
         const char* callerTag) {
-    input.store(newInput, std::memory_order_relaxed);
-    component.store(newComponent, std::memory_order_relaxed);
-    output.store(newOutput, std::memory_order_relaxed);
+    mUsage.store(0u, std::memory_order_relaxed);
+    mInputLimit.store(newInput, std::memory_order_relaxed);
+    mComponentLimit.store(newComponentMax, std::memory_order_relaxed);
+    mOutputLimit.store(newOutput, std::memory_order_relaxed);
+    mComponentMin.store(newComponentMin, std::memory_order_relaxed);
+    mComponentMax.store(newComponentMax, std::memory_order_relaxed);
+    mPeakHeldWork.store(0, std::memory_order_relaxed);
+    mWindowPeakHeldWork.store(0, std::memory_order_relaxed);
+    mWorksInWindow.store(0, std::memory_order_relaxed);
+    mLowLatency.store(false, std::memory_order_relaxed);
+    mLatencyUs.store(0, std::memory_order_relaxed);
+    mOutputIntervalUs.store(0, std::memory_order_relaxed);
+    mLastOutputUs.store(0, std::memory_order_relaxed);
+    for (QueueTime &queueTime : mQueueTimes) {
+        queueTime.frameIndex.store(UINT64_MAX, std::memory_order_relaxed);
+    }
     mName = newName;
     ALOGV("[%s] %s -- PipelineCapacity::initialize(): "
-          "pipeline availability initialized ==> "
-          "input = %d, component = %d, output = %d",
+          "pipeline limits initialized ==> "
+          "input = %d, component = %d..%d, output = %d",
             mName, callerTag ? callerTag : "*",
-            newInput, newComponent, newOutput);
+            newInput, newComponentMin, newComponentMax, newOutput);
+}
+
+void CCodecBufferChannel::PipelineCapacity::setLowLatency(bool lowLatency) {
+    mLowLatency.store(lowLatency, std::memory_order_relaxed);
+    ALOGV("[%s] PipelineCapacity::setLowLatency(%d)", mName, lowLatency);
 }
 
 bool CCodecBufferChannel::PipelineCapacity::allocate(const char* callerTag) {
-    int prevInput = input.fetch_sub(1, std::memory_order_relaxed);
-    int prevComponent = component.fetch_sub(1, std::memory_order_relaxed);
-    int prevOutput = output.fetch_sub(1, std::memory_order_relaxed);
-    if (prevInput > 0 && prevComponent > 0 && prevOutput > 0) {
-        ALOGV("[%s] %s -- PipelineCapacity::allocate() returns true: "
-              "pipeline availability -1 all ==> "
-              "input = %d, component = %d, output = %d",
-                mName, callerTag ? callerTag : "*",
-                prevInput - 1,
-                prevComponent - 1,
-                prevOutput - 1);
-        return true;
-    }
-    input.fetch_add(1, std::memory_order_relaxed);
-    component.fetch_add(1, std::memory_order_relaxed);
-    output.fetch_add(1, std::memory_order_relaxed);
-    ALOGV("[%s] %s -- PipelineCapacity::allocate() returns false: "
-          "pipeline availability unchanged ==> "
-          "input = %d, component = %d, output = %d",
+    constexpr uint64_t kOneOfEach =
+        (1ull << (kInput * kUsageBits)) |
+        (1ull << (kComponent * kUsageBits)) |
+        (1ull << (kOutput * kUsageBits));
+    uint64_t usage = mUsage.load(std::memory_order_relaxed);
+    int componentLimit;
+    do {
+        // Outside of low latency mode, the adaptive component limit only applies
+        // while the client holds outputs; otherwise the component is fed as much
+        // as it can take.
+        componentLimit = mComponentMax.load(std::memory_order_relaxed);
+        if (mLowLatency.load(std::memory_order_relaxed)
+                || Usage(usage, kOutput) > Usage(usage, kComponent)) {
+            componentLimit = mComponentLimit.load(std::memory_order_relaxed);
+        }
+        if (Usage(usage, kInput) >= mInputLimit.load(std::memory_order_relaxed)
+                || Usage(usage, kComponent) >= componentLimit
+                || Usage(usage, kOutput) >= mOutputLimit.load(std::memory_order_relaxed)) {
+            ALOGV("[%s] %s -- PipelineCapacity::allocate() returns false: "
+                  "pipeline usage unchanged ==> "
+                  "input = %d, component = %d/%d, output = %d",
+                    mName, callerTag ? callerTag : "*",
+                    Usage(usage, kInput),
+                    Usage(usage, kComponent), componentLimit,
+                    Usage(usage, kOutput));
+            return false;
+        }
+    } while (!mUsage.compare_exchange_weak(
+            usage, usage + kOneOfEach, std::memory_order_relaxed));
+    ALOGV("[%s] %s -- PipelineCapacity::allocate() returns true: "
+          "pipeline usage +1 all ==> "
+          "input = %d, component = %d/%d, output = %d",
             mName, callerTag ? callerTag : "*",
-            prevInput,
-            prevComponent,
-            prevOutput);
-    return false;
+            Usage(usage, kInput) + 1,
+            Usage(usage, kComponent) + 1, componentLimit,
+            Usage(usage, kOutput) + 1);
+    return true;
+}
+
+uint64_t CCodecBufferChannel::PipelineCapacity::release(
+        int input, int component, int output) {
+    const int counts[] = { input, component, output };
+    uint64_t usage = mUsage.load(std::memory_order_relaxed);
+    uint64_t newUsage;
+    do {
+        newUsage = 0u;
+        for (int index : { kInput, kComponent, kOutput }) {
+            int value = std::max(0, Usage(usage, index) - counts[index]);
+            newUsage |= uint64_t(value) << (index * kUsageBits);
+        }
+    } while (!mUsage.compare_exchange_weak(usage, newUsage, std::memory_order_relaxed));
+    return newUsage;
 }
 
 void CCodecBufferChannel::PipelineCapacity::free(const char* callerTag) {
-    int prevInput = input.fetch_add(1, std::memory_order_relaxed);
-    int prevComponent = component.fetch_add(1, std::memory_order_relaxed);
-    int prevOutput = output.fetch_add(1, std::memory_order_relaxed);
+    uint64_t usage = release(1, 1, 1);
     ALOGV("[%s] %s -- PipelineCapacity::free(): "
-          "pipeline availability +1 all ==> "
+          "pipeline usage -1 all ==> "
           "input = %d, component = %d, output = %d",
             mName, callerTag ? callerTag : "*",
-            prevInput + 1,
-            prevComponent + 1,
-            prevOutput + 1);
+            Usage(usage, kInput),
+            Usage(usage, kComponent),
+            Usage(usage, kOutput));
 }
 
 int CCodecBufferChannel::PipelineCapacity::freeInputSlots(
         size_t numDiscardedInputBuffers,
         const char* callerTag) {
-    int prevInput = input.fetch_add(numDiscardedInputBuffers,
-                                    std::memory_order_relaxed);
+    uint64_t usage = release(static_cast<int>(numDiscardedInputBuffers), 0, 0);
     ALOGV("[%s] %s -- PipelineCapacity::freeInputSlots(%zu): "
-          "pipeline availability +%zu input ==> "
+          "pipeline usage -%zu input ==> "
           "input = %d, component = %d, output = %d",
             mName, callerTag ? callerTag : "*",
             numDiscardedInputBuffers,
             numDiscardedInputBuffers,
-            prevInput + static_cast<int>(numDiscardedInputBuffers),
-            component.load(std::memory_order_relaxed),
-            output.load(std::memory_order_relaxed));
-    return prevInput + static_cast<int>(numDiscardedInputBuffers);
+            Usage(usage, kInput),
+            Usage(usage, kComponent),
+            Usage(usage, kOutput));
+    return mInputLimit.load(std::memory_order_relaxed) - Usage(usage, kInput);
 }
 
 int CCodecBufferChannel::PipelineCapacity::freeComponentSlot(
         const char* callerTag) {
-    int prevComponent = component.fetch_add(1, std::memory_order_relaxed);
+    uint64_t usage = release(0, 1, 0);
     ALOGV("[%s] %s -- PipelineCapacity::freeComponentSlot(): "
-          "pipeline availability +1 component ==> "
+          "pipeline usage -1 component ==> "
           "input = %d, component = %d, output = %d",
             mName, callerTag ? callerTag : "*",
-            input.load(std::memory_order_relaxed),
-            prevComponent + 1,
-            output.load(std::memory_order_relaxed));
-    return prevComponent + 1;
+            Usage(usage, kInput),
+            Usage(usage, kComponent),
+            Usage(usage, kOutput));
+    return mComponentLimit.load(std::memory_order_relaxed) - Usage(usage, kComponent);
 }
 
 int CCodecBufferChannel::PipelineCapacity::freeOutputSlot(
-        const char* callerTag) {
-    int prevOutput = output.fetch_add(1, std::memory_order_relaxed);
+        bool bufferReleased, const char* callerTag) {
+    uint64_t usage = release(0, 0, 1);
+    if (bufferReleased) {
+        int64_t nowUs = ALooper::GetNowUs();
+        int64_t lastUs = mLastOutputUs.exchange(nowUs, std::memory_order_relaxed);
+        if (lastUs > 0 && nowUs - lastUs < kMaxOutputIntervalUs) {
+            UpdateAverage(&mOutputIntervalUs, nowUs - lastUs);
+        }
+    }
     ALOGV("[%s] %s -- PipelineCapacity::freeOutputSlot(): "
-          "pipeline availability +1 output ==> "
+          "pipeline usage -1 output ==> "
           "input = %d, component = %d, output = %d",
             mName, callerTag ? callerTag : "*",
-            input.load(std::memory_order_relaxed),
-            component.load(std::memory_order_relaxed),
-            prevOutput + 1);
-    return prevOutput + 1;
+            Usage(usage, kInput),
+            Usage(usage, kComponent),
+            Usage(usage, kOutput));
+    return mOutputLimit.load(std::memory_order_relaxed) - Usage(usage, kOutput);
+}
+
+void CCodecBufferChannel::PipelineCapacity::onWorkQueued(uint64_t frameIndex) {
+    QueueTime &queueTime = mQueueTimes[frameIndex % kNumQueueTimes];
+    queueTime.timeUs.store(ALooper::GetNowUs(), std::memory_order_relaxed);
+    queueTime.frameIndex.store(frameIndex, std::memory_order_release);
+}
+
+void CCodecBufferChannel::PipelineCapacity::onWorkDone(uint64_t frameIndex) {
+    const bool lowLatency = mLowLatency.load(std::memory_order_relaxed);
+    QueueTime &queueTime = mQueueTimes[frameIndex % kNumQueueTimes];
+    uint64_t queuedIndex = frameIndex;
+    if (queueTime.frameIndex.load(std::memory_order_acquire) == frameIndex) {
+        int64_t latencyUs =
+            ALooper::GetNowUs() - queueTime.timeUs.load(std::memory_order_relaxed);
+        UpdateAverage(&mLatencyUs, latencyUs);
+        ALOGV("[%s] PipelineCapacity::onWorkDone(): frame #%llu done %lldus after queueing",
+                mName, (unsigned long long)frameIndex, (long long)latencyUs);
+        // the work is no longer outstanding
+        (void)queueTime.frameIndex.compare_exchange_strong(
+                queuedIndex, UINT64_MAX, std::memory_order_relaxed);
+    }
+
+    // Work queued before this one that the component still holds is work it
+    // needed in order to return this one; never go below that. Work queued after
+    // this one was not needed for it.
+    int held = 0;
+    for (const QueueTime &other : mQueueTimes) {
+        if (other.frameIndex.load(std::memory_order_relaxed) < frameIndex) {
+            ++held;
+        }
+    }
+    // The peak is taken over the current and the previous window of works, so
+    // that it decays once the component no longer holds as much work (e.g. after
+    // a change of the stream).
+    int windowPeak = mWindowPeakHeldWork.load(std::memory_order_relaxed);
+    while (held > windowPeak && !mWindowPeakHeldWork.compare_exchange_weak(
+            windowPeak, held, std::memory_order_relaxed)) {
+    }
+    windowPeak = std::max(windowPeak, held);
+    if (mWorksInWindow.fetch_add(1, std::memory_order_relaxed) + 1 >= kPeakHeldWorkWindow) {
+        mWorksInWindow.store(0, std::memory_order_relaxed);
+        mPeakHeldWork.store(mWindowPeakHeldWork.exchange(0, std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+    }
+    int peakHeld = std::max(mPeakHeldWork.load(std::memory_order_relaxed), windowPeak);
+    int64_t latencyUs = mLatencyUs.load(std::memory_order_relaxed);
+    int64_t intervalUs = mOutputIntervalUs.load(std::memory_order_relaxed);
+    int needed = peakHeld + 1;
+    if (intervalUs > 0) {
+        needed = std::max(needed, int(divUp(latencyUs, intervalUs)));
+    } else if (!lowLatency) {
+        // keep the maximum until the rate of the client is known
+        return;
+    }
+    int limit = std::min(std::max(needed + (lowLatency ? 0 : int(kComponentHeadroom)),
+                                  mComponentMin.load(std::memory_order_relaxed)),
+                         mComponentMax.load(std::memory_order_relaxed));
+    int prevLimit = mComponentLimit.exchange(limit, std::memory_order_relaxed);
+    if (prevLimit != limit) {
+        ALOGV("[%s] PipelineCapacity::onWorkDone(): component limit %d ==> %d "
+              "(latency = %lldus, output interval = %lldus, peak held = %d)",
+                mName, prevLimit, limit,
+                (long long)latencyUs, (long long)intervalUs, peakHeld);
+    }
 }
 
 // CCodecBufferChannel
@@ -1501,6 +1963,14 @@ CCodecBufferChannel::CCodecBufferChannel(
 }
 
 CCodecBufferChannel::~CCodecBufferChannel() {
+    {
+        Mutexed<RenderQueue>::Locked queue(mRenderQueue);
+        queue->stopped = true;
+        queue->cond.broadcast();
+    }
+    if (mRenderThread.joinable()) {
+        mRenderThread.join();
+    }
     if (mCrypto != nullptr && mDealer != nullptr && mHeapSeqNum >= 0) {
         mCrypto->unsetHeap(mHeapSeqNum);
     }
@@ -1577,6 +2047,9 @@ status_t CCodecBufferChannel::queueInputBufferInternal(const sp<MediaCodecBuffer
     work->worklets.clear();
     work->worklets.emplace_back(new C2Worklet);
 
+    // record the queue time before queueing, as the work may be done right away
+    mAvailablePipelineCapacity.onWorkQueued(work->input.ordinal.frameIndex.peeku());
+
     std::list<std::unique_ptr<C2Work>> items;
     items.push_back(std::move(work));
     c2_status_t err = mComponent->queue(&items);
@@ -1760,7 +2233,7 @@ void CCodecBufferChannel::feedInputBufferIfAvailableInternal() {
 
 status_t CCodecBufferChannel::renderOutputBuffer(
         const sp<MediaCodecBuffer> &buffer, int64_t timestampNs) {
-    mAvailablePipelineCapacity.freeOutputSlot("renderOutputBuffer");
+    mAvailablePipelineCapacity.freeOutputSlot(true, "renderOutputBuffer");
     feedInputBufferIfAvailable();
     std::shared_ptr<C2Buffer> c2Buffer;
     {
@@ -1773,6 +2246,91 @@ status_t CCodecBufferChannel::renderOutputBuffer(
         return INVALID_OPERATION;
     }
 
+    {
+        Mutexed<OutputSurface>::Locked output(mOutputSurface);
+        if (output->surface == nullptr) {
+            ALOGI("[%s] cannot render buffer without surface", mName);
+            return OK;
+        }
+    }
+
+    if (c2Buffer->data().graphicBlocks().size() != 1u) {
+        ALOGD("[%s] expected 1 graphic block, but got %zu",
+              mName, c2Buffer->data().graphicBlocks().size());
+        return UNKNOWN_ERROR;
+    }
+
+    RenderItem item;
+    item.buffer = c2Buffer;
+    item.mediaTimeUs = 0;
+    (void)buffer->meta()->findInt64("timeUs", &item.mediaTimeUs);
+    item.timestampNs = timestampNs;
+    // Use dataspace from format as it has the default aspects already applied
+    item.dataSpace = HAL_DATASPACE_UNKNOWN; // this is 0
+    (void)buffer->format()->findInt32("android._dataspace", &item.dataSpace);
+
+    // Queueing to the surface may block on binder calls, so it is done on the render thread.
+    Mutexed<RenderQueue>::Locked queue(mRenderQueue);
+    if (!mRenderThread.joinable()) {
+        mRenderThread = std::thread(&CCodecBufferChannel::renderLoop, this);
+    }
+    auto it = std::upper_bound(
+            queue->items.begin(), queue->items.end(), timestampNs,
+            [](nsecs_t ts, const RenderItem &other) { return ts < other.timestampNs; });
+    queue->items.insert(it, std::move(item));
+    queue->cond.broadcast();
+    // The client call returns before the buffer is queued to the surface, so a failure to
+    // queue is reported by the next call.
+    status_t err = queue->error;
+    queue->error = OK;
+    return err;
+}
+
+void CCodecBufferChannel::renderLoop() {
+    Mutexed<RenderQueue>::Locked queue(mRenderQueue);
+    while (!queue->stopped) {
+        if (queue->items.empty()) {
+            queue.waitForCondition(queue->cond);
+            continue;
+        }
+        RenderItem item = std::move(queue->items.front());
+        queue->items.pop_front();
+
+        // If the next frame is already due, this frame would be replaced right away, so
+        // drop it. Timestamps that are far in the past are not render times (e.g. the
+        // client passed media time), and are not dropped.
+        nsecs_t nowNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        bool late = !queue->items.empty()
+                && queue->items.front().timestampNs <= nowNs
+                && nowNs - queue->items.front().timestampNs < kMaxRenderLatenessNs;
+        if (late) {
+            ++queue->numDropped;
+            ALOGD("[%s] dropping late frame (timeUs=%lld, renderTimeNs=%lld, dropped=%u)",
+                  mName, (long long)item.mediaTimeUs, (long long)item.timestampNs,
+                  queue->numDropped);
+            continue;
+        }
+        queue->rendering = true;
+        queue.unlock();
+        status_t err = render(item);
+        item.buffer.reset();
+        queue.lock();
+        queue->rendering = false;
+        if (err != OK && queue->error == OK) {
+            queue->error = err;
+        }
+        queue->cond.broadcast();
+    }
+}
+
+void CCodecBufferChannel::waitForRenderIdle(Mutexed<RenderQueue>::Locked &queue) {
+    while (queue->rendering) {
+        queue.waitForCondition(queue->cond);
+    }
+}
+
+status_t CCodecBufferChannel::render(const RenderItem &item) {
+    const std::shared_ptr<C2Buffer> &c2Buffer = item.buffer;
 #if 0
     const std::vector<std::shared_ptr<const C2Info>> infoParams = c2Buffer->info();
     ALOGV("[%s] queuing gfx buffer with %zu infos", mName, infoParams.size());
@@ -1816,42 +2374,40 @@ status_t CCodecBufferChannel::renderOutputBuffer(
         videoScalingMode = surfaceScaling->value;
     }
 
-    // Use dataspace from format as it has the default aspects already applied
-    android_dataspace_t dataSpace = HAL_DATASPACE_UNKNOWN; // this is 0
-    (void)buffer->format()->findInt32("android._dataspace", (int32_t *)&dataSpace);
-
     // HDR static info
     std::shared_ptr<const C2StreamHdrStaticInfo::output> hdrStaticInfo =
         std::static_pointer_cast<const C2StreamHdrStaticInfo::output>(
                 c2Buffer->getInfo(C2StreamHdrStaticInfo::output::PARAM_TYPE));
 
-    {
-        Mutexed<OutputSurface>::Locked output(mOutputSurface);
-        if (output->surface == nullptr) {
-            ALOGI("[%s] cannot render buffer without surface", mName);
-            return OK;
-        }
-    }
-
     std::vector<C2ConstGraphicBlock> blocks = c2Buffer->data().graphicBlocks();
-    if (blocks.size() != 1u) {
-        ALOGD("[%s] expected 1 graphic block, but got %zu", mName, blocks.size());
-        return UNKNOWN_ERROR;
-    }
     const C2ConstGraphicBlock &block = blocks.front();
 
-    // TODO: revisit this after C2Fence implementation.
+    // Pass the producer's fence on to the consumer so that it does not need to be waited for
+    // here. Fences that are not backed by a sync_file must be waited for before queueing.
+    sp<Fence> acquireFence = Fence::NO_FENCE;
+    C2Fence blockFence = block.fence();
+    int fenceFd = blockFence.fd();
+    if (fenceFd >= 0) {
+        acquireFence = new Fence(fenceFd);
+    } else if (!blockFence.ready()) {
+        c2_status_t err = blockFence.wait(-1 /* indefinitely */);
+        if (err != C2_OK) {
+            ALOGD("[%s] failed to wait for output fence: %d", mName, err);
+            return UNKNOWN_ERROR;
+        }
+    }
+
     android::IGraphicBufferProducer::QueueBufferInput qbi(
-            timestampNs,
+            item.timestampNs,
             false, // droppable
-            dataSpace,
+            (android_dataspace_t)item.dataSpace,
             Rect(blocks.front().crop().left,
                  blocks.front().crop().top,
                  blocks.front().crop().right(),
                  blocks.front().crop().bottom()),
             videoScalingMode,
             transform,
-            Fence::NO_FENCE, 0);
+            acquireFence, 0);
     if (hdrStaticInfo) {
         struct android_smpte2086_metadata smpte2086_meta = {
             .displayPrimaryRed = {
@@ -1891,9 +2447,7 @@ status_t CCodecBufferChannel::renderOutputBuffer(
     }
     ALOGV("[%s] queue buffer successful", mName);
 
-    int64_t mediaTimeUs = 0;
-    (void)buffer->meta()->findInt64("timeUs", &mediaTimeUs);
-    mCCodecCallback->onOutputFramesRendered(mediaTimeUs, timestampNs);
+    mCCodecCallback->onOutputFramesRendered(item.mediaTimeUs, item.timestampNs);
 
     return OK;
 }
@@ -1914,7 +2468,7 @@ status_t CCodecBufferChannel::discardBuffer(const sp<MediaCodecBuffer> &buffer)
         if (*buffers && (*buffers)->releaseBuffer(buffer, nullptr)) {
             buffers.unlock();
             released = true;
-            mAvailablePipelineCapacity.freeOutputSlot("discardBuffer");
+            mAvailablePipelineCapacity.freeOutputSlot(true, "discardBuffer");
         }
     }
     feedInputBufferIfAvailable();
@@ -1959,6 +2513,11 @@ status_t CCodecBufferChannel::start(
         return UNKNOWN_ERROR;
     }
 
+    // In low latency mode, keep a single work in flight if the component allows it
+    C2LowLatencyModeTuning lowLatency(C2_FALSE);
+    (void)mComponent->query({ &lowLatency }, {}, C2_DONT_BLOCK, nullptr);
+    bool lowLatencyMode = lowLatency && lowLatency.value == C2_TRUE;
+
     // Query delays
     C2PortRequestedDelayTuning::input inputDelay;
     C2PortRequestedDelayTuning::output outputDelay;
@@ -1972,15 +2531,18 @@ status_t CCodecBufferChannel::start(
     mAvailablePipelineCapacity.initialize(
             inputDelay,
             inputDelay + pipelineDelay,
+            inputDelay + pipelineDelay,
             inputDelay + pipelineDelay + outputDelay,
             mName);
 #else
     mAvailablePipelineCapacity.initialize(
             kMinInputBufferArraySize,
+            lowLatencyMode ? 1 : kMinPipelineCapacity,
             kMaxPipelineCapacity,
             kMinOutputBufferArraySize,
             mName);
 #endif
+    mAvailablePipelineCapacity.setLowLatency(lowLatencyMode);
 
     // TODO: get this from input format
     bool secure = mComponent->getName().find(".secure") != std::string::npos;
@@ -2226,7 +2788,14 @@ status_t CCodecBufferChannel::start(
                 if (delay || padding) {
                     // We need write access to the buffers, and we're already in
                     // array mode.
-                    (*buffers)->initSkipCutBuffer(delay, padding, sampleRate, channelCount);
+                    C2StreamPcmEncodingInfo::output encoding(0u, C2Config::PCM_16);
+                    C2StreamMaxBufferSizeInfo::output maxBufferSize(0u, 0u);
+                    (void)mComponent->query(
+                            { &encoding, &maxBufferSize }, {}, C2_DONT_BLOCK, nullptr);
+                    (*buffers)->initSkipCutBuffer(
+                            delay, padding, sampleRate, channelCount,
+                            encoding ? encoding.value : C2Config::PCM_16,
+                            maxBufferSize ? maxBufferSize.value : 0u);
                 }
             }
         }
@@ -2306,7 +2875,7 @@ status_t CCodecBufferChannel::requestInitialInputBuffers() {
     for (const sp<MediaCodecBuffer> &buffer : toBeQueued) {
         if (queueInputBufferInternal(buffer) != OK) {
             mAvailablePipelineCapacity.freeComponentSlot("requestInitialInputBuffers");
-            mAvailablePipelineCapacity.freeOutputSlot("requestInitialInputBuffers");
+            mAvailablePipelineCapacity.freeOutputSlot(false, "requestInitialInputBuffers");
         }
     }
     return OK;
@@ -2315,6 +2884,18 @@ status_t CCodecBufferChannel::requestInitialInputBuffers() {
 void CCodecBufferChannel::stop() {
     mSync.stop();
     mFirstValidFrameIndex = mFrameIndex.load();
+    {
+        // frames that are not yet rendered are dropped
+        Mutexed<RenderQueue>::Locked queue(mRenderQueue);
+        if (!queue->items.empty() || queue->numDropped > 0) {
+            ALOGD("[%s] stop: dropping %zu unrendered frames (%u late frames dropped)",
+                  mName, queue->items.size(), queue->numDropped);
+        }
+        queue->items.clear();
+        waitForRenderIdle(queue);
+        queue->error = OK;
+        queue->numDropped = 0;
+    }
     if (mInputSurface != nullptr) {
         mInputSurface.reset();
     }
@@ -2370,8 +2951,9 @@ void CCodecBufferChannel::onWorkDone(
 
     mAvailablePipelineCapacity.freeInputSlots(numDiscardedInputBuffers, "onWorkDone");
     mAvailablePipelineCapacity.freeComponentSlot("onWorkDone");
+    mAvailablePipelineCapacity.onWorkDone(work->input.ordinal.frameIndex.peeku());
     if (handleWork(std::move(work), outputFormat, initData)) {
-        mAvailablePipelineCapacity.freeOutputSlot("onWorkDone");
+        mAvailablePipelineCapacity.freeOutputSlot(false, "onWorkDone");
     }
     feedInputBufferIfAvailable();
 }
@@ -2433,9 +3015,14 @@ bool CCodecBufferChannel::handleWork(
                 && mediaType == MIMETYPE_AUDIO_RAW) {
             int32_t channelCount;
             int32_t sampleRate;
+            int32_t pcmEncoding;
             if (outputFormat->findInt32(KEY_CHANNEL_COUNT, &channelCount)
                     && outputFormat->findInt32(KEY_SAMPLE_RATE, &sampleRate)) {
-                (*buffers)->updateSkipCutBuffer(sampleRate, channelCount);
+                if (outputFormat->findInt32(KEY_PCM_ENCODING, &pcmEncoding)) {
+                    (*buffers)->updateSkipCutBuffer(sampleRate, channelCount, pcmEncoding);
+                } else {
+                    (*buffers)->updateSkipCutBuffer(sampleRate, channelCount);
+                }
             }
         }
     }
@@ -2552,6 +3139,12 @@ status_t CCodecBufferChannel::setSurface(const sp<Surface> &newSurface) {
         outputPoolIntf = pools->outputPoolIntf;
     }
 
+    {
+        // do not switch the surface under a buffer being queued to the old one
+        Mutexed<RenderQueue>::Locked queue(mRenderQueue);
+        waitForRenderIdle(queue);
+    }
+
     if (outputPoolIntf) {
         if (mComponent->setOutputSurface(
                 outputPoolId,
@@ -18,8 +18,12 @@
 
 #define CCODEC_BUFFER_CHANNEL_H_
 
+#include <array>
+#include <atomic>
+#include <list>
 #include <map>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include <C2Buffer.h>
@@ -218,6 +222,35 @@ private:
             std::unique_ptr<C2Work> work, const sp<AMessage> &outputFormat,
             const C2StreamInitDataInfo::output *initData);
 
+    // Output buffer released by the client for rendering.
+    struct RenderItem {
+        std::shared_ptr<C2Buffer> buffer;
+        int64_t mediaTimeUs;
+        nsecs_t timestampNs;
+        int32_t dataSpace;
+    };
+
+    // Render items pending on the render thread, in the order of their render timestamps.
+    struct RenderQueue {
+        RenderQueue() : stopped(false), rendering(false), error(OK), numDropped(0) {}
+        std::list<RenderItem> items;
+        bool stopped;
+        // true while the render thread queues an item to the surface without the lock
+        bool rendering;
+        // first error of queueing a buffer to the surface that is not reported to the client yet
+        status_t error;
+        // number of late frames dropped since the last stop()
+        uint32_t numDropped;
+        Condition cond;
+    };
+
+    // Main function of the render thread, which queues rendered buffers to the output surface
+    // so that renderOutputBuffer() does not block on the surface.
+    void renderLoop();
+    status_t render(const RenderItem &item);
+    // Waits until the render thread is not queueing a buffer to the surface.
+    void waitForRenderIdle(Mutexed<RenderQueue>::Locked &queue);
+
     QueueSync mSync;
     sp<MemoryDealer> mDealer;
     sp<IMemory> mDecryptDestination;
@@ -246,6 +279,10 @@ private:
     };
     Mutexed<OutputSurface> mOutputSurface;
 
+    Mutexed<RenderQueue> mRenderQueue;
+    // Started on the first renderOutputBuffer() call.
+    std::thread mRenderThread;
+
     struct BlockPools {
         C2Allocator::id_t inputAllocatorId;
         std::shared_ptr<C2BlockPool> inputPool;
@@ -284,22 +321,32 @@ private:
     // 3. overload CCodecBufferChannel's output buffers if the component
     //    finishes all the pending work right away.
     //
+    // The component capacity is not fixed. While the client holds outputs (i.e. the client is
+    // the bottleneck), it is reduced to the work needed in flight to keep up with the client,
+    // which by Little's law is the component latency divided by the interval at which outputs
+    // are released. Queueing more work than that only adds latency. It never goes below the
+    // work queued earlier that the component has recently been seen to hold while returning
+    // work (e.g. for reordering), so that the component is not starved of the input it needs
+    // to produce output.
+    //
+    // In low latency mode, the reduced component capacity always applies and has no headroom,
+    // so that only one work is in flight if the component returns each work before the next
+    // one is needed.
+    //
     struct PipelineCapacity {
-        // The number of available input capacity.
-        std::atomic_int input;
-        // The number of available component capacity.
-        std::atomic_int component;
-        // The number of available output capacity.
-        std::atomic_int output;
-
         PipelineCapacity();
-        // Set the values of #component and #output.
-        void initialize(int newInput, int newComponent, int newOutput,
+        // Set the limits of input, component and output capacity. The component capacity
+        // starts at #newComponentMax and is adjusted within
+        // [#newComponentMin, #newComponentMax]. Nothing is in use after this call.
+        void initialize(int newInput, int newComponentMin, int newComponentMax, int newOutput,
                         const char* newName = "<UNKNOWN COMPONENT>",
                         const char* callerTag = nullptr);
 
-        // Return true and decrease #input, #component and #output by one if
-        // they are all greater than zero; return false otherwise.
+        // Enable or disable low latency mode. This is called after initialize().
+        void setLowLatency(bool lowLatency);
+
+        // Return true and increase the input, component and output usage by one if
+        // they are all below their limits; return false otherwise.
         //
         // callerTag is used for logging only.
         //
@@ -308,7 +355,7 @@ private:
         // onInputBufferAvailable() can (and will) be called afterwards.
         bool allocate(const char* callerTag = nullptr);
 
-        // Increase #input, #component and #output by one.
+        // Decrease the input, component and output usage by one.
         //
         // callerTag is used for logging only.
         //
@@ -317,7 +364,8 @@ private:
         // essentially undoes an allocate() call.
         void free(const char* callerTag = nullptr);
 
-        // Increase #input by @p numDiscardedInputBuffers.
+        // Decrease the input usage by @p numDiscardedInputBuffers and return the
+        // available input capacity.
         //
         // callerTag is used for logging only.
         //
@@ -327,7 +375,8 @@ private:
         int freeInputSlots(size_t numDiscardedInputBuffers,
                            const char* callerTag = nullptr);
 
-        // Increase #component by one and return the updated value.
+        // Decrease the component usage by one and return the available component
+        // capacity.
         //
         // callerTag is used for logging only.
         //
@@ -335,16 +384,80 @@ private:
         // onWorkDone() is called.
         int freeComponentSlot(const char* callerTag = nullptr);
 
-        // Increase #output by one and return the updated value.
+        // Decrease the output usage by one and return the available output
+        // capacity. If bufferReleased is true, i.e. the client released an
+        // output buffer, this also measures the interval at which output
+        // buffers are released. Works that did not produce an output buffer
+        // (codec config, dropped frames) do not count towards that interval.
         //
         // callerTag is used for logging only.
         //
         // freeOutputSlot() is called by CCodecBufferChannel when
         // discardBuffer() is called on an output buffer or when
         // renderOutputBuffer() is called.
-        int freeOutputSlot(const char* callerTag = nullptr);
+        int freeOutputSlot(bool bufferReleased, const char* callerTag = nullptr);
+
+        // Record the time the work with @p frameIndex was queued to the component.
+        void onWorkQueued(uint64_t frameIndex);
+
+        // Measure the latency of the work with @p frameIndex, which is returned by the
+        // component, and adjust the component capacity accordingly.
+        void onWorkDone(uint64_t frameIndex);
 
     private:
+        enum : int {
+            kInput,
+            kComponent,
+            kOutput,
+            // number of bits for each usage count in mUsage
+            kUsageBits = 20,
+            // extra component capacity on top of the measured need
+            kComponentHeadroom = 2,
+            // number of queue times that are remembered for measuring latency and
+            // counting outstanding work
+            kNumQueueTimes = 64,
+            // number of returned works over which the peak of held work is taken
+            kPeakHeldWorkWindow = 64,
+        };
+
+        static int Usage(uint64_t usage, int index) {
+            return int((usage >> (index * kUsageBits)) & ((1u << kUsageBits) - 1));
+        }
+
+        // Usage of the input, component and output capacity, packed into a single
+        // word so that allocate() can check and update all of them atomically.
+        std::atomic<uint64_t> mUsage;
+
+        std::atomic_int mInputLimit;
+        std::atomic_int mComponentLimit;
+        std::atomic_int mOutputLimit;
+        std::atomic_int mComponentMin;
+        std::atomic_int mComponentMax;
+        // The most work queued earlier that the component held while returning
+        // work, over the previous window of kPeakHeldWorkWindow works, and over
+        // the current window.
+        std::atomic_int mPeakHeldWork;
+        std::atomic_int mWindowPeakHeldWork;
+        std::atomic_int mWorksInWindow;
+        std::atomic_bool mLowLatency;
+
+        // Exponentially weighted averages of the component latency and of the
+        // interval between released outputs (in us, 0 if unknown).
+        std::atomic<int64_t> mLatencyUs;
+        std::atomic<int64_t> mOutputIntervalUs;
+        std::atomic<int64_t> mLastOutputUs;
+
+        // Queue time of a work; frameIndex is UINT64_MAX once the work is done.
+        struct QueueTime {
+            std::atomic<uint64_t> frameIndex;
+            std::atomic<int64_t> timeUs;
+        };
+        std::array<QueueTime, kNumQueueTimes> mQueueTimes;
+
+        // Decrease the usages by the given counts, not going below zero, and return
+        // the new usage word.
+        uint64_t release(int input, int component, int output);
+
         // Component name. Used for logging.
         const char* mName;
     };
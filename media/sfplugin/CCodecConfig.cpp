@@ -547,6 +547,72 @@ void CCodecConfig::initializeStandardParams() {
     deprecated(ConfigMapper(KEY_OPERATING_RATE,   "ctrl.operating-rate",     "value")
                .withMapper(makeFloat));
     deprecated(ConfigMapper(KEY_PRIORITY,         "ctrl.priority",           "value"));
+    add(ConfigMapper("low-latency",     C2_PARAMKEY_LOW_LATENCY_MODE,   "value")
+        .limitTo(D::CONFIG) // write-only, applied at start
+        .withMapper([](C2Value v) -> C2Value {
+            int32_t value;
+            if (v.get(&value)) {
+                return uint32_t(value ? C2_TRUE : C2_FALSE);
+            }
+            return C2Value();
+        }));
+    add(ConfigMapper("thread-count",    C2_PARAMKEY_THREAD_COUNT,       "value")
+        .limitTo(D::CONFIG) // write-only, applied at start
+        .withMapper([](C2Value v) -> C2Value {
+            int32_t value;
+            if (v.get(&value) && value >= 0) {
+                return uint32_t(value);
+            }
+            return C2Value();
+        }));
+    add(ConfigMapper("row-mt",          C2_PARAMKEY_ROW_MULTI_THREADING, "value")
+        .limitTo(D::VIDEO & D::CONFIG) // write-only, applied at start
+        .withMapper([](C2Value v) -> C2Value {
+            int32_t value;
+            if (v.get(&value)) {
+                return uint32_t(value ? C2_TRUE : C2_FALSE);
+            }
+            return C2Value();
+        }));
+    add(ConfigMapper("tile-columns",    C2_PARAMKEY_TILE_COLUMNS,       "value")
+        .limitTo(D::ENCODER & D::VIDEO & D::CONFIG) // write-only, applied at start
+        .withMapper([](C2Value v) -> C2Value {
+            int32_t value;
+            if (v.get(&value) && value >= 0) {
+                return uint32_t(value);
+            }
+            return C2Value();
+        }));
+    add(ConfigMapper("encoding-deadline", C2_PARAMKEY_ENCODING_DEADLINE, "value")
+        .limitTo(D::ENCODER & D::VIDEO & D::CONFIG) // write-only, applied at start
+        .withMapper([](C2Value v) -> C2Value {
+            int32_t value;
+            if (v.get(&value)) {
+                return uint32_t(value ? C2Config::DEADLINE_GOOD_QUALITY
+                                      : C2Config::DEADLINE_REALTIME);
+            }
+            return C2Value();
+        }));
+    add(ConfigMapper("look-ahead",      C2_PARAMKEY_LOOK_AHEAD,         "value")
+        .limitTo(D::ENCODER & D::VIDEO & D::CONFIG) // write-only, applied at start
+        .withMapper([](C2Value v) -> C2Value {
+            int32_t value;
+            if (v.get(&value) && value >= 0) {
+                return uint32_t(value);
+            }
+            return C2Value();
+        }));
+    add(ConfigMapper(C2_PARAMKEY_CPU_AFFINITY, C2_PARAMKEY_CPU_AFFINITY, "")
+        .limitTo(D::CONFIG)); // write-only, applied at start
+    add(ConfigMapper("key-frame-only",  C2_PARAMKEY_KEY_FRAME_ONLY_DECODING, "value")
+        .limitTo(D::DECODER & D::VIDEO & D::CONFIG) // write-only, applied at start
+        .withMapper([](C2Value v) -> C2Value {
+            int32_t value;
+            if (v.get(&value)) {
+                return uint32_t(value ? C2_TRUE : C2_FALSE);
+            }
+            return C2Value();
+        }));
 
     add(ConfigMapper(KEY_WIDTH,         C2_PARAMKEY_PICTURE_SIZE,       "width")
         .limitTo(D::VIDEO | D::IMAGE));
@@ -567,6 +633,13 @@ void CCodecConfig::initializeStandardParams() {
     add(ConfigMapper(KEY_MAX_HEIGHT,    C2_PARAMKEY_MAX_PICTURE_SIZE,    "height")
         .limitTo((D::VIDEO | D::IMAGE) & D::RAW));
 
+    // decoders that support it output pictures downscaled to this size. The output format
+    // reflects the size of the output buffers.
+    add(ConfigMapper("scaled-width",    C2_PARAMKEY_SCALED_PICTURE_SIZE, "width")
+        .limitTo(D::DECODER & D::VIDEO & D::CONFIG)); // write-only, applied at start
+    add(ConfigMapper("scaled-height",   C2_PARAMKEY_SCALED_PICTURE_SIZE, "height")
+        .limitTo(D::DECODER & D::VIDEO & D::CONFIG)); // write-only, applied at start
+
     add(ConfigMapper("csd-0",           C2_PARAMKEY_INIT_DATA,       "value")
         .limitTo(D::OUTPUT & D::READ));
 
@@ -624,7 +697,8 @@ void CCodecConfig::initializeStandardParams() {
         .limitTo(D::AUDIO & D::CODED));
 
     add(ConfigMapper(KEY_PCM_ENCODING,  C2_PARAMKEY_PCM_ENCODING,       "value")
-        .limitTo(D::AUDIO));
+        .limitTo(D::AUDIO)
+        .withC2Mappers<C2Config::pcm_encoding_t>());
 
     add(ConfigMapper(KEY_IS_ADTS, C2_PARAMKEY_AAC_PACKAGING, "value")
         .limitTo(D::AUDIO & D::CODED)
@@ -1358,6 +1432,40 @@ ReflectedParamUpdater::Dict CCodecConfig::getReflectedFormat(
         }
     }
 
+    {   // reflect the CPU affinity list (e.g. "0,2,4-7") into a binary blob
+        AString list;
+        if (params->findString("cpu-affinity", &list)) {
+            constexpr unsigned long kMaxCpu = 1023;
+            std::vector<uint32_t> cpus;
+            const char *s = list.c_str();
+            bool valid = true;
+            while (valid && *s != '\0') {
+                char *end;
+                unsigned long first = strtoul(s, &end, 10);
+                unsigned long last = first;
+                valid = end != s;
+                if (valid && *end == '-') {
+                    s = end + 1;
+                    last = strtoul(s, &end, 10);
+                    valid = end != s && last >= first;
+                }
+                valid = valid && last <= kMaxCpu && (*end == ',' || *end == '\0');
+                for (unsigned long cpu = first; valid && cpu <= last; ++cpu) {
+                    cpus.push_back(uint32_t(cpu));
+                }
+                s = *end == ',' ? end + 1 : end;
+            }
+            if (valid) {
+                std::unique_ptr<C2CpuAffinityTuning> affinity =
+                    C2CpuAffinityTuning::AllocUnique(cpus);
+                params->setBuffer(C2_PARAMKEY_CPU_AFFINITY,
+                                  ABuffer::CreateAsCopy(affinity.get(), affinity->size()));
+            } else {
+                ALOGD("Ignoring invalid cpu-affinity [%s]", list.c_str());
+            }
+        }
+    }
+
     { // convert from MediaFormat rect to Codec 2.0 rect
         int32_t offset;
         int32_t end;
@@ -18,6 +18,8 @@
 #define LOG_TAG "Codec2Buffer"
 #include <utils/Log.h>
 
+#include <algorithm>
+
 #include <hidlmemory/FrameworkUtils.h>
 #include <media/hardware/HardwareAPI.h>
 #include <media/stagefright/MediaCodecConstants.h>
@@ -143,7 +145,8 @@ sp<LinearBlockBuffer> LinearBlockBuffer::Allocate(
 }
 
 std::shared_ptr<C2Buffer> LinearBlockBuffer::asC2Buffer() {
-    return C2Buffer::CreateLinearBuffer(mBlock->share(offset(), size(), C2Fence()));
+    return C2Buffer::CreateLinearBuffer(mBlock->share(
+            mBlock->offset() + offset(), size(), C2Fence()));
 }
 
 bool LinearBlockBuffer::canCopy(const std::shared_ptr<C2Buffer> &buffer) const {
@@ -206,9 +209,8 @@ public:
      * Creates a C2GraphicView <=> MediaImage converter
      *
      * \param view C2GraphicView object
-     * \param colorFormat desired SDK color format for the MediaImage (if this is a flexible format,
-     *        an attempt is made to simply represent the graphic view as a flexible SDK format
-     *        without a memcpy)
+     * \param colorFormat desired SDK color format for the MediaImage (an attempt is made to
+     *        simply represent the graphic view in this format without a memcpy)
      */
     GraphicView2MediaImageConverter(
             const C2GraphicView &view, int32_t colorFormat)
@@ -260,44 +262,10 @@ public:
                     mInitCheck = BAD_VALUE;
                     return;
                 }
+                // also describe a back buffer in case the client cannot use the wrapped view
+                (void)wrapIfCompatible();
                 switch (mColorFormat) {
                     case COLOR_FormatYUV420Flexible:
-                    {  // try to map directly. check if the planes are near one another
-                        const uint8_t *minPtr = mView.data()[0];
-                        const uint8_t *maxPtr = mView.data()[0];
-                        int32_t planeSize = 0;
-                        for (uint32_t i = 0; i < layout.numPlanes; ++i) {
-                            const C2PlaneInfo &plane = layout.planes[i];
-                            ssize_t minOffset = plane.minOffset(mWidth, mHeight);
-                            ssize_t maxOffset = plane.maxOffset(mWidth, mHeight);
-                            if (minPtr > mView.data()[i] + minOffset) {
-                                minPtr = mView.data()[i] + minOffset;
-                            }
-                            if (maxPtr < mView.data()[i] + maxOffset) {
-                                maxPtr = mView.data()[i] + maxOffset;
-                            }
-                            planeSize += std::abs(plane.rowInc) * align(mHeight, 64)
-                                    / plane.rowSampling / plane.colSampling * divUp(mAllocatedDepth, 8u);
-                        }
-
-                        if ((maxPtr - minPtr + 1) <= planeSize) {
-                            // FIXME: this is risky as reading/writing data out of bound results in
-                            //        an undefined behavior, but gralloc does assume a contiguous
-                            //        mapping
-                            for (uint32_t i = 0; i < layout.numPlanes; ++i) {
-                                const C2PlaneInfo &plane = layout.planes[i];
-                                mediaImage->mPlane[i].mOffset = mView.data()[i] - minPtr;
-                                mediaImage->mPlane[i].mColInc = plane.colInc;
-                                mediaImage->mPlane[i].mRowInc = plane.rowInc;
-                                mediaImage->mPlane[i].mHorizSubsampling = plane.colSampling;
-                                mediaImage->mPlane[i].mVertSubsampling = plane.rowSampling;
-                            }
-                            mWrapped = new ABuffer(const_cast<uint8_t *>(minPtr), maxPtr - minPtr + 1);
-                            break;
-                        }
-                    }
-                    // fall through if we could not wrap
-
                     case COLOR_FormatYUV420Planar:
                     case COLOR_FormatYUV420PackedPlanar:
                         mediaImage->mPlane[mediaImage->Y].mOffset = 0;
@@ -427,6 +395,19 @@ public:
         }
 
         mBackBufferSize = bufferSize;
+        if (mWrapped != nullptr) {
+            mWrappedImage = new ABuffer(sizeof(MediaImage2));
+            MediaImage2 *wrappedImage = (MediaImage2 *)mWrappedImage->base();
+            *wrappedImage = *mediaImage;
+            for (uint32_t i = 0; i < layout.numPlanes; ++i) {
+                const C2PlaneInfo &plane = layout.planes[i];
+                wrappedImage->mPlane[i].mOffset = mView.data()[i] - mWrapped->data();
+                wrappedImage->mPlane[i].mColInc = plane.colInc;
+                wrappedImage->mPlane[i].mRowInc = plane.rowInc;
+                wrappedImage->mPlane[i].mHorizSubsampling = plane.colSampling;
+                wrappedImage->mPlane[i].mVertSubsampling = plane.rowSampling;
+            }
+        }
         mInitCheck = OK;
     }
 
@@ -467,7 +448,15 @@ public:
         return ImageCopy(mBackBuffer->base(), getMediaImage(), mView);
     }
 
-    const sp<ABuffer> &imageData() const { return mMediaImage; }
+    /**
+     * \return the image data describing the wrapped view, or the back buffer if one was set.
+     */
+    sp<ABuffer> imageData() const {
+        if (mBackBuffer == nullptr && mWrappedImage != nullptr) {
+            return mWrappedImage;
+        }
+        return mMediaImage;
+    }
 
 private:
     status_t mInitCheck;
@@ -479,7 +468,8 @@ private:
     sp<ABuffer> mWrapped;  ///< wrapped buffer (if we can map C2Buffer to an ABuffer)
     uint32_t mAllocatedDepth;
     uint32_t mBackBufferSize;
-    sp<ABuffer> mMediaImage;
+    sp<ABuffer> mMediaImage;   ///< image data for the back buffer
+    sp<ABuffer> mWrappedImage; ///< image data for the wrapped buffer
     std::function<sp<ABuffer>(size_t)> mAlloc;
 
     sp<ABuffer> mBackBuffer;    ///< backing buffer if we have to copy C2Buffer <=> ABuffer
@@ -487,6 +477,79 @@ private:
     MediaImage2 *getMediaImage() {
         return (MediaImage2 *)mMediaImage->base();
     }
+
+    /**
+     * Wraps the mapped planes of the view without a copy if they can be exposed in
+     * |mColorFormat|.
+     *
+     * Flexible YUV accepts any 4:2:0 layout. YUV420Planar and YUV420SemiPlanar require the exact
+     * I420 and NV12 layouts that are implied by the stride and slice height, as clients may access
+     * those without looking at the image data.
+     *
+     * \return true if the view was wrapped.
+     */
+    bool wrapIfCompatible() {
+        const C2PlanarLayout &layout = mView.layout();
+        const C2PlaneInfo &yPlane = layout.planes[C2PlanarLayout::PLANE_Y];
+        const C2PlaneInfo &uPlane = layout.planes[C2PlanarLayout::PLANE_U];
+        const C2PlaneInfo &vPlane = layout.planes[C2PlanarLayout::PLANE_V];
+        const uint8_t *const *data = mView.data();
+        const ssize_t stride = yPlane.rowInc;
+        const ssize_t uOffset = data[C2PlanarLayout::PLANE_U] - data[C2PlanarLayout::PLANE_Y];
+        const ssize_t vOffset = data[C2PlanarLayout::PLANE_V] - data[C2PlanarLayout::PLANE_Y];
+        switch (mColorFormat) {
+            case COLOR_FormatYUV420Flexible:
+                break;
+
+            case COLOR_FormatYUV420Planar:
+            case COLOR_FormatYUV420PackedPlanar:
+                if (mAllocatedDepth != 8 || stride <= 0 || stride % 2 != 0
+                        || yPlane.colInc != 1 || uPlane.colInc != 1 || vPlane.colInc != 1
+                        || uPlane.rowInc != stride / 2 || vPlane.rowInc != stride / 2
+                        || uOffset % (stride * 2) != 0
+                        || uOffset / stride < (ssize_t)align(mHeight, 2)
+                        || vOffset - uOffset != stride / 2 * (uOffset / stride / 2)) {
+                    return false;
+                }
+                break;
+
+            case COLOR_FormatYUV420SemiPlanar:
+            case COLOR_FormatYUV420PackedSemiPlanar:
+                if (mAllocatedDepth != 8 || stride <= 0
+                        || yPlane.colInc != 1 || uPlane.colInc != 2 || vPlane.colInc != 2
+                        || uPlane.rowInc != stride || vPlane.rowInc != stride
+                        || uOffset % stride != 0
+                        || uOffset / stride < (ssize_t)align(mHeight, 2)
+                        || vOffset != uOffset + 1) {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+        }
+
+        // check if the planes are near one another
+        const uint8_t *minPtr = data[0];
+        const uint8_t *maxPtr = data[0];
+        ssize_t planeSize = 0;
+        for (uint32_t i = 0; i < layout.numPlanes; ++i) {
+            const C2PlaneInfo &plane = layout.planes[i];
+            uint32_t width = divUp(mWidth, plane.colSampling);
+            uint32_t height = divUp(mHeight, plane.rowSampling);
+            minPtr = std::min(minPtr, data[i] + plane.minOffset(width, height));
+            maxPtr = std::max(maxPtr, data[i] + plane.maxOffset(width, height));
+            planeSize += std::abs(plane.rowInc) * divUp(align(mHeight, 64), plane.rowSampling);
+        }
+        if (maxPtr - minPtr + 1 > planeSize) {
+            return false;
+        }
+
+        // FIXME: this is risky as reading/writing data out of bound results in an undefined
+        //        behavior, but gralloc does assume a contiguous mapping
+        mWrapped = new ABuffer(const_cast<uint8_t *>(minPtr), maxPtr - minPtr + 1);
+        return true;
+    }
 };
 
 }  // namespace
@@ -766,7 +829,8 @@ EncryptedLinearBlockBuffer::EncryptedLinearBlockBuffer(
 }
 
 std::shared_ptr<C2Buffer> EncryptedLinearBlockBuffer::asC2Buffer() {
-    return C2Buffer::CreateLinearBuffer(mBlock->share(offset(), size(), C2Fence()));
+    return C2Buffer::CreateLinearBuffer(mBlock->share(
+            mBlock->offset() + offset(), size(), C2Fence()));
 }
 
 void EncryptedLinearBlockBuffer::fillSourceBuffer(
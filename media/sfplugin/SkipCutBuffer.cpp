@@ -18,26 +18,46 @@
 #define LOG_TAG "SkipCutBuffer"
 #include <utils/Log.h>
 
+#include <algorithm>
+
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaBuffer.h>
-#include <media/stagefright/SkipCutBuffer.h>
+
+#include "SkipCutBuffer.h"
 
 namespace android {
 
-SkipCutBuffer::SkipCutBuffer(size_t skip, size_t cut, size_t num16BitChannels) {
+namespace {
+
+// The ring is a little larger than the data it may hold, so that there is no ambiguity as to
+// whether mWriteHead == mReadHead means that the ring is full or empty.
+constexpr size_t kRingMargin = 32;
+
+// Ring space for data that is not held back, if the buffer size is not known.
+constexpr size_t kDefaultBufferSize = 4096;
+
+}  // namespace
+
+SkipCutBuffer::SkipCutBuffer(size_t skip, size_t cut, size_t frameSize, size_t maxBufferSize) {
 
+    mSkip = 0;
+    mFrontPadding = 0;
+    mBackPadding = 0;
     mWriteHead = 0;
     mReadHead = 0;
     mCapacity = 0;
     mCutBuffer = NULL;
 
-    if (num16BitChannels == 0 || num16BitChannels > INT32_MAX / 2) {
-        ALOGW("# channels out of range: %zu, using passthrough instead", num16BitChannels);
+    if (frameSize == 0 || frameSize > INT32_MAX) {
+        ALOGW("frame size out of range: %zu, using passthrough instead", frameSize);
         return;
     }
-    size_t frameSize = num16BitChannels * 2;
+    if (maxBufferSize == 0) {
+        maxBufferSize = kDefaultBufferSize;
+    }
     if (skip > INT32_MAX / frameSize || cut > INT32_MAX / frameSize
-            || cut * frameSize > INT32_MAX - 4096) {
+            || maxBufferSize > INT32_MAX - kRingMargin
+            || cut * frameSize > INT32_MAX - kRingMargin - maxBufferSize) {
         ALOGW("out of range skip/cut: %zu/%zu, using passthrough instead",
                 skip, cut);
         return;
@@ -45,80 +65,94 @@ SkipCutBuffer::SkipCutBuffer(size_t skip, size_t cut, size_t num16BitChannels) {
     skip *= frameSize;
     cut *= frameSize;
 
+    if (cut > 0) {
+        // skipping alone only trims the range of the buffers
+        mCapacity = cut + maxBufferSize + kRingMargin;
+        mCutBuffer = new (std::nothrow) uint8_t[mCapacity];
+        if (mCutBuffer == NULL) {
+            ALOGW("failed to allocate %zu bytes, using passthrough instead", mCapacity);
+            mCapacity = 0;
+            return;
+        }
+    }
     mFrontPadding = mSkip = skip;
     mBackPadding = cut;
-    mCapacity = cut + 4096;
-    mCutBuffer = new (std::nothrow) char[mCapacity];
-    ALOGV("skipcutbuffer %zu %zu %d", skip, cut, mCapacity);
+    ALOGV("skipcutbuffer %zu %zu %zu", skip, cut, mCapacity);
 }
 
 SkipCutBuffer::~SkipCutBuffer() {
     delete[] mCutBuffer;
 }
 
-void SkipCutBuffer::submit(MediaBuffer *buffer) {
-    if (mCutBuffer == NULL) {
-        // passthrough mode
-        return;
-    }
-
-    int32_t offset = buffer->range_offset();
-    int32_t buflen = buffer->range_length();
-
+void SkipCutBuffer::process(uint8_t *base, size_t capacity, size_t *offset, size_t *length) {
     // drop the initial data from the buffer if needed
     if (mFrontPadding > 0) {
         // still data left to drop
-        int32_t to_drop = (buflen < mFrontPadding) ? buflen : mFrontPadding;
-        offset += to_drop;
-        buflen -= to_drop;
-        buffer->set_range(offset, buflen);
+        size_t to_drop = std::min(*length, mFrontPadding);
+        *offset += to_drop;
+        *length -= to_drop;
         mFrontPadding -= to_drop;
     }
+    if (mBackPadding == 0) {
+        return;
+    }
 
+    // The ring holds at most mBackPadding bytes between calls. If those fit in front of the data
+    // and the data replenishes the held back bytes, pass the held back bytes and the data but its
+    // last mBackPadding bytes on in place.
+    size_t held = size();
+    if (held <= *offset && mBackPadding <= *length) {
+        take(base + *offset - held, held);
+        *offset -= held;
+        *length -= mBackPadding;
+        write(base + *offset + held + *length, mBackPadding);
+        *length += held;
+        return;
+    }
 
-    // append data to cutbuffer
-    char *src = ((char*) buffer->data()) + offset;
-    write(src, buflen);
+    // Otherwise, stream the data through the ring. The data passed on so far never exceeds the
+    // data consumed, so writing it to the front of the buffer does not overwrite pending data.
+    const uint8_t *src = base + *offset;
+    size_t pending = *length;
+    size_t copied = 0;
+    while (pending > 0) {
+        size_t num = std::min(pending, mCapacity - kRingMargin - size());
+        if (num == 0) {
+            ALOGW("no room in the ring, dropping %zu bytes", pending);
+            break;
+        }
+        write(src, num);
+        src += num;
+        pending -= num;
+        copied += read(base + copied, capacity - copied);
+    }
+    *offset = 0;
+    *length = copied;
+}
 
+void SkipCutBuffer::submit(MediaBuffer *buffer) {
+    if (mSkip == 0 && mBackPadding == 0) {
+        // passthrough mode
+        return;
+    }
 
-    // the mediabuffer is now empty. Fill it from cutbuffer, always leaving
-    // at least mBackPadding bytes in the cutbuffer
-    char *dst = (char*) buffer->data();
-    size_t copied = read(dst, buffer->size());
-    buffer->set_range(0, copied);
+    size_t offset = buffer->range_offset();
+    size_t length = buffer->range_length();
+    process((uint8_t *)buffer->data(), buffer->size(), &offset, &length);
+    buffer->set_range(offset, length);
 }
 
 template <typename T>
 void SkipCutBuffer::submitInternal(const sp<T>& buffer) {
-    if (mCutBuffer == NULL) {
+    if (mSkip == 0 && mBackPadding == 0) {
         // passthrough mode
         return;
     }
 
-    int32_t offset = buffer->offset();
-    int32_t buflen = buffer->size();
-
-    // drop the initial data from the buffer if needed
-    if (mFrontPadding > 0) {
-        // still data left to drop
-        int32_t to_drop = (buflen < mFrontPadding) ? buflen : mFrontPadding;
-        offset += to_drop;
-        buflen -= to_drop;
-        buffer->setRange(offset, buflen);
-        mFrontPadding -= to_drop;
-    }
-
-
-    // append data to cutbuffer
-    char *src = (char*) buffer->data();
-    write(src, buflen);
-
-
-    // the mediabuffer is now empty. Fill it from cutbuffer, always leaving
-    // at least mBackPadding bytes in the cutbuffer
-    char *dst = (char*) buffer->base();
-    size_t copied = read(dst, buffer->capacity());
-    buffer->setRange(0, copied);
+    size_t offset = buffer->offset();
+    size_t length = buffer->size();
+    process(buffer->base(), buffer->capacity(), &offset, &length);
+    buffer->setRange(offset, length);
 }
 
 void SkipCutBuffer::submit(const sp<ABuffer>& buffer) {
@@ -134,23 +168,9 @@ void SkipCutBuffer::clear() {
     mFrontPadding = mSkip;
 }
 
-void SkipCutBuffer::write(const char *src, size_t num) {
-    int32_t sizeused = (mWriteHead - mReadHead);
-    if (sizeused < 0) sizeused += mCapacity;
-
-    // Everything must fit. Make sure the buffer is a little larger than needed,
-    // so there is no ambiguity as to whether mWriteHead == mReadHead means buffer
-    // full or empty
-    size_t available = mCapacity - sizeused - 32;
-    if (available < num) {
-        int32_t newcapacity = mCapacity + (num - available);
-        char * newbuffer = new char[newcapacity];
-        memcpy(newbuffer, mCutBuffer, mCapacity);
-        delete [] mCutBuffer;
-        mCapacity = newcapacity;
-        mCutBuffer = newbuffer;
-        ALOGV("reallocated buffer at size %d", newcapacity);
-    }
+void SkipCutBuffer::write(const uint8_t *src, size_t num) {
+    // Everything must fit. Callers never write more than there is room for.
+    CHECK_LE(num, mCapacity - kRingMargin - size());
 
     size_t copyfirst = (mCapacity - mWriteHead);
     if (copyfirst > num) copyfirst = num;
@@ -168,18 +188,20 @@ void SkipCutBuffer::write(const char *src, size_t num) {
     }
 }
 
-size_t SkipCutBuffer::read(char *dst, size_t num) {
-    int32_t available = (mWriteHead - mReadHead);
-    if (available < 0) available += mCapacity;
-
-    available -= mBackPadding;
-    if (available <=0) {
+size_t SkipCutBuffer::read(uint8_t *dst, size_t num) {
+    size_t available = size();
+    if (available <= mBackPadding) {
         return 0;
     }
-    if (available < int32_t(num)) {
+    available -= mBackPadding;
+    if (available < num) {
         num = available;
     }
+    take(dst, num);
+    return num;
+}
 
+void SkipCutBuffer::take(uint8_t *dst, size_t num) {
     size_t copyfirst = (mCapacity - mReadHead);
     if (copyfirst > num) copyfirst = num;
     if (copyfirst) {
@@ -194,13 +216,13 @@ size_t SkipCutBuffer::read(char *dst, size_t num) {
             mReadHead += num;
         }
     }
-    return available;
 }
 
 size_t SkipCutBuffer::size() {
-    int32_t available = (mWriteHead - mReadHead);
-    if (available < 0) available += mCapacity;
-    return available;
+    if (mWriteHead >= mReadHead) {
+        return mWriteHead - mReadHead;
+    }
+    return mWriteHead + mCapacity - mReadHead;
 }
 
 }  // namespace android
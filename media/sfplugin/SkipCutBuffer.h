@@ -27,13 +27,18 @@ namespace android {
 /**
  * utility class to cut the start and end off a stream of data in MediaBuffers
  *
+ * Data held back for the cut is kept in a ring of fixed capacity. When the held back data fits in
+ * front of the range of a submitted buffer, the buffer is trimmed in place and only the held back
+ * data is copied; otherwise the data is streamed through the ring.
  */
 class SkipCutBuffer: public RefBase {
  public:
     // 'skip' is the number of frames to skip from the beginning
     // 'cut' is the number of frames to cut from the end
-    // 'num16BitChannels' is the number of channels, which are assumed to be 16 bit wide each
-    SkipCutBuffer(size_t skip, size_t cut, size_t num16Channels);
+    // 'frameSize' is the size of a frame (a sample of each channel) in bytes
+    // 'maxBufferSize' is the expected size of submitted data, used to size the ring. Larger
+    // buffers are still processed, in multiple passes.
+    SkipCutBuffer(size_t skip, size_t cut, size_t frameSize, size_t maxBufferSize = 0);
 
     // Submit one MediaBuffer for skipping and cutting. This may consume all or
     // some of the data in the buffer, or it may add data to it.
@@ -48,20 +53,26 @@ class SkipCutBuffer: public RefBase {
     virtual ~SkipCutBuffer();
 
  private:
-    void write(const char *src, size_t num);
-    size_t read(char *dst, size_t num);
+    // Skip and cut the data at [|*offset|, |*offset| + |*length|) in a buffer of |capacity|
+    // bytes at |base|, and update the range to the data to pass on.
+    void process(uint8_t *base, size_t capacity, size_t *offset, size_t *length);
+    void write(const uint8_t *src, size_t num);
+    // read up to |num| bytes, leaving the bytes to cut in the ring
+    size_t read(uint8_t *dst, size_t num);
+    // read |num| bytes, including bytes to cut
+    void take(uint8_t *dst, size_t num);
     template <typename T>
     void submitInternal(const sp<T>& buffer);
-    int32_t mSkip;
-    int32_t mFrontPadding;
-    int32_t mBackPadding;
-    int32_t mWriteHead;
-    int32_t mReadHead;
-    int32_t mCapacity;
-    char* mCutBuffer;
+    size_t mSkip;
+    size_t mFrontPadding;
+    size_t mBackPadding;
+    size_t mWriteHead;
+    size_t mReadHead;
+    size_t mCapacity;
+    uint8_t* mCutBuffer;
     DISALLOW_EVIL_CONSTRUCTORS(SkipCutBuffer);
 };
 
 }  // namespace android
 
-#endif  // OMX_CODEC_H_
+#endif  // SKIP_CUT_BUFFER_H_
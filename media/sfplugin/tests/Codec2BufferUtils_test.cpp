@@ -0,0 +1,290 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <C2AllocatorGralloc.h>
+#include <C2Buffer.h>
+#include <C2BufferPriv.h>
+
+#include <media/hardware/VideoAPI.h>
+#include <system/graphics.h>
+
+#include <Codec2BufferUtils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace android {
+
+namespace {
+
+// odd multiples of 2 so that the SIMD kernels also run their tail loops
+constexpr uint32_t kWidth = 182;
+constexpr uint32_t kHeight = 102;
+constexpr uint32_t kStride = kWidth + 26;
+constexpr uint32_t kVStride = kHeight + 6;
+
+uint8_t Pattern(uint32_t plane, uint32_t row, uint32_t col, uint32_t seed) {
+    return (uint8_t)(plane * 67 + row * 13 + col * 7 + seed);
+}
+
+struct Image {
+    const char *name;
+    MediaImage2 img;
+};
+
+std::vector<Image> CreateImages() {
+    MediaImage2 nv21 = CreateYUV420SemiPlanarMediaImage2(kWidth, kHeight, kStride, kVStride);
+    std::swap(nv21.mPlane[1].mOffset, nv21.mPlane[2].mOffset);
+    return {
+        { "I420", CreateYUV420PlanarMediaImage2(kWidth, kHeight, kStride, kVStride) },
+        { "NV12", CreateYUV420SemiPlanarMediaImage2(kWidth, kHeight, kStride, kVStride) },
+        { "NV21", nv21 },
+    };
+}
+
+uint8_t *ImageSample(
+        uint8_t *base, const MediaImage2 &img, uint32_t plane, uint32_t row, uint32_t col) {
+    return base + img.mPlane[plane].mOffset
+            + row * img.mPlane[plane].mRowInc + col * img.mPlane[plane].mColInc;
+}
+
+}  // namespace
+
+class ImageCopyTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::shared_ptr<C2BlockPool> pool =
+            std::make_shared<C2BasicGraphicBlockPool>(std::make_shared<C2AllocatorGralloc>('g'));
+        ASSERT_EQ(C2_OK, pool->fetchGraphicBlock(
+                kWidth, kHeight, HAL_PIXEL_FORMAT_YCBCR_420_888,
+                { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE },
+                &mBlock));
+        ASSERT_TRUE(mBlock);
+    }
+
+    static uint8_t *ViewSample(
+            const C2GraphicView &view, uint32_t plane, uint32_t row, uint32_t col) {
+        const C2PlaneInfo &info = view.layout().planes[plane];
+        return const_cast<uint8_t *>(view.data()[plane])
+                + row * info.rowInc + col * info.colInc;
+    }
+
+    std::shared_ptr<C2GraphicBlock> mBlock;
+};
+
+TEST_F(ImageCopyTest, ToMediaImage) {
+    for (const Image &image : CreateImages()) {
+        SCOPED_TRACE(image.name);
+        const MediaImage2 &img = image.img;
+        {
+            C2GraphicView view = mBlock->map().get();
+            ASSERT_EQ(C2_OK, view.error());
+            ASSERT_TRUE(IsYUV420(view));
+            for (uint32_t p = 0; p < 3; ++p) {
+                const C2PlaneInfo &info = view.layout().planes[p];
+                for (uint32_t row = 0; row < kHeight / info.rowSampling; ++row) {
+                    for (uint32_t col = 0; col < kWidth / info.colSampling; ++col) {
+                        *ViewSample(view, p, row, col) = Pattern(p, row, col, 1);
+                    }
+                }
+            }
+        }
+
+        std::vector<uint8_t> buffer(kStride * kVStride * 3 / 2, 0);
+        C2ConstGraphicBlock constBlock = mBlock->share(C2Rect(kWidth, kHeight), C2Fence());
+        const C2GraphicView view = constBlock.map().get();
+        ASSERT_EQ(C2_OK, view.error());
+        ASSERT_EQ(OK, ImageCopy(buffer.data(), &img, view));
+
+        for (uint32_t p = 0; p < 3; ++p) {
+            for (uint32_t row = 0; row < kHeight / img.mPlane[p].mVertSubsampling; ++row) {
+                for (uint32_t col = 0; col < kWidth / img.mPlane[p].mHorizSubsampling; ++col) {
+                    ASSERT_EQ(*ViewSample(view, p, row, col),
+                              *ImageSample(buffer.data(), img, p, row, col))
+                            << "plane " << p << " row " << row << " col " << col;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(ImageCopyTest, FromMediaImage) {
+    for (const Image &image : CreateImages()) {
+        SCOPED_TRACE(image.name);
+        const MediaImage2 &img = image.img;
+        std::vector<uint8_t> buffer(kStride * kVStride * 3 / 2, 0);
+        for (uint32_t p = 0; p < 3; ++p) {
+            for (uint32_t row = 0; row < kHeight / img.mPlane[p].mVertSubsampling; ++row) {
+                for (uint32_t col = 0; col < kWidth / img.mPlane[p].mHorizSubsampling; ++col) {
+                    *ImageSample(buffer.data(), img, p, row, col) = Pattern(p, row, col, 2);
+                }
+            }
+        }
+
+        C2GraphicView view = mBlock->map().get();
+        ASSERT_EQ(C2_OK, view.error());
+        ASSERT_EQ(OK, ImageCopy(view, buffer.data(), &img));
+
+        for (uint32_t p = 0; p < 3; ++p) {
+            const C2PlaneInfo &info = view.layout().planes[p];
+            for (uint32_t row = 0; row < kHeight / info.rowSampling; ++row) {
+                for (uint32_t col = 0; col < kWidth / info.colSampling; ++col) {
+                    ASSERT_EQ(Pattern(p, row, col, 2), *ViewSample(view, p, row, col))
+                            << "plane " << p << " row " << row << " col " << col;
+                }
+            }
+        }
+    }
+}
+
+TEST(ImageScaleTest, HalvesPlanarImage) {
+    std::shared_ptr<C2BlockPool> pool =
+        std::make_shared<C2BasicGraphicBlockPool>(std::make_shared<C2AllocatorGralloc>('g'));
+    std::shared_ptr<C2GraphicBlock> block;
+    ASSERT_EQ(C2_OK, pool->fetchGraphicBlock(
+            kWidth, kHeight, HAL_PIXEL_FORMAT_YV12,
+            { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE },
+            &block));
+    C2GraphicView view = block->map().get();
+    ASSERT_EQ(C2_OK, view.error());
+
+    // source image of twice the size where each 2x2 block has a single value, so that the
+    // box filter result is exact
+    constexpr uint32_t kSrcWidth = kWidth * 2;
+    constexpr uint32_t kSrcHeight = kHeight * 2;
+    std::vector<uint8_t> src(kSrcWidth * kSrcHeight * 3 / 2);
+    uint8_t *planes[3] = {
+        src.data(), src.data() + kSrcWidth * kSrcHeight,
+        src.data() + kSrcWidth * kSrcHeight * 5 / 4 };
+    for (uint32_t p = 0; p < 3; ++p) {
+        const uint32_t shift = p == 0 ? 0 : 1;
+        for (uint32_t row = 0; row < kSrcHeight >> shift; ++row) {
+            for (uint32_t col = 0; col < kSrcWidth >> shift; ++col) {
+                planes[p][row * (kSrcWidth >> shift) + col] = Pattern(p, row / 2, col / 2, 3);
+            }
+        }
+    }
+
+    ASSERT_EQ(OK, ImageScale(view, kWidth, kHeight, planes[0], planes[1], planes[2],
+                             kSrcWidth, kSrcWidth / 2, kSrcWidth / 2, kSrcWidth, kSrcHeight));
+    for (uint32_t p = 0; p < 3; ++p) {
+        const C2PlaneInfo &info = view.layout().planes[p];
+        for (uint32_t row = 0; row < kHeight / info.rowSampling; ++row) {
+            for (uint32_t col = 0; col < kWidth / info.colSampling; ++col) {
+                ASSERT_EQ(Pattern(p, row, col, 3),
+                          view.data()[p][row * info.rowInc + col * info.colInc])
+                        << "plane " << p << " row " << row << " col " << col;
+            }
+        }
+    }
+
+    // the scaled image must fit into the view
+    EXPECT_EQ(BAD_VALUE, ImageScale(
+            view, kWidth + 2, kHeight, planes[0], planes[1], planes[2],
+            kSrcWidth, kSrcWidth / 2, kSrcWidth / 2, kSrcWidth, kSrcHeight));
+}
+
+TEST(ConvertRGBToPlanarYUVTest, MatchesFloatReference) {
+    constexpr uint32_t kRgbWidth = 64;
+    constexpr uint32_t kRgbHeight = 34;
+    // allow for rounding of the fixed point (and SIMD) implementations
+    constexpr int kTolerance = 2;
+
+    std::shared_ptr<C2BlockPool> pool =
+        std::make_shared<C2BasicGraphicBlockPool>(std::make_shared<C2AllocatorGralloc>('g'));
+    std::shared_ptr<C2GraphicBlock> block;
+    ASSERT_EQ(C2_OK, pool->fetchGraphicBlock(
+            kRgbWidth, kRgbHeight, HAL_PIXEL_FORMAT_RGBA_8888,
+            { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE },
+            &block));
+    C2GraphicView view = block->map().get();
+    ASSERT_EQ(C2_OK, view.error());
+    const C2PlanarLayout &layout = view.layout();
+    auto sample = [&view, &layout](uint32_t plane, uint32_t row, uint32_t col) {
+        return view.data()[plane]
+                + row * layout.planes[plane].rowInc + col * layout.planes[plane].colInc;
+    };
+    for (uint32_t row = 0; row < kRgbHeight; ++row) {
+        for (uint32_t col = 0; col < kRgbWidth; ++col) {
+            *sample(C2PlanarLayout::PLANE_R, row, col) = (uint8_t)(row * 7 + col * 3);
+            *sample(C2PlanarLayout::PLANE_G, row, col) = (uint8_t)(row * 5 + col * 11 + 40);
+            *sample(C2PlanarLayout::PLANE_B, row, col) = (uint8_t)(255 - row * 3 - col * 2);
+        }
+    }
+
+    struct Case {
+        C2Color::matrix_t matrix;
+        C2Color::range_t range;
+        float kr, kb;
+    };
+    for (const Case &c : {
+            Case{ C2Color::MATRIX_BT601, C2Color::RANGE_LIMITED, 0.299f, 0.114f },
+            Case{ C2Color::MATRIX_BT601, C2Color::RANGE_FULL, 0.299f, 0.114f },
+            Case{ C2Color::MATRIX_BT709, C2Color::RANGE_LIMITED, 0.2126f, 0.0722f },
+            Case{ C2Color::MATRIX_BT709, C2Color::RANGE_FULL, 0.2126f, 0.0722f } }) {
+        SCOPED_TRACE(::testing::Message() << "matrix " << c.matrix << " range " << c.range);
+        std::vector<uint8_t> yuv(kRgbWidth * kRgbHeight * 3 / 2);
+        ASSERT_EQ(OK, ConvertRGBToPlanarYUV(
+                yuv.data(), kRgbWidth, kRgbHeight, yuv.size(), view, c.matrix, c.range));
+
+        const bool full = (c.range == C2Color::RANGE_FULL);
+        const float kg = 1.f - c.kr - c.kb;
+        auto luma = [&](float r, float g, float b) {
+            return c.kr * r + kg * g + c.kb * b;
+        };
+        auto check = [](float expected, uint8_t actual) {
+            expected = std::min(255.f, std::max(0.f, expected));
+            return std::abs(std::lround(expected) - (long)actual) <= kTolerance;
+        };
+        const uint8_t *u = yuv.data() + kRgbWidth * kRgbHeight;
+        const uint8_t *v = u + kRgbWidth * kRgbHeight / 4;
+        for (uint32_t row = 0; row < kRgbHeight; ++row) {
+            for (uint32_t col = 0; col < kRgbWidth; ++col) {
+                float y = luma(*sample(C2PlanarLayout::PLANE_R, row, col),
+                               *sample(C2PlanarLayout::PLANE_G, row, col),
+                               *sample(C2PlanarLayout::PLANE_B, row, col));
+                float expected = full ? y : 16.f + y * 219.f / 255.f;
+                ASSERT_TRUE(check(expected, yuv[row * kRgbWidth + col]))
+                        << "Y at row " << row << " col " << col << ": expected " << expected
+                        << ", got " << (int)yuv[row * kRgbWidth + col];
+                if ((row & 1) || (col & 1)) {
+                    continue;
+                }
+                float r = 0, g = 0, b = 0;
+                for (uint32_t i = 0; i < 4; ++i) {
+                    r += *sample(C2PlanarLayout::PLANE_R, row + i / 2, col + i % 2) / 4.f;
+                    g += *sample(C2PlanarLayout::PLANE_G, row + i / 2, col + i % 2) / 4.f;
+                    b += *sample(C2PlanarLayout::PLANE_B, row + i / 2, col + i % 2) / 4.f;
+                }
+                const float scale = full ? 1.f : 224.f / 255.f;
+                float expectedU = 128.f + scale * (b - luma(r, g, b)) / (2.f * (1.f - c.kb));
+                float expectedV = 128.f + scale * (r - luma(r, g, b)) / (2.f * (1.f - c.kr));
+                size_t ix = (row / 2) * (kRgbWidth / 2) + col / 2;
+                ASSERT_TRUE(check(expectedU, u[ix]))
+                        << "U at row " << row << " col " << col << ": expected " << expectedU
+                        << ", got " << (int)u[ix];
+                ASSERT_TRUE(check(expectedV, v[ix]))
+                        << "V at row " << row << " col " << col << ": expected " << expectedV
+                        << ", got " << (int)v[ix];
+            }
+        }
+    }
+}
+
+} // namespace android
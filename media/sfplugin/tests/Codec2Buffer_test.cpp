@@ -0,0 +1,176 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <C2Buffer.h>
+#include <C2BlockInternal.h>
+
+#include <media/hardware/VideoAPI.h>
+#include <media/stagefright/MediaCodecConstants.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+#include <Codec2Buffer.h>
+
+#include <vector>
+
+namespace android {
+
+namespace {
+
+constexpr uint32_t kWidth = 182;
+constexpr uint32_t kHeight = 102;
+constexpr uint32_t kStride = 256;
+constexpr uint32_t kVStride = 112;
+
+/**
+ * Graphic allocation in system memory with a fixed YUV 4:2:0 layout, so that tests do not depend
+ * on the layouts chosen by gralloc.
+ */
+class YUV420Allocation : public C2GraphicAllocation {
+public:
+    YUV420Allocation(uint32_t chromaColInc, uint32_t chromaRowInc, size_t uOffset, size_t vOffset)
+        : C2GraphicAllocation(kWidth, kHeight),
+          mMemory(kStride * kVStride * 2) {
+        mLayout.type = C2PlanarLayout::TYPE_YUV;
+        mLayout.numPlanes = 3;
+        mLayout.rootPlanes = chromaColInc == 1 ? 3 : 2;
+        mLayout.planes[C2PlanarLayout::PLANE_Y] = {
+            C2PlaneInfo::CHANNEL_Y, 1, kStride, 1, 1, 8, 8, 0, C2PlaneInfo::NATIVE,
+            C2PlanarLayout::PLANE_Y, 0 };
+        mLayout.planes[C2PlanarLayout::PLANE_U] = {
+            C2PlaneInfo::CHANNEL_CB, (int32_t)chromaColInc, (int32_t)chromaRowInc, 2, 2, 8, 8, 0,
+            C2PlaneInfo::NATIVE, C2PlanarLayout::PLANE_U, 0 };
+        mLayout.planes[C2PlanarLayout::PLANE_V] = {
+            C2PlaneInfo::CHANNEL_CR, (int32_t)chromaColInc, (int32_t)chromaRowInc, 2, 2, 8, 8, 0,
+            C2PlaneInfo::NATIVE, C2PlanarLayout::PLANE_V, 0 };
+        mOffsets[C2PlanarLayout::PLANE_Y] = 0;
+        mOffsets[C2PlanarLayout::PLANE_U] = uOffset;
+        mOffsets[C2PlanarLayout::PLANE_V] = vOffset;
+    }
+
+    ~YUV420Allocation() override = default;
+
+    c2_status_t map(
+            C2Rect, C2MemoryUsage, C2Fence *fence,
+            C2PlanarLayout *layout, uint8_t **addr) override {
+        if (fence) {
+            *fence = C2Fence();
+        }
+        *layout = mLayout;
+        for (uint32_t i = 0; i < mLayout.numPlanes; ++i) {
+            addr[i] = mMemory.data() + mOffsets[i];
+        }
+        return C2_OK;
+    }
+
+    c2_status_t unmap(uint8_t **, C2Rect, C2Fence *fence) override {
+        if (fence) {
+            *fence = C2Fence();
+        }
+        return C2_OK;
+    }
+
+    C2Allocator::id_t getAllocatorId() const override { return 0; }
+    const C2Handle *handle() const override { return nullptr; }
+    bool equals(const std::shared_ptr<const C2GraphicAllocation> &other) const override {
+        return other.get() == this;
+    }
+
+    const uint8_t *base() const { return mMemory.data(); }
+
+private:
+    std::vector<uint8_t> mMemory;
+    C2PlanarLayout mLayout;
+    size_t mOffsets[3];
+};
+
+struct Case {
+    const char *name;
+    int32_t colorFormat;
+    std::shared_ptr<YUV420Allocation> allocation;
+    bool zeroCopy;
+};
+
+std::vector<Case> CreateCases() {
+    constexpr size_t kLumaSize = kStride * kVStride;
+    auto i420 = [] {
+        return std::make_shared<YUV420Allocation>(
+                1, kStride / 2, kLumaSize, kLumaSize + kLumaSize / 4);
+    };
+    auto nv12 = [] {
+        return std::make_shared<YUV420Allocation>(2, kStride, kLumaSize, kLumaSize + 1);
+    };
+    auto yv12 = [] {
+        return std::make_shared<YUV420Allocation>(
+                1, kStride / 2, kLumaSize + kLumaSize / 4, kLumaSize);
+    };
+    return {
+        { "I420 as flexible", COLOR_FormatYUV420Flexible, i420(), true },
+        { "I420 as planar", COLOR_FormatYUV420Planar, i420(), true },
+        { "I420 as semi-planar", COLOR_FormatYUV420SemiPlanar, i420(), false },
+        { "NV12 as flexible", COLOR_FormatYUV420Flexible, nv12(), true },
+        { "NV12 as semi-planar", COLOR_FormatYUV420SemiPlanar, nv12(), true },
+        { "NV12 as planar", COLOR_FormatYUV420Planar, nv12(), false },
+        { "YV12 as flexible", COLOR_FormatYUV420Flexible, yv12(), true },
+        { "YV12 as planar", COLOR_FormatYUV420Planar, yv12(), false },
+    };
+}
+
+}  // namespace
+
+TEST(ConstGraphicBlockBufferTest, WrapsCompatibleLayouts) {
+    for (const Case &c : CreateCases()) {
+        SCOPED_TRACE(c.name);
+        std::shared_ptr<C2GraphicBlock> block = _C2BlockFactory::CreateGraphicBlock(c.allocation);
+        ASSERT_TRUE(block);
+        std::shared_ptr<C2Buffer> buffer = C2Buffer::CreateGraphicBuffer(
+                block->share(C2Rect(kWidth, kHeight), C2Fence()));
+
+        sp<AMessage> format = new AMessage;
+        format->setInt32("width", kWidth);
+        format->setInt32("height", kHeight);
+        format->setInt32("color-format", c.colorFormat);
+
+        size_t copies = 0;
+        sp<ConstGraphicBlockBuffer> clientBuffer = ConstGraphicBlockBuffer::Allocate(
+                format, buffer, [&copies](size_t capacity) {
+                    ++copies;
+                    return new ABuffer(capacity);
+                });
+        ASSERT_TRUE(clientBuffer != nullptr);
+        EXPECT_EQ(c.zeroCopy ? 0u : 1u, copies);
+        if (!c.zeroCopy) {
+            continue;
+        }
+        EXPECT_EQ(c.allocation->base(), clientBuffer->base());
+
+        sp<ABuffer> imageData;
+        ASSERT_TRUE(clientBuffer->meta()->findBuffer("image-data", &imageData));
+        const MediaImage2 *img = (const MediaImage2 *)imageData->data();
+        C2GraphicView view = block->map().get();
+        ASSERT_EQ(C2_OK, view.error());
+        for (uint32_t i = 0; i < 3; ++i) {
+            const C2PlaneInfo &plane = view.layout().planes[i];
+            EXPECT_EQ(view.data()[i], clientBuffer->base() + img->mPlane[i].mOffset);
+            EXPECT_EQ(plane.colInc, img->mPlane[i].mColInc);
+            EXPECT_EQ(plane.rowInc, img->mPlane[i].mRowInc);
+        }
+    }
+}
+
+} // namespace android
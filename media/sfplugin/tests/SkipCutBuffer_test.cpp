@@ -0,0 +1,113 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+
+#include <SkipCutBuffer.h>
+
+#include <vector>
+
+namespace android {
+
+namespace {
+
+constexpr size_t kSkipFrames = 529;
+constexpr size_t kCutFrames = 1105;
+
+struct Chunk {
+    size_t capacity;
+    size_t offset;
+    size_t size;
+};
+
+/**
+ * Submits |chunks| of a byte pattern to |scb|, and returns the bytes passed on.
+ */
+std::vector<uint8_t> Submit(const sp<SkipCutBuffer> &scb, const std::vector<Chunk> &chunks) {
+    std::vector<uint8_t> out;
+    uint8_t value = 0;
+    for (const Chunk &chunk : chunks) {
+        sp<ABuffer> buffer = new ABuffer(chunk.capacity);
+        for (size_t i = 0; i < chunk.size; ++i) {
+            buffer->base()[chunk.offset + i] = value++;
+        }
+        buffer->setRange(chunk.offset, chunk.size);
+        scb->submit(buffer);
+        out.insert(out.end(), buffer->data(), buffer->data() + buffer->size());
+    }
+    return out;
+}
+
+std::vector<uint8_t> Expected(size_t total, size_t skip, size_t cut) {
+    std::vector<uint8_t> out;
+    for (size_t i = skip; i + cut < total; ++i) {
+        out.push_back((uint8_t)i);
+    }
+    return out;
+}
+
+}  // namespace
+
+TEST(SkipCutBufferTest, SampleSizes) {
+    // 16-bit, 24-bit packed and 32-bit/float stereo
+    for (size_t frameSize : { 4u, 6u, 8u }) {
+        SCOPED_TRACE(::testing::Message() << "frame size " << frameSize);
+        sp<SkipCutBuffer> scb = new SkipCutBuffer(kSkipFrames, kCutFrames, frameSize, 4096);
+        std::vector<Chunk> chunks(40, Chunk{ 4096, 0, 4096 });
+        EXPECT_EQ(Expected(40 * 4096, kSkipFrames * frameSize, kCutFrames * frameSize),
+                  Submit(scb, chunks));
+        EXPECT_EQ(kCutFrames * frameSize, scb->size());
+    }
+}
+
+TEST(SkipCutBufferTest, BuffersLargerThanRing) {
+    sp<SkipCutBuffer> scb = new SkipCutBuffer(kSkipFrames, kCutFrames, 4, 1024);
+    std::vector<Chunk> chunks = {
+        { 65536, 0, 65536 }, { 20000, 0, 7 }, { 30000, 0, 30000 }, { 10, 0, 0 },
+    };
+    EXPECT_EQ(Expected(95543, kSkipFrames * 4, kCutFrames * 4), Submit(scb, chunks));
+}
+
+TEST(SkipCutBufferTest, TrimsInPlace) {
+    sp<SkipCutBuffer> scb = new SkipCutBuffer(0, 16, 1, 4096);
+    sp<ABuffer> buffer = new ABuffer(4096);
+    buffer->setRange(0, 1024);
+    scb->submit(buffer);
+    EXPECT_EQ(0u, buffer->offset());
+    EXPECT_EQ(1008u, buffer->size());
+
+    // the held back bytes are copied in front of the data
+    uint8_t *base = buffer->base();
+    buffer->setRange(100, 1024);
+    scb->submit(buffer);
+    EXPECT_EQ(base, buffer->base());
+    EXPECT_EQ(84u, buffer->offset());
+    EXPECT_EQ(1024u, buffer->size());
+}
+
+TEST(SkipCutBufferTest, Clear) {
+    sp<SkipCutBuffer> scb = new SkipCutBuffer(kSkipFrames, kCutFrames, 4, 4096);
+    std::vector<Chunk> chunks(4, Chunk{ 8192, 0, 8192 });
+    std::vector<uint8_t> expected = Expected(4 * 8192, kSkipFrames * 4, kCutFrames * 4);
+    EXPECT_EQ(expected, Submit(scb, chunks));
+    scb->clear();
+    EXPECT_EQ(0u, scb->size());
+    EXPECT_EQ(expected, Submit(scb, chunks));
+}
+
+} // namespace android
@@ -20,6 +20,7 @@
 
 #include <libyuv.h>
 
+#include <cmath>
 #include <list>
 #include <mutex>
 
@@ -54,6 +55,87 @@ struct MemCopier<false, S> {
     }
 };
 
+/**
+ * Chroma planes of an 8-bit YUV 4:2:0 image.
+ */
+template<typename Pixel>
+struct ChromaPlanes {
+    Pixel *u;
+    Pixel *v;
+    int32_t uColInc;
+    int32_t vColInc;
+    int32_t uRowInc;
+    int32_t vRowInc;
+
+    bool isPlanar() const {
+        return uColInc == 1 && vColInc == 1;
+    }
+
+    /// Whether U and V samples alternate in a single plane (as in NV12 or NV21).
+    bool isInterleaved() const {
+        return uColInc == 2 && vColInc == 2 && uRowInc == vRowInc && (v - u == 1 || u - v == 1);
+    }
+
+    bool isUFirst() const {
+        return u < v;
+    }
+};
+
+/**
+ * Copies chroma planes of an 8-bit YUV 4:2:0 image using libyuv row kernels (which use the SIMD
+ * extensions of the CPU, detected at runtime) if either side has interleaved chroma. The generic
+ * path would copy such planes one sample at a time.
+ *
+ * \return true if the chroma planes were copied.
+ */
+template<typename Pixel>
+static bool CopyChroma420(
+        const ChromaPlanes<const uint8_t> &src, const ChromaPlanes<Pixel> &dst,
+        int32_t width, int32_t height) {
+    if (src.isInterleaved() && dst.isPlanar()) {
+        bool uFirst = src.isUFirst();
+        libyuv::SplitUVPlane(std::min(src.u, src.v), src.uRowInc,
+                             uFirst ? dst.u : dst.v, uFirst ? dst.uRowInc : dst.vRowInc,
+                             uFirst ? dst.v : dst.u, uFirst ? dst.vRowInc : dst.uRowInc,
+                             width, height);
+        return true;
+    } else if (src.isPlanar() && dst.isInterleaved()) {
+        bool uFirst = dst.isUFirst();
+        libyuv::MergeUVPlane(uFirst ? src.u : src.v, uFirst ? src.uRowInc : src.vRowInc,
+                             uFirst ? src.v : src.u, uFirst ? src.vRowInc : src.uRowInc,
+                             std::min(dst.u, dst.v), dst.uRowInc,
+                             width, height);
+        return true;
+    } else if (src.isInterleaved() && dst.isInterleaved() && src.isUFirst() == dst.isUFirst()) {
+        libyuv::CopyPlane(std::min(src.u, src.v), src.uRowInc,
+                          std::min(dst.u, dst.v), dst.uRowInc,
+                          width * 2, height);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * A flippable CopyChroma420. Copies from B to A if ToA, otherwise from A to B.
+ */
+template<bool ToA>
+struct ChromaCopier {
+    template<typename A, typename B>
+    inline static bool copy(
+            const ChromaPlanes<A> &a, const ChromaPlanes<B> &b, int32_t width, int32_t height) {
+        return CopyChroma420(b, a, width, height);
+    }
+};
+
+template<>
+struct ChromaCopier<false> {
+    template<typename A, typename B>
+    inline static bool copy(
+            const ChromaPlanes<A> &a, const ChromaPlanes<B> &b, int32_t width, int32_t height) {
+        return CopyChroma420(a, b, width, height);
+    }
+};
+
 /**
  * Copies between a MediaImage and a graphic view.
  *
@@ -64,15 +146,11 @@ struct MemCopier<false, S> {
  */
 template<bool ToMediaImage, typename View, typename ImagePixel>
 static status_t _ImageCopy(View &view, const MediaImage2 *img, ImagePixel *imgBase) {
-    // TODO: more efficient copying --- e.g. copy interleaved planes together, etc.
     const C2PlanarLayout &layout = view.layout();
     const size_t bpp = divUp(img->mBitDepthAllocated, 8u);
 
+    // validate all planes before writing anything
     for (uint32_t i = 0; i < layout.numPlanes; ++i) {
-        typename std::conditional<ToMediaImage, uint8_t, const uint8_t>::type *imgRow =
-            imgBase + img->mPlane[i].mOffset;
-        typename std::conditional<ToMediaImage, const uint8_t, uint8_t>::type *viewRow =
-            viewRow = view.data()[i];
         const C2PlaneInfo &plane = layout.planes[i];
         if (plane.colSampling != img->mPlane[i].mHorizSubsampling
                 || plane.rowSampling != img->mPlane[i].mVertSubsampling
@@ -83,6 +161,37 @@ static status_t _ImageCopy(View &view, const MediaImage2 *img, ImagePixel *imgBa
                 || (bpp > 1 && plane.endianness != plane.NATIVE)) {
             return BAD_VALUE;
         }
+    }
+
+    // copy interleaved chroma planes together
+    bool chromaCopied = false;
+    if (IsYUV420(view) && IsYUV420(img)) {
+        typedef typename std::conditional<ToMediaImage, const uint8_t, uint8_t>::type ViewPixel;
+        ChromaPlanes<ImagePixel> imgChroma = {
+            imgBase + img->mPlane[1].mOffset, imgBase + img->mPlane[2].mOffset,
+            img->mPlane[1].mColInc, img->mPlane[2].mColInc,
+            img->mPlane[1].mRowInc, img->mPlane[2].mRowInc,
+        };
+        ChromaPlanes<ViewPixel> viewChroma = {
+            view.data()[C2PlanarLayout::PLANE_U], view.data()[C2PlanarLayout::PLANE_V],
+            layout.planes[C2PlanarLayout::PLANE_U].colInc,
+            layout.planes[C2PlanarLayout::PLANE_V].colInc,
+            layout.planes[C2PlanarLayout::PLANE_U].rowInc,
+            layout.planes[C2PlanarLayout::PLANE_V].rowInc,
+        };
+        chromaCopied = ChromaCopier<ToMediaImage>::copy(
+                imgChroma, viewChroma, img->mWidth / 2, img->mHeight / 2);
+    }
+
+    for (uint32_t i = 0; i < layout.numPlanes; ++i) {
+        typename std::conditional<ToMediaImage, uint8_t, const uint8_t>::type *imgRow =
+            imgBase + img->mPlane[i].mOffset;
+        typename std::conditional<ToMediaImage, const uint8_t, uint8_t>::type *viewRow =
+            viewRow = view.data()[i];
+        const C2PlaneInfo &plane = layout.planes[i];
+        if (chromaCopied && i != C2PlanarLayout::PLANE_Y) {
+            continue;
+        }
 
         uint32_t planeW = img->mWidth / plane.colSampling;
         uint32_t planeH = img->mHeight / plane.rowSampling;
@@ -98,6 +207,18 @@ static status_t _ImageCopy(View &view, const MediaImage2 *img, ImagePixel *imgBa
                 imgRow += img->mPlane[i].mRowInc;
                 viewRow += plane.rowInc;
             }
+        } else if (bpp == 1) {
+            for (uint32_t row = 0; row < planeH; ++row) {
+                decltype(imgRow) imgPtr = imgRow;
+                decltype(viewRow) viewPtr = viewRow;
+                for (uint32_t col = 0; col < planeW; ++col) {
+                    MemCopier<ToMediaImage, 1>::copy(imgPtr, viewPtr, 1);
+                    imgPtr += img->mPlane[i].mColInc;
+                    viewPtr += plane.colInc;
+                }
+                imgRow += img->mPlane[i].mRowInc;
+                viewRow += plane.rowInc;
+            }
         } else {
             for (uint32_t row = 0; row < planeH; ++row) {
                 decltype(imgRow) imgPtr = imgRow;
@@ -187,6 +308,36 @@ status_t ImageCopy(C2GraphicView &view, const uint8_t *imgBase, const MediaImage
     return _ImageCopy<false>(view, img, imgBase);
 }
 
+status_t ImageScale(
+        C2GraphicView &view, uint32_t dstWidth, uint32_t dstHeight,
+        const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
+        size_t srcYStride, size_t srcUStride, size_t srcVStride,
+        uint32_t srcWidth, uint32_t srcHeight) {
+    if (!IsYUV420(view) || dstWidth > view.width() || dstHeight > view.height()) {
+        return BAD_VALUE;
+    }
+    const C2PlanarLayout &layout = view.layout();
+    const C2PlaneInfo &planeY = layout.planes[C2PlanarLayout::PLANE_Y];
+    const C2PlaneInfo &planeU = layout.planes[C2PlanarLayout::PLANE_U];
+    const C2PlaneInfo &planeV = layout.planes[C2PlanarLayout::PLANE_V];
+    if (planeY.colInc != 1 || planeU.colInc != 1 || planeV.colInc != 1) {
+        ALOGD("scaling into semi-planar views is not supported");
+        return BAD_VALUE;
+    }
+    uint8_t *dstY = const_cast<uint8_t *>(view.data()[C2PlanarLayout::PLANE_Y]);
+    uint8_t *dstU = const_cast<uint8_t *>(view.data()[C2PlanarLayout::PLANE_U]);
+    uint8_t *dstV = const_cast<uint8_t *>(view.data()[C2PlanarLayout::PLANE_V]);
+    // the SIMD kernels of libyuv filter straight into the view, so the full size image is not
+    // copied before scaling
+    if (libyuv::I420Scale(
+            srcY, srcYStride, srcU, srcUStride, srcV, srcVStride, srcWidth, srcHeight,
+            dstY, planeY.rowInc, dstU, planeU.rowInc, dstV, planeV.rowInc, dstWidth, dstHeight,
+            libyuv::kFilterBox) != 0) {
+        return BAD_VALUE;
+    }
+    return OK;
+}
+
 bool IsYUV420(const C2GraphicView &view) {
     const C2PlanarLayout &layout = view.layout();
     return (layout.numPlanes == 3
@@ -225,6 +376,20 @@ bool IsNV12(const C2GraphicView &view) {
             && layout.planes[layout.PLANE_V].offset == 1);
 }
 
+bool IsNV21(const C2GraphicView &view) {
+    if (!IsYUV420(view)) {
+        return false;
+    }
+    const C2PlanarLayout &layout = view.layout();
+    return (layout.rootPlanes == 2
+            && layout.planes[layout.PLANE_U].colInc == 2
+            && layout.planes[layout.PLANE_U].rootIx == layout.PLANE_V
+            && layout.planes[layout.PLANE_U].offset == 1
+            && layout.planes[layout.PLANE_V].colInc == 2
+            && layout.planes[layout.PLANE_V].rootIx == layout.PLANE_V
+            && layout.planes[layout.PLANE_V].offset == 0);
+}
+
 bool IsI420(const C2GraphicView &view) {
     if (!IsYUV420(view)) {
         return false;
@@ -340,9 +505,102 @@ MediaImage2 CreateYUV420SemiPlanarMediaImage2(
     };
 }
 
+namespace {
+
+/**
+ * Fixed point (Q16) RGB to YUV conversion coefficients.
+ */
+struct RGBToYUVCoeffs {
+    int32_t yR, yG, yB, yOffset;
+    int32_t uR, uG, uB;
+    int32_t vR, vG, vB;
+
+    RGBToYUVCoeffs(C2Color::matrix_t matrix, C2Color::range_t range) {
+        float kr, kb;
+        switch (matrix) {
+            case C2Color::MATRIX_BT709:         kr = 0.2126f; kb = 0.0722f; break;
+            case C2Color::MATRIX_FCC47_73_682:  kr = 0.30f;   kb = 0.11f;   break;
+            case C2Color::MATRIX_240M:          kr = 0.212f;  kb = 0.087f;  break;
+            case C2Color::MATRIX_BT2020:
+            case C2Color::MATRIX_BT2020_CONSTANT:
+                                                kr = 0.2627f; kb = 0.0593f; break;
+            case C2Color::MATRIX_BT601:
+            default:                            kr = 0.299f;  kb = 0.114f;  break;
+        }
+        const float kg = 1.f - kr - kb;
+        const bool full = (range == C2Color::RANGE_FULL);
+        const float yScale = full ? 1.f : 219.f / 255.f;
+        const float cScale = full ? 1.f : 224.f / 255.f;
+        const float uScale = cScale / (2.f * (1.f - kb));
+        const float vScale = cScale / (2.f * (1.f - kr));
+        auto q16 = [](float f) { return (int32_t)std::lround(f * 65536.f); };
+        yR = q16(yScale * kr);
+        yG = q16(yScale * kg);
+        yB = q16(yScale * kb);
+        yOffset = full ? 0 : 16;
+        uR = q16(-uScale * kr);
+        uG = q16(-uScale * kg);
+        uB = q16(uScale * (1.f - kb));
+        vR = q16(vScale * (1.f - kr));
+        vG = q16(-vScale * kg);
+        vB = q16(-vScale * kb);
+    }
+
+    inline uint8_t y(int32_t r, int32_t g, int32_t b) const {
+        return Clip(((yR * r + yG * g + yB * b + 0x8000) >> 16) + yOffset);
+    }
+
+    // r, g and b are sums of 4 samples
+    inline uint8_t u(int32_t r4, int32_t g4, int32_t b4) const {
+        return Clip(((uR * r4 + uG * g4 + uB * b4 + 0x20000) >> 18) + 128);
+    }
+
+    inline uint8_t v(int32_t r4, int32_t g4, int32_t b4) const {
+        return Clip(((vR * r4 + vG * g4 + vB * b4 + 0x20000) >> 18) + 128);
+    }
+
+    static inline uint8_t Clip(int32_t value) {
+        return value < 0 ? 0 : value > 255 ? 255 : value;
+    }
+};
+
+/**
+ * Returns the libyuv conversion function for views with packed 8-bit RGBX/BGRX pixels, or
+ * nullptr if there is no libyuv function for the view layout and color space.
+ */
+decltype(&libyuv::ARGBToI420) GetLibyuvRGBToI420(
+        const C2GraphicView &src, C2Color::matrix_t matrix, C2Color::range_t range,
+        const uint8_t **base) {
+    const C2PlanarLayout &layout = src.layout();
+    const C2PlaneInfo &r = layout.planes[C2PlanarLayout::PLANE_R];
+    const C2PlaneInfo &g = layout.planes[C2PlanarLayout::PLANE_G];
+    const C2PlaneInfo &b = layout.planes[C2PlanarLayout::PLANE_B];
+    if (layout.type != C2PlanarLayout::TYPE_RGBA
+            || r.colInc != 4 || g.colInc != 4 || b.colInc != 4
+            || r.rowInc != g.rowInc || r.rowInc != b.rowInc
+            || r.allocatedDepth != 8 || g.allocatedDepth != 8 || b.allocatedDepth != 8
+            || (matrix != C2Color::MATRIX_BT601 && matrix != C2Color::MATRIX_UNSPECIFIED)) {
+        return nullptr;
+    }
+    const uint8_t *pR = src.data()[C2PlanarLayout::PLANE_R];
+    const uint8_t *pG = src.data()[C2PlanarLayout::PLANE_G];
+    const uint8_t *pB = src.data()[C2PlanarLayout::PLANE_B];
+    // libyuv names formats by little endian word order, e.g. "ABGR" is RGBA in memory
+    if (pG == pR + 1 && pB == pR + 2) {
+        *base = pR;
+        return range == C2Color::RANGE_FULL ? nullptr : libyuv::ABGRToI420;
+    } else if (pG == pB + 1 && pR == pB + 2) {
+        *base = pB;
+        return range == C2Color::RANGE_FULL ? libyuv::ARGBToJ420 : libyuv::ARGBToI420;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
 status_t ConvertRGBToPlanarYUV(
         uint8_t *dstY, size_t dstStride, size_t dstVStride, size_t bufferSize,
-        const C2GraphicView &src) {
+        const C2GraphicView &src, C2Color::matrix_t colorMatrix, C2Color::range_t colorRange) {
     CHECK(dstY != nullptr);
     CHECK((src.width() & 1) == 0);
     CHECK((src.height() & 1) == 0);
@@ -355,52 +613,59 @@ status_t ConvertRGBToPlanarYUV(
     uint8_t *dstU = dstY + dstStride * dstVStride;
     uint8_t *dstV = dstU + (dstStride >> 1) * (dstVStride >> 1);
 
+    const uint8_t *base = nullptr;
+    auto convert = GetLibyuvRGBToI420(src, colorMatrix, colorRange, &base);
+    if (convert) {
+        // use the SIMD kernels of libyuv for packed RGBA/BGRA
+        if (convert(base, src.layout().planes[C2PlanarLayout::PLANE_R].rowInc,
+                    dstY, dstStride, dstU, dstStride >> 1, dstV, dstStride >> 1,
+                    src.width(), src.height()) == 0) {
+            return OK;
+        }
+        ALOGD("libyuv RGB to YUV conversion failed; falling back");
+    }
+
+    const RGBToYUVCoeffs coeffs(colorMatrix, colorRange);
     const C2PlanarLayout &layout = src.layout();
+    const C2PlaneInfo &planeR = layout.planes[C2PlanarLayout::PLANE_R];
+    const C2PlaneInfo &planeG = layout.planes[C2PlanarLayout::PLANE_G];
+    const C2PlaneInfo &planeB = layout.planes[C2PlanarLayout::PLANE_B];
     const uint8_t *pRed   = src.data()[C2PlanarLayout::PLANE_R];
     const uint8_t *pGreen = src.data()[C2PlanarLayout::PLANE_G];
     const uint8_t *pBlue  = src.data()[C2PlanarLayout::PLANE_B];
 
-#define CLIP3(x,y,z) (((z) < (x)) ? (x) : (((z) > (y)) ? (y) : (z)))
-    for (size_t y = 0; y < src.height(); ++y) {
-        for (size_t x = 0; x < src.width(); ++x) {
-            uint8_t red = *pRed;
-            uint8_t green = *pGreen;
-            uint8_t blue = *pBlue;
-
-            // using ITU-R BT.601 conversion matrix
-            unsigned luma =
-                CLIP3(0, (((red * 66 + green * 129 + blue * 25) >> 8) + 16), 255);
-
-            dstY[x] = luma;
-
-            if ((x & 1) == 0 && (y & 1) == 0) {
-                unsigned U =
-                    CLIP3(0, (((-red * 38 - green * 74 + blue * 112) >> 8) + 128), 255);
-
-                unsigned V =
-                    CLIP3(0, (((red * 112 - green * 94 - blue * 18) >> 8) + 128), 255);
-
-                dstU[x >> 1] = U;
-                dstV[x >> 1] = V;
-            }
-            pRed   += layout.planes[C2PlanarLayout::PLANE_R].colInc;
-            pGreen += layout.planes[C2PlanarLayout::PLANE_G].colInc;
-            pBlue  += layout.planes[C2PlanarLayout::PLANE_B].colInc;
-        }
-
-        if ((y & 1) == 0) {
-            dstU += dstStride >> 1;
-            dstV += dstStride >> 1;
+    // convert two rows at a time so that chroma is computed from the average of each 2x2 block
+    for (size_t y = 0; y < src.height(); y += 2) {
+        const uint8_t *r0 = pRed,   *r1 = pRed + planeR.rowInc;
+        const uint8_t *g0 = pGreen, *g1 = pGreen + planeG.rowInc;
+        const uint8_t *b0 = pBlue,  *b1 = pBlue + planeB.rowInc;
+        uint8_t *y0 = dstY, *y1 = dstY + dstStride;
+        for (size_t x = 0; x < src.width(); x += 2) {
+            int32_t r00 = r0[0], r01 = r0[planeR.colInc], r10 = r1[0], r11 = r1[planeR.colInc];
+            int32_t g00 = g0[0], g01 = g0[planeG.colInc], g10 = g1[0], g11 = g1[planeG.colInc];
+            int32_t b00 = b0[0], b01 = b0[planeB.colInc], b10 = b1[0], b11 = b1[planeB.colInc];
+
+            y0[x]     = coeffs.y(r00, g00, b00);
+            y0[x + 1] = coeffs.y(r01, g01, b01);
+            y1[x]     = coeffs.y(r10, g10, b10);
+            y1[x + 1] = coeffs.y(r11, g11, b11);
+
+            int32_t r4 = r00 + r01 + r10 + r11;
+            int32_t g4 = g00 + g01 + g10 + g11;
+            int32_t b4 = b00 + b01 + b10 + b11;
+            dstU[x >> 1] = coeffs.u(r4, g4, b4);
+            dstV[x >> 1] = coeffs.v(r4, g4, b4);
+
+            r0 += 2 * planeR.colInc; r1 += 2 * planeR.colInc;
+            g0 += 2 * planeG.colInc; g1 += 2 * planeG.colInc;
+            b0 += 2 * planeB.colInc; b1 += 2 * planeB.colInc;
         }
-
-        pRed   -= layout.planes[C2PlanarLayout::PLANE_R].colInc * src.width();
-        pGreen -= layout.planes[C2PlanarLayout::PLANE_G].colInc * src.width();
-        pBlue  -= layout.planes[C2PlanarLayout::PLANE_B].colInc * src.width();
-        pRed   += layout.planes[C2PlanarLayout::PLANE_R].rowInc;
-        pGreen += layout.planes[C2PlanarLayout::PLANE_G].rowInc;
-        pBlue  += layout.planes[C2PlanarLayout::PLANE_B].rowInc;
-
-        dstY += dstStride;
+        pRed   += 2 * planeR.rowInc;
+        pGreen += 2 * planeG.rowInc;
+        pBlue  += 2 * planeB.rowInc;
+        dstY += 2 * dstStride;
+        dstU += dstStride >> 1;
+        dstV += dstStride >> 1;
     }
     return OK;
 }
@@ -18,6 +18,7 @@
 #define CODEC2_BUFFER_UTILS_H_
 
 #include <C2Buffer.h>
+#include <C2Config.h>
 #include <C2ParamDef.h>
 
 #include <media/hardware/VideoAPI.h>
@@ -26,20 +27,25 @@
 namespace android {
 
 /**
- * Converts an RGB view to planar YUV 420 media image.
+ * Converts an RGB view to planar YUV 420 media image. Chroma is computed from the average of each
+ * 2x2 block of pixels.
  *
- * \param dstY       pointer to media image buffer
- * \param dstStride  stride in bytes
- * \param dstVStride vertical stride in pixels
- * \param bufferSize media image buffer size
- * \param src source image
+ * \param dstY        pointer to media image buffer
+ * \param dstStride   stride in bytes
+ * \param dstVStride  vertical stride in pixels
+ * \param bufferSize  media image buffer size
+ * \param src         source image
+ * \param colorMatrix YUV matrix coefficients to use. Unspecified means BT.601.
+ * \param colorRange  YUV range to use. Unspecified means limited range.
  *
  * \retval NO_MEMORY media image is too small
  * \retval OK on success
  */
 status_t ConvertRGBToPlanarYUV(
         uint8_t *dstY, size_t dstStride, size_t dstVStride, size_t bufferSize,
-        const C2GraphicView &src);
+        const C2GraphicView &src,
+        C2Color::matrix_t colorMatrix = C2Color::MATRIX_BT601,
+        C2Color::range_t colorRange = C2Color::RANGE_LIMITED);
 
 /**
  * Returns a planar YUV 420 8-bit media image descriptor.
@@ -85,6 +91,32 @@ status_t ImageCopy(uint8_t *imgBase, const MediaImage2 *img, const C2GraphicView
  */
 status_t ImageCopy(C2GraphicView &view, const uint8_t *imgBase, const MediaImage2 *img);
 
+/**
+ * Scales a planar YUV 420 8-bit image into the top left corner of a graphic view with a planar
+ * (I420 or YV12) layout. Downscaling uses a box filter, so that every source pixel contributes
+ * to the result.
+ *
+ * \param view       destination graphic view
+ * \param dstWidth   width of the scaled image in pixels. Must be at most the view width.
+ * \param dstHeight  height of the scaled image in pixels. Must be at most the view height.
+ * \param srcY       luma plane of the source image
+ * \param srcU       Cb plane of the source image
+ * \param srcV       Cr plane of the source image
+ * \param srcYStride stride of the luma plane in bytes
+ * \param srcUStride stride of the Cb plane in bytes
+ * \param srcVStride stride of the Cr plane in bytes
+ * \param srcWidth   width of the source image in pixels
+ * \param srcHeight  height of the source image in pixels
+ *
+ * \retval BAD_VALUE the view does not have a planar YUV 420 layout or is too small
+ * \retval OK on success
+ */
+status_t ImageScale(
+        C2GraphicView &view, uint32_t dstWidth, uint32_t dstHeight,
+        const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
+        size_t srcYStride, size_t srcUStride, size_t srcVStride,
+        uint32_t srcWidth, uint32_t srcHeight);
+
 /**
  * Returns true iff a view has a YUV 420 888 layout.
  */
@@ -95,6 +127,11 @@ bool IsYUV420(const C2GraphicView &view);
  */
 bool IsNV12(const C2GraphicView &view);
 
+/**
+ * Returns true iff a view has a NV21 layout.
+ */
+bool IsNV21(const C2GraphicView &view);
+
 /**
  * Returns true iff a view has a I420 layout.
  */
@@ -296,10 +296,16 @@ ALookup<C2Config::profile_t, int32_t> sMpeg4Profiles = {
     { C2Config::PROFILE_MP4V_ADVANCED_SIMPLE,   MPEG4ProfileAdvancedSimple },
 };
 
+// AudioFormat.ENCODING_PCM_24BIT_PACKED and ENCODING_PCM_32BIT; not in MediaCodecConstants.h
+constexpr int32_t kEncodingPcm24bitPacked = 21;
+constexpr int32_t kEncodingPcm32bit = 22;
+
 ALookup<C2Config::pcm_encoding_t, int32_t> sPcmEncodings = {
     { C2Config::PCM_8, kAudioEncodingPcm8bit },
     { C2Config::PCM_16, kAudioEncodingPcm16bit },
     { C2Config::PCM_FLOAT, kAudioEncodingPcmFloat },
+    { C2Config::PCM_24, kEncodingPcm24bitPacked },
+    { C2Config::PCM_32, kEncodingPcm32bit },
 };
 
 ALookup<C2Config::level_t, int32_t> sVp9Levels = {